@@ -0,0 +1,144 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_FLAT_ID_MAP_H_
+#define MAIDSAFE_TRANSPORT_FLAT_ID_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace maidsafe {
+
+namespace transport {
+
+// A map from non-zero 64-bit ids to values, held in a single open-addressing
+// array with linear probing. Unlike a node-based map, inserting and erasing
+// an entry costs no allocation unless the array has to grow, and lookups of
+// the near-sequential ids transports generate touch few cache lines. Erasing
+// shifts later entries of a probe sequence back rather than leaving
+// tombstones, so lookups stay short however many entries have come and gone.
+// Values are moved when the array grows, so pointers to them are only valid
+// until the next insertion.
+template <typename T>
+class FlatIdMap {
+ public:
+  FlatIdMap() : slots_(kMinCapacity), size_(0) {}
+
+  // Returns the value for the id, or NULL if there is none.
+  T *Find(uint64_t id) {
+    for (size_t i = IndexOf(id); slots_[i].first != 0; i = Next(i)) {
+      if (slots_[i].first == id)
+        return &slots_[i].second;
+    }
+    return NULL;
+  }
+
+  // Inserts the value for the id, replacing any existing one.
+  void Insert(uint64_t id, const T &value) {
+    if (T *existing = Find(id)) {
+      *existing = value;
+      return;
+    }
+    // The array is kept at most half full, so probe sequences stay short.
+    if (2 * (size_ + 1) > slots_.size())
+      Grow();
+    size_t i(IndexOf(id));
+    while (slots_[i].first != 0)
+      i = Next(i);
+    slots_[i].first = id;
+    slots_[i].second = value;
+    ++size_;
+  }
+
+  // Removes the id's value, returning false if there was none.
+  bool Erase(uint64_t id) {
+    size_t i(IndexOf(id));
+    while (slots_[i].first != id) {
+      if (slots_[i].first == 0)
+        return false;
+      i = Next(i);
+    }
+    // Move back any later entry in the run which would otherwise become
+    // unreachable from its home slot.
+    for (size_t j = Next(i); slots_[j].first != 0; j = Next(j)) {
+      size_t home(IndexOf(slots_[j].first));
+      bool reachable(i <= j ? (i < home && home <= j) :
+                              (i < home || home <= j));
+      if (!reachable) {
+        std::swap(slots_[i], slots_[j]);
+        i = j;
+      }
+    }
+    slots_[i] = Slot();
+    --size_;
+    return true;
+  }
+
+  void Clear() {
+    std::vector<Slot>(kMinCapacity).swap(slots_);
+    size_ = 0;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t capacity() const { return slots_.size(); }
+
+ private:
+  typedef std::pair<uint64_t, T> Slot;
+  static const size_t kMinCapacity = 16;
+
+  size_t IndexOf(uint64_t id) const {
+    // Fibonacci hashing spreads ids which differ only in their low bits.
+    return static_cast<size_t>((id * 0x9E3779B97F4A7C15ULL) >> 32) &
+           (slots_.size() - 1);
+  }
+  size_t Next(size_t i) const { return (i + 1) & (slots_.size() - 1); }
+
+  void Grow() {
+    std::vector<Slot> slots(2 * slots_.size());
+    slots.swap(slots_);
+    for (auto it = slots.begin(); it != slots.end(); ++it) {
+      if (it->first == 0)
+        continue;
+      size_t i(IndexOf(it->first));
+      while (slots_[i].first != 0)
+        i = Next(i);
+      std::swap(slots_[i], *it);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  size_t size_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_FLAT_ID_MAP_H_
@@ -0,0 +1,176 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/transport/outbound_limiter.h"
+
+#include <functional>
+#include <vector>
+
+namespace asio = boost::asio;
+
+namespace maidsafe {
+
+namespace transport {
+
+// Keeps the message's owner alive, and releases the message's share of the
+// limits when destroyed.
+class OutboundLimiter::Ticket {
+ public:
+  Ticket(const std::shared_ptr<OutboundLimiter> &limiter,
+         const Key &key,
+         size_t size,
+         const std::shared_ptr<const void> &owner)
+      : limiter_(limiter), key_(key), size_(size), owner_(owner) {}
+  ~Ticket() { limiter_->Release(key_, size_); }
+ private:
+  Ticket(const Ticket&);
+  Ticket &operator=(const Ticket&);
+  std::shared_ptr<OutboundLimiter> limiter_;
+  Key key_;
+  size_t size_;
+  std::shared_ptr<const void> owner_;
+};
+
+OutboundLimiter::OutboundLimiter(asio::io_service &asio_service,  // NOLINT
+                                 const OnWritable &on_writable)
+    : asio_service_(asio_service),
+      on_writable_(on_writable),
+      limits_(),
+      usage_(),
+      total_(),
+      stalled_(),
+      mutex_() {}
+
+void OutboundLimiter::set_limits(const OutboundLimits &limits) {
+  boost::mutex::scoped_lock lock(mutex_);
+  limits_ = limits;
+}
+
+OutboundLimits OutboundLimiter::limits() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return limits_;
+}
+
+bool OutboundLimiter::Acquire(const Endpoint &endpoint,
+                              size_t size,
+                              std::shared_ptr<const void> *owner) {
+  Key key(endpoint.ip, endpoint.port);
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (limits_.endpoint_bytes == 0 && limits_.endpoint_messages == 0 &&
+        limits_.total_bytes == 0 && limits_.total_messages == 0)
+      return true;
+
+    // A message is always let through to an endpoint with nothing in flight,
+    // even if it is larger than the endpoint byte limit on its own, and while
+    // nothing at all is in flight, even if larger than the total byte limit.
+    auto it = usage_.find(key);
+    bool refused((it != usage_.end() &&
+        ((limits_.endpoint_messages != 0 &&
+          it->second.messages >= limits_.endpoint_messages) ||
+         (limits_.endpoint_bytes != 0 &&
+          it->second.bytes + size > limits_.endpoint_bytes))) ||
+        (limits_.total_messages != 0 &&
+         total_.messages >= limits_.total_messages) ||
+        (total_.messages != 0 && limits_.total_bytes != 0 &&
+         total_.bytes + size > limits_.total_bytes));
+    if (refused) {
+      stalled_.insert(key);
+      return false;
+    }
+    Usage &usage(usage_[key]);
+    ++usage.messages;
+    usage.bytes += size;
+    ++total_.messages;
+    total_.bytes += size;
+  }
+  owner->reset(new Ticket(shared_from_this(), key, size, *owner));
+  return true;
+}
+
+size_t OutboundLimiter::total_messages() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return total_.messages;
+}
+
+size_t OutboundLimiter::total_bytes() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return total_.bytes;
+}
+
+bool OutboundLimiter::HasRoom(const Usage &usage, const Usage &limits) const {
+  return (limits.messages == 0 || usage.messages < limits.messages) &&
+         (limits.bytes == 0 || usage.bytes < limits.bytes);
+}
+
+void OutboundLimiter::Release(const Key &key, size_t size) {
+  std::vector<Endpoint> writable;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    auto it = usage_.find(key);
+    if (it != usage_.end()) {
+      --it->second.messages;
+      it->second.bytes -= size;
+      if (it->second.messages == 0)
+        usage_.erase(it);
+    }
+    --total_.messages;
+    total_.bytes -= size;
+
+    Usage endpoint_limits, total_limits;
+    endpoint_limits.messages = limits_.endpoint_messages;
+    endpoint_limits.bytes = limits_.endpoint_bytes;
+    total_limits.messages = limits_.total_messages;
+    total_limits.bytes = limits_.total_bytes;
+    if (!HasRoom(total_, total_limits))
+      return;
+    for (auto stalled = stalled_.begin(); stalled != stalled_.end();) {
+      auto usage = usage_.find(*stalled);
+      if (usage == usage_.end() || HasRoom(usage->second, endpoint_limits)) {
+        writable.push_back(Endpoint(stalled->first, stalled->second));
+        stalled_.erase(stalled++);
+      } else {
+        ++stalled;
+      }
+    }
+  }
+
+  // As with received messages, the signal is fired outside the caller's
+  // strand.
+  for (auto it = writable.begin(); it != writable.end(); ++it)
+    asio_service_.post(std::bind(&OutboundLimiter::SignalWritable,
+                                 on_writable_, *it));
+}
+
+void OutboundLimiter::SignalWritable(const OnWritable &on_writable,
+                                     const Endpoint &endpoint) {
+  (*on_writable)(endpoint);
+}
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -0,0 +1,108 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_OUTBOUND_LIMITER_H_
+#define MAIDSAFE_TRANSPORT_OUTBOUND_LIMITER_H_
+
+#include <map>
+#include <memory>
+#include <set>
+#include <utility>
+#include "boost/asio/io_service.hpp"
+#include "boost/thread/mutex.hpp"
+#include "maidsafe/transport/transport.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+// Counts the messages a transport has accepted for sending against its
+// OutboundLimits. Each accepted message holds a ticket, and is counted until
+// the last copy of its ticket is destroyed, so the transport only needs to
+// drop the message's owner once the message has been written out or has
+// failed. When a ticket is released, any endpoint which had a message refused
+// and now has room is signalled through on_writable.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Weffc++"
+#endif
+class OutboundLimiter : public std::enable_shared_from_this<OutboundLimiter> {
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+ public:
+  OutboundLimiter(boost::asio::io_service &asio_service,  // NOLINT
+                  const OnWritable &on_writable);
+
+  void set_limits(const OutboundLimits &limits);
+  OutboundLimits limits();
+
+  // Accounts for a message of the given size to the endpoint. On success the
+  // owner is replaced by a ticket which keeps the original owner alive, and
+  // which is to be held until the message is no longer in flight. Returns
+  // false if the message would exceed the limits, in which case the endpoint
+  // is signalled once there is room. Without limits, owner is left unchanged.
+  bool Acquire(const Endpoint &endpoint,
+               size_t size,
+               std::shared_ptr<const void> *owner);
+
+  // The number of messages and bytes currently in flight in total.
+  size_t total_messages();
+  size_t total_bytes();
+
+ private:
+  OutboundLimiter(const OutboundLimiter&);
+  OutboundLimiter &operator=(const OutboundLimiter&);
+
+  class Ticket;
+  typedef std::pair<IP, Port> Key;
+  struct Usage {
+    Usage() : messages(0), bytes(0) {}
+    size_t messages, bytes;
+  };
+
+  bool HasRoom(const Usage &usage, const Usage &limits) const;
+  void Release(const Key &key, size_t size);
+  static void SignalWritable(const OnWritable &on_writable,
+                             const Endpoint &endpoint);
+
+  boost::asio::io_service &asio_service_;
+  OnWritable on_writable_;
+  OutboundLimits limits_;
+  std::map<Key, Usage> usage_;
+  Usage total_;
+  // Endpoints with a refused message, waiting to be signalled.
+  std::set<Key> stalled_;
+  boost::mutex mutex_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_OUTBOUND_LIMITER_H_
@@ -0,0 +1,134 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/transport/rudp_aimd_congestion.h"
+
+#include <algorithm>
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+RudpAimdCongestion::RudpAimdCongestion()
+  : send_window_size_(RudpParameters::default_window_size),
+    send_data_size_(RudpParameters::default_data_size),
+    send_delay_(RudpParameters::default_send_delay),
+    lost_packets_(0),
+    corrupted_packets_(0) {
+}
+
+void RudpAimdCongestion::OnAck(const RudpAckSample &sample) {
+  // Each time an ack packet received, we check whether during this interval,
+  // any packet reported to be lost or corrupted. If none, increase size,
+  // otherwise decrease size
+  bool congested((corrupted_packets_ + lost_packets_) > sample.allowed_lost);
+  if (congested) {
+    send_data_size_ = static_cast<size_t>(0.9 * send_data_size_);
+    send_data_size_ =
+        std::max(static_cast<size_t> (RudpParameters::default_data_size),
+                 send_data_size_);
+  } else {
+    send_data_size_ = static_cast<size_t>(1.5 * send_data_size_);
+    send_data_size_ =
+        std::min(static_cast<size_t> (RudpParameters::max_data_size),
+                               send_data_size_);
+  }
+  corrupted_packets_ = 0;
+  lost_packets_ = 0;
+  // If the other side still has some available buffer size, then the speed
+  // can be increased this side. Otherwise, the sender's speed shall be reduced
+  // To prevent osillator:
+  //    a minum margin of 8 * max_data_size for increase is taken
+  //    a step of 20% for reducing window size is defined
+  if (sample.available_buffer_size > (8 * send_data_size_)) {
+    send_window_size_ += (sample.available_buffer_size + 1) /
+                         RudpParameters::max_data_size;
+    send_window_size_ = std::min(send_window_size_,
+        static_cast<size_t> (RudpParameters::maximum_window_size));
+  } else {
+    send_window_size_ = static_cast<size_t>(0.9 * send_window_size_);
+    send_window_size_ = std::max(send_window_size_,
+        static_cast<size_t>(RudpParameters::default_window_size));
+  }
+  UpdateSendDelay(sample, congested);
+}
+
+void RudpAimdCongestion::UpdateSendDelay(const RudpAckSample &sample,
+                                         bool congested) {
+  // Spread the window over a round trip, but never send faster than the
+  // estimated link capacity, nor, once packets are being lost, faster than the
+  // peer has been receiving them. Rates are in packets per second.
+  double rate(0.0);
+  if (sample.round_trip_time != 0)
+    rate = 1000000.0 * send_window_size_ /
+           (sample.round_trip_time + sample.round_trip_time_variance);
+  if (sample.estimated_link_capacity != 0 &&
+      (rate == 0.0 || rate > sample.estimated_link_capacity))
+    rate = sample.estimated_link_capacity;
+  if (congested && sample.packets_receiving_rate != 0 &&
+      (rate == 0.0 || rate > sample.packets_receiving_rate))
+    rate = sample.packets_receiving_rate;
+  if (rate == 0.0)
+    return;
+
+  send_delay_ = std::min(
+      bptime::time_duration(bptime::microseconds(
+          static_cast<boost::int64_t>(1000000.0 / rate))),
+      RudpParameters::default_send_delay);
+}
+
+void RudpAimdCongestion::OnNegativeAck(boost::uint32_t /*seqnum*/,
+                                       const bptime::ptime &/*now*/) {
+  ++corrupted_packets_;
+}
+
+void RudpAimdCongestion::OnSendTimeout(boost::uint32_t /*seqnum*/,
+                                       const bptime::ptime &/*now*/) {
+  ++lost_packets_;
+}
+
+void RudpAimdCongestion::OnAckOfAck(boost::uint32_t /*round_trip_time*/,
+                                    const bptime::ptime &/*now*/) {
+}
+
+size_t RudpAimdCongestion::SendWindowSize() const {
+  return send_window_size_;
+}
+
+size_t RudpAimdCongestion::SendDataSize() const {
+  return send_data_size_;
+}
+
+bptime::time_duration RudpAimdCongestion::SendDelay() const {
+  return send_delay_;
+}
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -0,0 +1,74 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_AIMD_CONGESTION_H_
+#define MAIDSAFE_TRANSPORT_RUDP_AIMD_CONGESTION_H_
+
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+// The original RUDP heuristics. The window grows while the peer reports free
+// buffer space and shrinks by 10% when it doesn't; the packet size grows by
+// half on each acknowledgement without loss and shrinks by 10% after losses.
+class RudpAimdCongestion : public RudpCongestionAlgorithm {
+ public:
+  RudpAimdCongestion();
+
+  virtual void OnAck(const RudpAckSample &sample);
+  virtual void OnNegativeAck(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now);
+  virtual void OnSendTimeout(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now);
+  virtual void OnAckOfAck(boost::uint32_t round_trip_time,
+                          const boost::posix_time::ptime &now);
+
+  virtual size_t SendWindowSize() const;
+  virtual size_t SendDataSize() const;
+  virtual boost::posix_time::time_duration SendDelay() const;
+
+ private:
+  // Derive the send delay, the interval between data packets, from the
+  // window, the round trip time and the rates reported by the peer.
+  void UpdateSendDelay(const RudpAckSample &sample, bool congested);
+
+  size_t send_window_size_;
+  size_t send_data_size_;
+  boost::posix_time::time_duration send_delay_;
+
+  // The packets lost since the last acknowledgement.
+  size_t lost_packets_;
+  size_t corrupted_packets_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_AIMD_CONGESTION_H_
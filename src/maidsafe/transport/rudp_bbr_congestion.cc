@@ -0,0 +1,264 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/transport/rudp_bbr_congestion.h"
+
+#include <algorithm>
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+// 2/ln(2), the lowest gain which doubles the delivery rate each round.
+static const double kHighGain(2.885);
+static const double kDrainGain(1.0 / kHighGain);
+static const double kWindowGain(2.0);
+static const double kPacingGainCycle[] = { 1.25, 0.75, 1.0, 1.0,
+                                           1.0, 1.0, 1.0, 1.0 };
+static const size_t kPacingGainCycleLength(8);
+static const size_t kBandwidthWindowRounds(10);
+static const double kFullBandwidthGrowth(1.25);
+static const size_t kFullBandwidthRounds(3);
+static const bptime::time_duration kMinRoundTripTimeWindow(
+    bptime::seconds(10));
+static const bptime::time_duration kProbeRoundTripTimeDuration(
+    bptime::milliseconds(200));
+static const size_t kMinimumWindow(4);
+
+RudpBbrCongestion::RudpBbrCongestion()
+  : mode_(kStartup),
+    round_bandwidths_(kBandwidthWindowRounds, 0.0),
+    round_count_(0),
+    round_start_(bptime::neg_infin),
+    delivered_(0),
+    delivery_start_(),
+    min_round_trip_time_(0),
+    min_round_trip_time_stamp_(),
+    full_bandwidth_(0.0),
+    full_bandwidth_rounds_(0),
+    cycle_index_(0),
+    cycle_start_(),
+    probe_rtt_end_(),
+    pacing_gain_(kHighGain),
+    window_gain_(kHighGain),
+    send_window_size_(RudpParameters::default_window_size),
+    send_delay_(RudpParameters::default_send_delay) {
+}
+
+void RudpBbrCongestion::OnAck(const RudpAckSample &sample) {
+  bool min_round_trip_time_expired = UpdateMinRoundTripTime(sample);
+  bool round_start = UpdateBandwidth(sample);
+  UpdateMode(sample, round_start, min_round_trip_time_expired);
+  UpdateSendWindowSize(sample);
+  UpdateSendDelay(sample);
+}
+
+bool RudpBbrCongestion::UpdateMinRoundTripTime(const RudpAckSample &sample) {
+  bool expired = !min_round_trip_time_stamp_.is_not_a_date_time() &&
+                 sample.now > min_round_trip_time_stamp_ +
+                              kMinRoundTripTimeWindow;
+  if (sample.round_trip_time != 0 &&
+      (min_round_trip_time_ == 0 ||
+       sample.round_trip_time <= min_round_trip_time_ || expired)) {
+    min_round_trip_time_ = sample.round_trip_time;
+    min_round_trip_time_stamp_ = sample.now;
+  }
+  return expired;
+}
+
+bool RudpBbrCongestion::UpdateBandwidth(const RudpAckSample &sample) {
+  // Acknowledgements are generated at a fixed interval, but can arrive
+  // bunched up, so the delivery rate is measured over at least half that
+  // interval.
+  delivered_ += sample.packets_acknowledged;
+  if (delivery_start_.is_not_a_date_time()) {
+    delivered_ = 0;
+    delivery_start_ = sample.now;
+    return false;
+  }
+  boost::int64_t elapsed = (sample.now - delivery_start_).total_microseconds();
+  if (elapsed < RudpParameters::ack_interval.total_microseconds() / 2)
+    return false;
+  double rate = 1e6 * delivered_ / elapsed;
+  delivered_ = 0;
+  delivery_start_ = sample.now;
+
+  bool round_start = sample.now >= round_start_ + RoundDuration();
+  if (round_start) {
+    ++round_count_;
+    round_start_ = sample.now;
+    round_bandwidths_[round_count_ % kBandwidthWindowRounds] = 0.0;
+  }
+  double &round_bandwidth =
+      round_bandwidths_[round_count_ % kBandwidthWindowRounds];
+  round_bandwidth = std::max(round_bandwidth, rate);
+  return round_start;
+}
+
+void RudpBbrCongestion::UpdateMode(const RudpAckSample &sample,
+                                   bool round_start,
+                                   bool min_round_trip_time_expired) {
+  switch (mode_) {
+    case kStartup:
+      if (round_start) {
+        if (Bandwidth() >= full_bandwidth_ * kFullBandwidthGrowth) {
+          full_bandwidth_ = Bandwidth();
+          full_bandwidth_rounds_ = 0;
+        } else {
+          ++full_bandwidth_rounds_;
+        }
+      }
+      if (FilledPipe()) {
+        mode_ = kDrain;
+        pacing_gain_ = kDrainGain;
+        window_gain_ = kHighGain;
+      }
+      break;
+    case kDrain:
+      if (sample.packets_in_flight <= BandwidthDelayProduct())
+        EnterProbeBandwidth(sample.now);
+      break;
+    case kProbeBandwidth:
+      if (sample.now >= cycle_start_ + RoundDuration()) {
+        cycle_index_ = (cycle_index_ + 1) % kPacingGainCycleLength;
+        cycle_start_ = sample.now;
+        pacing_gain_ = kPacingGainCycle[cycle_index_];
+      }
+      break;
+    case kProbeRoundTripTime:
+      if (sample.now >= probe_rtt_end_) {
+        min_round_trip_time_stamp_ = sample.now;
+        if (FilledPipe())
+          EnterProbeBandwidth(sample.now);
+        else
+          EnterStartup();
+      }
+      break;
+  }
+
+  if (mode_ != kProbeRoundTripTime && min_round_trip_time_expired) {
+    mode_ = kProbeRoundTripTime;
+    pacing_gain_ = 1.0;
+    window_gain_ = 1.0;
+    probe_rtt_end_ = sample.now + kProbeRoundTripTimeDuration +
+                     RoundDuration();
+  }
+}
+
+void RudpBbrCongestion::UpdateSendWindowSize(const RudpAckSample &sample) {
+  if (mode_ == kProbeRoundTripTime) {
+    send_window_size_ = kMinimumWindow;
+    return;
+  }
+
+  // Until the pipe is full the window grows with each packet acknowledged,
+  // like slow start, so that it never holds back the measurement.
+  size_t target = static_cast<size_t>(window_gain_ * BandwidthDelayProduct());
+  if (FilledPipe())
+    send_window_size_ = std::min(
+        send_window_size_ + sample.packets_acknowledged, target);
+  else if (send_window_size_ < target || target == 0)
+    send_window_size_ += sample.packets_acknowledged;
+  send_window_size_ = std::max(send_window_size_, kMinimumWindow);
+  send_window_size_ = std::min(send_window_size_,
+      static_cast<size_t>(RudpParameters::maximum_window_size));
+}
+
+void RudpBbrCongestion::UpdateSendDelay(const RudpAckSample &sample) {
+  // Until the bandwidth has been measured the window is spread over the
+  // time until it is acknowledged.
+  double rate = pacing_gain_ * Bandwidth();
+  if (rate == 0.0 && sample.round_trip_time != 0)
+    rate = pacing_gain_ * 1e6 * send_window_size_ /
+           FeedbackDelay(sample.round_trip_time);
+  if (rate == 0.0)
+    return;
+  send_delay_ = std::min(
+      bptime::time_duration(bptime::microseconds(
+          static_cast<boost::int64_t>(1e6 / rate))),
+      RudpParameters::default_send_delay);
+}
+
+void RudpBbrCongestion::EnterStartup() {
+  mode_ = kStartup;
+  pacing_gain_ = kHighGain;
+  window_gain_ = kHighGain;
+}
+
+void RudpBbrCongestion::EnterProbeBandwidth(const bptime::ptime &now) {
+  mode_ = kProbeBandwidth;
+  cycle_index_ = 0;
+  cycle_start_ = now;
+  pacing_gain_ = kPacingGainCycle[cycle_index_];
+  window_gain_ = kWindowGain;
+}
+
+bool RudpBbrCongestion::FilledPipe() const {
+  return full_bandwidth_rounds_ >= kFullBandwidthRounds;
+}
+
+double RudpBbrCongestion::Bandwidth() const {
+  return *std::max_element(round_bandwidths_.begin(), round_bandwidths_.end());
+}
+
+double RudpBbrCongestion::BandwidthDelayProduct() const {
+  return Bandwidth() * FeedbackDelay(min_round_trip_time_) / 1e6;
+}
+
+bptime::time_duration RudpBbrCongestion::RoundDuration() const {
+  return bptime::microseconds(FeedbackDelay(min_round_trip_time_));
+}
+
+void RudpBbrCongestion::OnNegativeAck(boost::uint32_t /*seqnum*/,
+                                      const bptime::ptime &/*now*/) {
+}
+
+void RudpBbrCongestion::OnSendTimeout(boost::uint32_t /*seqnum*/,
+                                      const bptime::ptime &/*now*/) {
+}
+
+void RudpBbrCongestion::OnAckOfAck(boost::uint32_t /*round_trip_time*/,
+                                   const bptime::ptime &/*now*/) {
+}
+
+size_t RudpBbrCongestion::SendWindowSize() const {
+  return send_window_size_;
+}
+
+size_t RudpBbrCongestion::SendDataSize() const {
+  return RudpParameters::max_data_size;
+}
+
+bptime::time_duration RudpBbrCongestion::SendDelay() const {
+  return send_delay_;
+}
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -0,0 +1,122 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_BBR_CONGESTION_H_
+#define MAIDSAFE_TRANSPORT_RUDP_BBR_CONGESTION_H_
+
+#include <vector>
+
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+// A model-based algorithm after BBR. It estimates the bottleneck bandwidth as
+// the highest delivery rate seen over the last ten rounds, and the path's
+// propagation delay as the lowest round trip time seen over ten seconds.
+// Packets are paced at the bandwidth, scaled by a gain which depends on the
+// phase, and the window is twice the bandwidth-delay product:
+//   Startup   - the gain is 2/ln(2), doubling the rate each round, until the
+//               bandwidth stops growing by a quarter for three rounds
+//   Drain     - the gain is ln(2)/2, until the queue built up during Startup
+//               has emptied
+//   ProbeBw   - the gain cycles through 1.25, 0.75 and then six rounds of 1,
+//               probing for more bandwidth and draining any queue it built
+//   ProbeRtt  - if the lowest round trip time is ten seconds old, the window
+//               drops to four packets for 200 ms so that it can be measured
+// Losses are not taken as a sign of congestion. Packets are always of the
+// maximum size, so that the rates in packets reflect rates in bytes.
+class RudpBbrCongestion : public RudpCongestionAlgorithm {
+ public:
+  RudpBbrCongestion();
+
+  virtual void OnAck(const RudpAckSample &sample);
+  virtual void OnNegativeAck(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now);
+  virtual void OnSendTimeout(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now);
+  virtual void OnAckOfAck(boost::uint32_t round_trip_time,
+                          const boost::posix_time::ptime &now);
+
+  virtual size_t SendWindowSize() const;
+  virtual size_t SendDataSize() const;
+  virtual boost::posix_time::time_duration SendDelay() const;
+
+ private:
+  enum Mode { kStartup, kDrain, kProbeBandwidth, kProbeRoundTripTime };
+
+  // Add a delivery rate sample, returning whether a new round began.
+  bool UpdateBandwidth(const RudpAckSample &sample);
+  // Add a round trip time sample, returning whether the lowest had expired.
+  bool UpdateMinRoundTripTime(const RudpAckSample &sample);
+  void UpdateMode(const RudpAckSample &sample, bool round_start,
+                  bool min_round_trip_time_expired);
+  void UpdateSendWindowSize(const RudpAckSample &sample);
+  void UpdateSendDelay(const RudpAckSample &sample);
+  void EnterStartup();
+  void EnterProbeBandwidth(const boost::posix_time::ptime &now);
+  bool FilledPipe() const;
+
+  // The estimated bottleneck bandwidth, in packets per second, and the
+  // bandwidth-delay product, in packets. Both are zero until measured. As
+  // acknowledgements are sent at a fixed interval, the delay includes it.
+  double Bandwidth() const;
+  double BandwidthDelayProduct() const;
+  // A round lasts until the packets sent at its start are acknowledged.
+  boost::posix_time::time_duration RoundDuration() const;
+
+  Mode mode_;
+  // The highest delivery rate of each of the last ten rounds, indexed by the
+  // round count, and the time the current round began.
+  std::vector<double> round_bandwidths_;
+  boost::uint64_t round_count_;
+  boost::posix_time::ptime round_start_;
+  // The packets acknowledged since delivery_start_, not yet in a sample.
+  size_t delivered_;
+  boost::posix_time::ptime delivery_start_;
+  // The lowest round trip time, in microseconds, and when it was seen.
+  boost::uint32_t min_round_trip_time_;
+  boost::posix_time::ptime min_round_trip_time_stamp_;
+  // The bandwidth at which Startup last saw growth, and the rounds since.
+  double full_bandwidth_;
+  size_t full_bandwidth_rounds_;
+  // The current ProbeBw gain, and when it took effect.
+  size_t cycle_index_;
+  boost::posix_time::ptime cycle_start_;
+  // When ProbeRtt ends.
+  boost::posix_time::ptime probe_rtt_end_;
+  double pacing_gain_, window_gain_;
+  size_t send_window_size_;
+  boost::posix_time::time_duration send_delay_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_BBR_CONGESTION_H_
@@ -0,0 +1,53 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+
+#include "maidsafe/transport/rudp_aimd_congestion.h"
+#include "maidsafe/transport/rudp_bbr_congestion.h"
+#include "maidsafe/transport/rudp_cubic_congestion.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+std::unique_ptr<RudpCongestionAlgorithm> RudpCongestionAlgorithm::Create(
+    RudpParameters::CongestionAlgorithm algorithm) {
+  switch (algorithm) {
+    case RudpParameters::kCubic:
+      return std::unique_ptr<RudpCongestionAlgorithm>(new RudpCubicCongestion);
+    case RudpParameters::kBbr:
+      return std::unique_ptr<RudpCongestionAlgorithm>(new RudpBbrCongestion);
+    case RudpParameters::kAimd:
+    default:
+      return std::unique_ptr<RudpCongestionAlgorithm>(new RudpAimdCongestion);
+  }
+}
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -0,0 +1,122 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_CONGESTION_ALGORITHM_H_
+#define MAIDSAFE_TRANSPORT_RUDP_CONGESTION_ALGORITHM_H_
+
+#include <memory>
+
+#include "boost/cstdint.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+
+#include "maidsafe/transport/rudp_parameters.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+// The state of the path when an acknowledgement arrives, as measured by the
+// peer and smoothed by RudpCongestionControl, and by the sender.
+struct RudpAckSample {
+  RudpAckSample()
+      : now(),
+        round_trip_time(0),
+        round_trip_time_variance(0),
+        available_buffer_size(0),
+        packets_receiving_rate(0),
+        estimated_link_capacity(0),
+        packets_acknowledged(0),
+        packets_in_flight(0),
+        allowed_lost(0) {}
+  boost::posix_time::ptime now;
+  // In microseconds.
+  boost::uint32_t round_trip_time;
+  boost::uint32_t round_trip_time_variance;
+  // The space left in the peer's receive buffer, in bytes.
+  boost::uint32_t available_buffer_size;
+  // In packets per second.
+  boost::uint32_t packets_receiving_rate;
+  boost::uint32_t estimated_link_capacity;
+  // The packets acknowledged for the first time by this acknowledgement, and
+  // the packets sent but still unacknowledged after it.
+  size_t packets_acknowledged;
+  size_t packets_in_flight;
+  // The number of lost packets between acknowledgements which the connection
+  // type permits.
+  size_t allowed_lost;
+};
+
+// The strategy by which a connection's sender decides how much data may be
+// in flight and how fast to send it. RudpCongestionControl measures the path
+// and passes on the events, and the sender asks for the resulting values.
+class RudpCongestionAlgorithm {
+ public:
+  virtual ~RudpCongestionAlgorithm() {}
+
+  // Create an instance of the given algorithm.
+  static std::unique_ptr<RudpCongestionAlgorithm> Create(
+      RudpParameters::CongestionAlgorithm algorithm);
+
+  // Event notifications.
+  virtual void OnAck(const RudpAckSample &sample) = 0;
+  virtual void OnNegativeAck(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now) = 0;
+  virtual void OnSendTimeout(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now) = 0;
+  virtual void OnAckOfAck(boost::uint32_t round_trip_time,
+                          const boost::posix_time::ptime &now) = 0;
+
+  // The most packets which may be unacknowledged at once.
+  virtual size_t SendWindowSize() const = 0;
+  // The most data carried by each packet, in bytes.
+  virtual size_t SendDataSize() const = 0;
+  // The interval between sending packets.
+  virtual boost::posix_time::time_duration SendDelay() const = 0;
+
+ protected:
+  RudpCongestionAlgorithm() {}
+
+  // The time from sending a packet until its acknowledgement arrives, in
+  // microseconds. Acknowledgements are sent at a fixed interval rather than
+  // for each packet, so it is up to an interval longer than the round trip,
+  // and windows must cover it to keep the path busy between them.
+  static boost::uint32_t FeedbackDelay(boost::uint32_t round_trip_time) {
+    return round_trip_time + static_cast<boost::uint32_t>(
+        RudpParameters::ack_interval.total_microseconds());
+  }
+
+ private:
+  // Disallow copying and assignment.
+  RudpCongestionAlgorithm(const RudpCongestionAlgorithm&);
+  RudpCongestionAlgorithm &operator=(const RudpCongestionAlgorithm&);
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_CONGESTION_ALGORITHM_H_
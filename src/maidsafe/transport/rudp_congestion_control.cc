@@ -30,7 +30,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 #include <cmath>
 #include <limits>
-#include <vector>
+#include <utility>
 
 #include "boost/assert.hpp"
 
@@ -50,19 +50,17 @@ RudpCongestionControl::RudpCongestionControl()
     round_trip_time_variance_(0),
     packets_receiving_rate_(0),
     estimated_link_capacity_(0),
-    send_window_size_(RudpParameters::default_window_size),
+    algorithm_(RudpCongestionAlgorithm::Create(
+        RudpParameters::congestion_algorithm)),
     receive_window_size_(RudpParameters::default_window_size),
-    send_data_size_(RudpParameters::default_data_size),
-    send_delay_(RudpParameters::default_send_delay),
     send_timeout_(RudpParameters::default_send_timeout),
     receive_delay_(RudpParameters::default_receive_delay),
     receive_timeout_(RudpParameters::default_receive_timeout),
     ack_delay_(bptime::milliseconds(10)),
     ack_timeout_(RudpParameters::default_ack_timeout),
     ack_interval_(16),
-    lost_packets_(0),
-    corrupted_packets_(0),
-    arrival_times_(),
+    arrival_intervals_(),
+    last_arrival_time_(),
     packet_pair_intervals_(),
     peer_connection_type_(0),
     allowed_lost_(0),
@@ -71,6 +69,16 @@ RudpCongestionControl::RudpCongestionControl()
     transmission_speed_(0) {
 }
 
+void RudpCongestionControl::SetAlgorithm(
+    RudpParameters::CongestionAlgorithm algorithm) {
+  algorithm_ = RudpCongestionAlgorithm::Create(algorithm);
+}
+
+void RudpCongestionControl::SetAlgorithm(
+    std::unique_ptr<RudpCongestionAlgorithm> algorithm) {
+  algorithm_ = std::move(algorithm);
+}
+
 void RudpCongestionControl::OnOpen(boost::uint32_t /*send_seqnum*/,
                                    boost::uint32_t /*receive_seqnum*/) {
   transmitted_bits_ = 0;
@@ -86,39 +94,29 @@ void RudpCongestionControl::OnDataPacketSent(boost::uint32_t /*seqnum*/) {
 void RudpCongestionControl::OnDataPacketReceived(boost::uint32_t seqnum) {
   bptime::ptime now = RudpTickTimer::Now();
 
-  if ((seqnum % 16 == 1) && !arrival_times_.empty()) {
-    // The pushed in interval is the interval between every 16 arrived packets
-    packet_pair_intervals_.push_back(now - arrival_times_.back());
-    while (packet_pair_intervals_.size() > kMaxPacketPairIntervals)
-      packet_pair_intervals_.pop_front();
+  if (!last_arrival_time_.is_not_a_date_time()) {
+    boost::uint64_t interval = (now - last_arrival_time_).total_microseconds();
+    // The second packet of each pair is sent immediately after the first, so
+    // its interval measures the link capacity.
+    if (seqnum % 16 == 1)
+      packet_pair_intervals_.Add(interval);
+    arrival_intervals_.Add(interval);
   }
-
-  arrival_times_.push_back(now);
-  while (arrival_times_.size() > kMaxArrivalTimes)
-    arrival_times_.pop_front();
+  last_arrival_time_ = now;
 }
 
 void RudpCongestionControl::OnGenerateAck(boost::uint32_t /*seqnum*/) {
   // Need to have received at least 8 packets to calculate receiving rate.
-  if (arrival_times_.size() <= 8)
+  if (arrival_intervals_.Size() < 8)
     return;
 
-  // Calculate all packet arrival intervals.
-  std::vector<boost::uint64_t> intervals;
-  for (auto iter = arrival_times_.begin() + 1;
-       iter != arrival_times_.end(); ++iter)
-    intervals.push_back((*iter - *(iter - 1)).total_microseconds());
-
-  // Find the median packet arrival interval.
-  std::sort(intervals.begin(), intervals.end());
-  boost::uint64_t median = intervals[intervals.size() / 2];
-
-  // Calculate average of all intervals in range (median / 8) to (median * 8).
+  // Calculate average of all packet arrival intervals in range (median / 8)
+  // to (median * 8).
+  boost::uint64_t median = arrival_intervals_.Median();
   size_t num_valid_intervals = 0;
   boost::uint64_t total = 0;
-  for (auto iter = intervals.begin(); iter != intervals.end(); ++iter)
-    if ((median / 8 <= *iter) && (*iter <= median * 8))
-      ++num_valid_intervals, total += *iter;
+  arrival_intervals_.SumRange(median / 8, median * 8, &num_valid_intervals,
+                              &total);
 
   // Determine packet arrival speed only if we had more than 8 valid values.
   if ((total > 0) && (num_valid_intervals > 8)) {
@@ -134,16 +132,11 @@ void RudpCongestionControl::OnGenerateAck(boost::uint32_t /*seqnum*/) {
 
   // Need to have recorded some packet pair intervals to be able to calculate
   // the estimated link capacity.
-  if (!packet_pair_intervals_.empty()) {
+  if (!packet_pair_intervals_.IsEmpty()) {
     // Calculate the estimated link capacity by determining the median of the
     // packet pair intervals, and from that determining the number of packets
     // per second.
-    std::vector<boost::uint64_t> intervals;
-    for (auto iter = packet_pair_intervals_.begin();
-        iter != packet_pair_intervals_.end(); ++iter)
-      intervals.push_back(iter->total_microseconds());
-    std::sort(intervals.begin(), intervals.end());
-    boost::uint64_t median = intervals[intervals.size() / 2];
+    boost::uint64_t median = packet_pair_intervals_.Median();
     estimated_link_capacity_ =
         (median > 0) ? static_cast<boost::uint32_t>(1000000 / median) : 0;
   }
@@ -160,7 +153,6 @@ void RudpCongestionControl::OnGenerateAck(boost::uint32_t /*seqnum*/) {
 //                                   RudpParameters::default_window_size);
 //   receive_window_size_ = std::min(receive_window_size_,
 //                                   RudpParameters::maximum_window_size);
-  // TODO(Team) calculate SND (send_delay_).
 }
 
 void RudpCongestionControl::OnAck(boost::uint32_t /*seqnum*/) {
@@ -171,7 +163,9 @@ void RudpCongestionControl::OnAck(boost::uint32_t /*seqnum*/,
                                   boost::uint32_t round_trip_time_variance,
                                   boost::uint32_t available_buffer_size,
                                   boost::uint32_t packets_receiving_rate,
-                                  boost::uint32_t estimated_link_capacity) {
+                                  boost::uint32_t estimated_link_capacity,
+                                  size_t packets_acknowledged,
+                                  size_t packets_in_flight) {
   round_trip_time_ = round_trip_time;
   round_trip_time_variance_ = round_trip_time_variance;
 
@@ -190,45 +184,26 @@ void RudpCongestionControl::OnAck(boost::uint32_t /*seqnum*/,
     tmp = (tmp + estimated_link_capacity) / 8;
     estimated_link_capacity_ = static_cast<boost::uint32_t>(tmp);
   }
-  // Each time an ack packet received, we check whether during this interval,
-  // any packet reported to be lost or corrupted. If none, increase size,
-  // otherwise decrease size
-  if ((corrupted_packets_ + lost_packets_) > AllowedLost()) {
-    send_data_size_ = static_cast<size_t>(0.9 * send_data_size_);
-    send_data_size_ =
-        std::max(static_cast<size_t> (RudpParameters::default_data_size),
-                 send_data_size_);
-  } else {
-    send_data_size_ = static_cast<size_t>(1.5 * send_data_size_);
-    send_data_size_ =
-        std::min(static_cast<size_t> (RudpParameters::max_data_size),
-                               send_data_size_);
-  }
-  corrupted_packets_ = 0;
-  lost_packets_ = 0;
-  // If the other side still has some available buffer size, then the speed
-  // can be increased this side. Otherwise, the sender's speed shall be reduced
-  // To prevent osillator:
-  //    a minum margin of 8 * max_data_size for increase is taken
-  //    a step of 20% for reducing window size is defined
-  if (available_buffer_size > (8 * send_data_size_)) {
-    send_window_size_ += (available_buffer_size + 1) /
-                         RudpParameters::max_data_size;
-    send_window_size_ = std::min(send_window_size_,
-        static_cast<size_t> (RudpParameters::maximum_window_size));
-  } else {
-    send_window_size_ = static_cast<size_t>(0.9 * send_window_size_);
-    send_window_size_ = std::max(send_window_size_,
-        static_cast<size_t>(RudpParameters::default_window_size));
-  }
+
+  RudpAckSample sample;
+  sample.now = RudpTickTimer::Now();
+  sample.round_trip_time = round_trip_time_;
+  sample.round_trip_time_variance = round_trip_time_variance_;
+  sample.available_buffer_size = available_buffer_size;
+  sample.packets_receiving_rate = packets_receiving_rate_;
+  sample.estimated_link_capacity = estimated_link_capacity_;
+  sample.packets_acknowledged = packets_acknowledged;
+  sample.packets_in_flight = packets_in_flight;
+  sample.allowed_lost = AllowedLost();
+  algorithm_->OnAck(sample);
 }
 
-void RudpCongestionControl::OnNegativeAck(boost::uint32_t /*seqnum*/) {
-  ++corrupted_packets_;
+void RudpCongestionControl::OnNegativeAck(boost::uint32_t seqnum) {
+  algorithm_->OnNegativeAck(seqnum, RudpTickTimer::Now());
 }
 
-void RudpCongestionControl::OnSendTimeout(boost::uint32_t /*seqnum*/) {
-  ++lost_packets_;
+void RudpCongestionControl::OnSendTimeout(boost::uint32_t seqnum) {
+  algorithm_->OnSendTimeout(seqnum, RudpTickTimer::Now());
 }
 
 void RudpCongestionControl::OnAckOfAck(boost::uint32_t round_trip_time) {
@@ -247,6 +222,8 @@ void RudpCongestionControl::OnAckOfAck(boost::uint32_t round_trip_time) {
   ack_delay_ = bptime::microseconds(UINT64_C(4) * round_trip_time_);
   ack_delay_ += bptime::microseconds(round_trip_time_variance_);
   ack_delay_ += kSynPeriod;
+
+  algorithm_->OnAckOfAck(round_trip_time, RudpTickTimer::Now());
 }
 
 void RudpCongestionControl::SetPeerConnectionType(uint32_t connection_type) {
@@ -313,7 +290,7 @@ boost::uint32_t RudpCongestionControl::EstimatedLinkCapacity() const {
 }
 
 size_t RudpCongestionControl::SendWindowSize() const {
-  return send_window_size_;
+  return algorithm_->SendWindowSize();
 }
 
 size_t RudpCongestionControl::ReceiveWindowSize() const {
@@ -321,7 +298,7 @@ size_t RudpCongestionControl::ReceiveWindowSize() const {
 }
 
 size_t RudpCongestionControl::SendDataSize() const {
-  return send_data_size_;
+  return algorithm_->SendDataSize();
 }
 
 boost::uint32_t RudpCongestionControl::BestReadBufferSize() {
@@ -332,7 +309,7 @@ boost::uint32_t RudpCongestionControl::BestReadBufferSize() {
 }
 
 boost::posix_time::time_duration RudpCongestionControl::SendDelay() const {
-  return send_delay_;
+  return algorithm_->SendDelay();
 }
 
 boost::posix_time::time_duration RudpCongestionControl::SendTimeout() const {
@@ -30,11 +30,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_RUDP_CONGESTION_CONTROL_H_
 #define MAIDSAFE_TRANSPORT_RUDP_CONGESTION_CONTROL_H_
 
-#include <deque>
+#include <memory>
 
 #include "boost/cstdint.hpp"
 #include "boost/date_time/posix_time/posix_time_types.hpp"
 
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+#include "maidsafe/transport/rudp_median_filter.h"
 #include "maidsafe/transport/rudp_sliding_window.h"
 #include "maidsafe/transport/rudp_data_packet.h"
 #include "maidsafe/transport/rudp_tick_timer.h"
@@ -48,6 +50,13 @@ class RudpCongestionControl {
  public:
   RudpCongestionControl();
 
+  // Choose the algorithm which decides the send window, packet size and send
+  // delay, starting it afresh. Connections use
+  // RudpParameters::congestion_algorithm unless another is chosen.
+  void SetAlgorithm(RudpParameters::CongestionAlgorithm algorithm);
+  // As above, but with an algorithm provided by the caller.
+  void SetAlgorithm(std::unique_ptr<RudpCongestionAlgorithm> algorithm);
+
   // Event notifications.
   void OnOpen(boost::uint32_t send_seqnum,
               boost::uint32_t receive_seqnum);
@@ -61,7 +70,9 @@ class RudpCongestionControl {
              boost::uint32_t round_trip_time_variance,
              boost::uint32_t available_buffer_size,
              boost::uint32_t packets_receiving_rate,
-             boost::uint32_t estimated_link_capacity);
+             boost::uint32_t estimated_link_capacity,
+             size_t packets_acknowledged,
+             size_t packets_in_flight);
   void OnNegativeAck(boost::uint32_t seqnum);
   void OnSendTimeout(boost::uint32_t seqnum);
   void OnAckOfAck(boost::uint32_t round_trip_time);
@@ -109,10 +120,10 @@ class RudpCongestionControl {
   boost::uint32_t packets_receiving_rate_;
   boost::uint32_t estimated_link_capacity_;
 
-  size_t send_window_size_;
+  // The algorithm which decides the send window, packet size and send delay.
+  std::unique_ptr<RudpCongestionAlgorithm> algorithm_;
+
   size_t receive_window_size_;
-  size_t send_data_size_;
-  boost::posix_time::time_duration send_delay_;
   boost::posix_time::time_duration send_timeout_;
   boost::posix_time::time_duration receive_delay_;
   boost::posix_time::time_duration receive_timeout_;
@@ -120,14 +131,14 @@ class RudpCongestionControl {
   boost::posix_time::time_duration ack_timeout_;
   boost::uint32_t ack_interval_;
 
-  size_t lost_packets_;
-  size_t corrupted_packets_;
-
-  enum { kMaxArrivalTimes = 16 + 1 };
-  std::deque<boost::posix_time::ptime> arrival_times_;
+  // The intervals between the arrivals of the last packets, and the
+  // intervals within the last packet pairs, in microseconds.
+  enum { kMaxArrivalIntervals = 16 };
+  RudpMedianFilter<kMaxArrivalIntervals> arrival_intervals_;
+  boost::posix_time::ptime last_arrival_time_;
 
   enum { kMaxPacketPairIntervals = 16 + 1 };
-  std::deque<boost::posix_time::time_duration> packet_pair_intervals_;
+  RudpMedianFilter<kMaxPacketPairIntervals> packet_pair_intervals_;
 
   // The peer's connection type
   boost::uint32_t peer_connection_type_;
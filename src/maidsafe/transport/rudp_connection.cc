@@ -61,8 +61,12 @@ RudpConnection::RudpConnection(const std::shared_ptr<RudpTransport> &transport,
     response_deadline_(),
     remote_endpoint_(remote),
     buffer_(),
+    size_buffer_(sizeof(DataSize)),
+    write_buffers_(),
+    write_owner_(),
     data_size_(0),
     data_received_(0),
+    stream_(),
     timeout_for_response_(kDefaultInitialTimeout),
     timeout_state_(kNoTimeout) {
   static_assert((sizeof(DataSize)) == 4, "DataSize must be 4 bytes.");
@@ -79,6 +83,7 @@ void RudpConnection::Close() {
 }
 
 void RudpConnection::DoClose() {
+  FailStream(kNoConnection);
   if (std::shared_ptr<RudpTransport> transport = transport_.lock()) {
     // We're still connected to the transport. We need to detach and then
     // start flushing the socket to attempt a graceful closure.
@@ -142,9 +147,10 @@ void RudpConnection::HandleSimpleClientConnect(const bs::error_code &ec,
   }
 }
 
-void RudpConnection::StartSending(const std::string &data,
+void RudpConnection::StartSending(const ConstBuffers &data,
+                                  const std::shared_ptr<const void> &owner,
                                   const Timeout &timeout) {
-  EncodeData(data);
+  EncodeData(data, owner);
   timeout_for_response_ = timeout;
   strand_.dispatch(std::bind(&RudpConnection::DoStartSending,
                              shared_from_this()));
@@ -286,6 +292,13 @@ void RudpConnection::HandleReadSize(const bs::error_code &ec) {
   data_size_ = size;
   data_received_ = 0;
 
+  if (std::shared_ptr<RudpTransport> transport = transport_.lock()) {
+    Info info;
+    info.endpoint.ip = socket_.RemoteEndpoint().address();
+    info.endpoint.port = socket_.RemoteEndpoint().port();
+    stream_ = transport->SignalStreamStarted(size, info);
+  }
+
   timer_.expires_from_now(kStallTimeout);
   StartReadData();
 }
@@ -294,11 +307,14 @@ void RudpConnection::StartReadData() {
   if (Stopped())
     return CloseOnError(kNoConnection);
 
-  size_t buffer_size = data_received_;
+  // A streamed message is read into storage of its own for each part, which
+  // is handed over to the stream once read.
+  size_t offset(stream_ ? 0 : data_received_);
+  size_t buffer_size = offset;
   buffer_size += std::min(static_cast<size_t> (socket_.BestReadBufferSize()),
                           data_size_ - data_received_);
   buffer_.resize(buffer_size);
-  asio::mutable_buffer data_buffer = asio::buffer(buffer_) + data_received_;
+  asio::mutable_buffer data_buffer = asio::buffer(buffer_) + offset;
   socket_.AsyncRead(asio::buffer(data_buffer), 1,
                     strand_.wrap(std::bind(&RudpConnection::HandleReadData,
                                            shared_from_this(),
@@ -314,13 +330,49 @@ void RudpConnection::HandleReadData(const bs::error_code &ec, size_t length) {
 
   data_received_ += length;
 
+  if (stream_) {
+    std::shared_ptr<std::vector<unsigned char>> storage(
+        std::make_shared<std::vector<unsigned char>>());
+    storage->swap(buffer_);
+    SharedBuffer chunk(storage, 0, length);
+    MessageStreamPtr stream(stream_);
+    if (data_received_ == data_size_) {
+      // The last part and the completion are delivered outside the strand,
+      // as for a message received whole.
+      stream_.reset();
+      timer_.expires_at(boost::posix_time::pos_infin);
+      strand_.get_io_service().post(std::bind(&RudpConnection::DispatchStream,
+                                              shared_from_this(), stream,
+                                              chunk));
+      return;
+    }
+    if (length > 0)
+      timer_.expires_from_now(kStallTimeout);
+    if (socket_.IsSlowTransmission(length))
+      return CloseOnError(kReceiveTimeout);
+    // Start reading the next part before delivering this one, so that the
+    // stream's processing overlaps with receiving.
+    StartReadData();
+    if (length > 0)
+      stream->OnData(chunk);
+    return;
+  }
+
   if (data_received_ == data_size_) {
     // No timeout applies while dispatching the message.
     timer_.expires_at(boost::posix_time::pos_infin);
 
+    // Hand the received storage over to the message, so that it can be
+    // signalled without being copied.
+    std::shared_ptr<std::vector<unsigned char>> storage(
+        std::make_shared<std::vector<unsigned char>>());
+    storage->swap(buffer_);
+
     // Dispatch the message outside the strand.
     strand_.get_io_service().post(std::bind(&RudpConnection::DispatchMessage,
-                                            shared_from_this()));
+                                            shared_from_this(),
+                                            SharedBuffer(storage, 0,
+                                                         storage->size())));
   } else {
     // Need more data to complete the message.
     if (length > 0)
@@ -333,7 +385,7 @@ void RudpConnection::HandleReadData(const bs::error_code &ec, size_t length) {
   }
 }
 
-void RudpConnection::DispatchMessage() {
+void RudpConnection::DispatchMessage(const SharedBuffer &data) {
   if (std::shared_ptr<RudpTransport> transport = transport_.lock()) {
     // Signal message received and send response if applicable
     std::string response;
@@ -341,25 +393,52 @@ void RudpConnection::DispatchMessage() {
     Info info;
     info.endpoint.ip = socket_.RemoteEndpoint().address();
     info.endpoint.port = socket_.RemoteEndpoint().port();
-    (*transport->on_message_received_)(std::string(buffer_.begin(),
-                                                   buffer_.end()),
-                                       info, &response,
-                                       &response_timeout);
-    if (response.empty()) {
-      Close();
-      return;
-    }
+    transport->SignalMessageReceived(data, info, &response, &response_timeout);
+    SendResponse(&response, response_timeout);
+  }
+}
+
+void RudpConnection::DispatchStream(const MessageStreamPtr &stream,
+                                    const SharedBuffer &data) {
+  if (!data.empty())
+    stream->OnData(data);
+  std::string response;
+  Timeout response_timeout(kImmediateTimeout);
+  Info info;
+  info.endpoint.ip = socket_.RemoteEndpoint().address();
+  info.endpoint.port = socket_.RemoteEndpoint().port();
+  stream->OnComplete(info, &response, &response_timeout);
+  SendResponse(&response, response_timeout);
+}
 
-    EncodeData(response);
-    timeout_for_response_ = response_timeout;
-    strand_.dispatch(std::bind(&RudpConnection::StartWrite,
-                               shared_from_this()));
+void RudpConnection::SendResponse(std::string *response,
+                                  const Timeout &response_timeout) {
+  if (response->empty()) {
+    Close();
+    return;
   }
+
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>());
+  owner->swap(*response);
+  EncodeData(ConstBuffers(1, asio::buffer(*owner)), owner);
+  timeout_for_response_ = response_timeout;
+  strand_.dispatch(std::bind(&RudpConnection::StartWrite,
+                             shared_from_this()));
+}
+
+void RudpConnection::FailStream(const TransportCondition &error) {
+  if (!stream_)
+    return;
+  MessageStreamPtr stream(stream_);
+  stream_.reset();
+  stream->OnFailure(error);
 }
 
-void RudpConnection::EncodeData(const std::string &data) {
-  // Serialize message to internal buffer
-  DataSize msg_size = static_cast<DataSize>(data.size());
+void RudpConnection::EncodeData(const ConstBuffers &data,
+                                const std::shared_ptr<const void> &owner) {
+  // Serialize the message size to the internal buffer. The data itself is
+  // written straight from the caller's buffers.
+  DataSize msg_size = static_cast<DataSize>(asio::buffer_size(data));
   if (static_cast<size_t>(msg_size) >
           static_cast<size_t>(RudpTransport::kMaxTransportMessageSize())) {
     DLOG(ERROR) << "Data size " << msg_size << " bytes (exceeds limit of "
@@ -369,16 +448,19 @@ void RudpConnection::EncodeData(const std::string &data) {
     return;
   }
 
-  buffer_.clear();
   for (int i = 0; i != 4; ++i)
-    buffer_.push_back(static_cast<char>(msg_size >> (8 * (3 - i))));
-  buffer_.insert(buffer_.end(), data.begin(), data.end());
+    size_buffer_.at(i) = static_cast<char>(msg_size >> (8 * (3 - i)));
+  write_buffers_.clear();
+  write_buffers_.reserve(1 + data.size());
+  write_buffers_.push_back(asio::buffer(size_buffer_));
+  write_buffers_.insert(write_buffers_.end(), data.begin(), data.end());
+  write_owner_ = owner;
 }
 
 void RudpConnection::StartWrite() {
   if (Stopped())
     return CloseOnError(kNoConnection);
-  socket_.AsyncWrite(asio::buffer(buffer_),
+  socket_.AsyncWrite(write_buffers_,
                      strand_.wrap(std::bind(&RudpConnection::HandleWrite,
                                             shared_from_this(), args::_1)));
   timer_.expires_from_now(kStallTimeout);
@@ -389,6 +471,8 @@ void RudpConnection::HandleWrite(const bs::error_code &ec) {
   if (Stopped())
     return CloseOnError(kNoConnection);
 
+  write_buffers_.clear();
+  write_owner_.reset();
   if (ec)
     return CloseOnError(kSendFailure);
   // Once data sent out, stop the timer for the sending procedure
@@ -403,6 +487,7 @@ void RudpConnection::HandleWrite(const bs::error_code &ec) {
 }
 
 void RudpConnection::CloseOnError(const TransportCondition &error) {
+  FailStream(error);
   if (std::shared_ptr<RudpTransport> transport = transport_.lock()) {
     Endpoint ep(remote_endpoint_.address(), remote_endpoint_.port());
     (*transport->on_error_)(error, ep);
@@ -75,7 +75,9 @@ class RudpConnection : public std::enable_shared_from_this<RudpConnection> {
 
   void Close();
   void StartReceiving();
-  void StartSending(const std::string &data, const Timeout &timeout);
+  void StartSending(const ConstBuffers &data,
+                    const std::shared_ptr<const void> &owner,
+                    const Timeout &timeout);
   void Connect(const Timeout &timeout, ConnectFunctor callback);
 
  private:
@@ -112,8 +114,12 @@ class RudpConnection : public std::enable_shared_from_this<RudpConnection> {
   void StartWrite();
   void HandleWrite(const boost::system::error_code &ec);
 
-  void DispatchMessage();
-  void EncodeData(const std::string &data);
+  void DispatchMessage(const SharedBuffer &data);
+  void DispatchStream(const MessageStreamPtr &stream, const SharedBuffer &data);
+  void SendResponse(std::string *response, const Timeout &response_timeout);
+  void FailStream(const TransportCondition &error);
+  void EncodeData(const ConstBuffers &data,
+                  const std::shared_ptr<const void> &owner);
   void CloseOnError(const TransportCondition &error);
 
   std::weak_ptr<RudpTransport> transport_;
@@ -124,7 +130,15 @@ class RudpConnection : public std::enable_shared_from_this<RudpConnection> {
   boost::posix_time::ptime response_deadline_;
   boost::asio::ip::udp::endpoint remote_endpoint_;
   std::vector<unsigned char> buffer_;
+  // The message being written, which is gathered from the size and the
+  // caller's buffers.
+  std::vector<unsigned char> size_buffer_;
+  ConstBuffers write_buffers_;
+  std::shared_ptr<const void> write_owner_;
   size_t data_size_, data_received_;
+  // The stream the message is being delivered to as it arrives, if one was
+  // set by an on_stream_started slot.
+  MessageStreamPtr stream_;
   Timeout timeout_for_response_;
   enum TimeoutState { kNoTimeout, kSending, kReceiving } timeout_state_;
 };
@@ -81,6 +81,17 @@ void RudpControlPacket::SetDestinationSocketId(boost::uint32_t n) {
   destination_socket_id_ = n;
 }
 
+bool RudpControlPacket::DecodeType(boost::uint16_t *type,
+                                   const asio::const_buffer &buffer) {
+  const unsigned char *p = asio::buffer_cast<const unsigned char *>(buffer);
+  if ((asio::buffer_size(buffer) < kHeaderSize) || ((p[0] & 0x80) == 0))
+    return false;
+
+  *type = (p[0] & 0x7f);
+  *type = ((*type << 8) | p[1]);
+  return true;
+}
+
 bool RudpControlPacket::IsValidBase(const asio::const_buffer &buffer,
                                     boost::uint16_t expected_packet_type) {
   const unsigned char *p = asio::buffer_cast<const unsigned char *>(buffer);
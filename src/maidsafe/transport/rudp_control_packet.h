@@ -50,6 +50,11 @@ class RudpControlPacket : public RudpPacket {
 
   RudpControlPacket();
 
+  // Get the packet type from an encoded control packet without decoding the
+  // rest of it. Returns false if the buffer does not hold a control packet.
+  static bool DecodeType(boost::uint16_t *type,
+                         const boost::asio::const_buffer &buffer);
+
   boost::uint16_t Type() const;
 
   boost::uint32_t TimeStamp() const;
@@ -0,0 +1,166 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/transport/rudp_cubic_congestion.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+// The cubic scaling constant, in packets per second cubed, and the factor by
+// which the window is cut after a loss.
+static const double kCubicC(0.4);
+static const double kCubicBeta(0.7);
+// The per round trip growth of the TCP-friendly window, giving the same
+// average throughput as standard TCP for the reduction factor above.
+static const double kTcpAlpha(3.0 * (1.0 - kCubicBeta) / (1.0 + kCubicBeta));
+static const double kMinimumWindow(2.0);
+// Packets are paced this much faster than the window alone requires, so that
+// the window rather than the pacer is the limit.
+static const double kSlowStartPacingGain(2.0);
+static const double kPacingGain(1.2);
+
+RudpCubicCongestion::RudpCubicCongestion()
+  : window_(RudpParameters::default_window_size),
+    slow_start_threshold_(RudpParameters::maximum_window_size),
+    window_max_(0.0),
+    epoch_start_(),
+    k_(0.0),
+    tcp_window_(0.0),
+    recovery_end_(bptime::neg_infin),
+    feedback_delay_(0),
+    send_delay_(RudpParameters::default_send_delay) {
+}
+
+void RudpCubicCongestion::OnAck(const RudpAckSample &sample) {
+  if (sample.round_trip_time != 0)
+    feedback_delay_ = FeedbackDelay(sample.round_trip_time);
+
+  // The window doesn't grow while recovering from a loss.
+  double acked = static_cast<double>(sample.packets_acknowledged);
+  if (acked > 0.0 && sample.now >= recovery_end_) {
+    if (window_ < slow_start_threshold_) {
+      window_ += acked;
+    } else {
+      if (epoch_start_.is_not_a_date_time()) {
+        epoch_start_ = sample.now;
+        if (window_ < window_max_) {
+          k_ = std::pow((window_max_ - window_) / kCubicC, 1.0 / 3.0);
+        } else {
+          k_ = 0.0;
+          window_max_ = window_;
+        }
+        tcp_window_ = window_;
+      }
+      // The target is where the curve will be by the next acknowledgement.
+      double t = (sample.now - epoch_start_).total_microseconds() / 1e6 +
+                 feedback_delay_ / 1e6;
+      double target = kCubicC * std::pow(t - k_, 3.0) + window_max_;
+      tcp_window_ += kTcpAlpha * acked / window_;
+      target = std::max(target, tcp_window_);
+      // Growth is limited to half the window per round trip.
+      target = std::min(target, 1.5 * window_);
+      if (target > window_)
+        window_ += acked * (target - window_) / window_;
+    }
+  }
+  window_ = std::min(window_,
+                     static_cast<double>(RudpParameters::maximum_window_size));
+  UpdateSendDelay();
+}
+
+void RudpCubicCongestion::OnNegativeAck(boost::uint32_t /*seqnum*/,
+                                        const bptime::ptime &now) {
+  OnLoss(now);
+}
+
+void RudpCubicCongestion::OnSendTimeout(boost::uint32_t /*seqnum*/,
+                                        const bptime::ptime &now) {
+  // A timeout means whole round trips of packets were lost, so the window
+  // starts again from the minimum, slow starting back up to the cut window.
+  bool new_loss_event(now >= recovery_end_);
+  OnLoss(now);
+  if (new_loss_event) {
+    window_ = kMinimumWindow;
+    UpdateSendDelay();
+  }
+}
+
+void RudpCubicCongestion::OnAckOfAck(boost::uint32_t /*round_trip_time*/,
+                                     const bptime::ptime &/*now*/) {
+}
+
+void RudpCubicCongestion::OnLoss(const bptime::ptime &now) {
+  if (now < recovery_end_)
+    return;
+
+  // If the window didn't regain its previous maximum, another flow probably
+  // needs the bandwidth, so it is released faster.
+  if (window_ < window_max_)
+    window_max_ = window_ * (1.0 + kCubicBeta) / 2.0;
+  else
+    window_max_ = window_;
+  window_ = std::max(window_ * kCubicBeta, kMinimumWindow);
+  slow_start_threshold_ = window_;
+  epoch_start_ = bptime::ptime();
+  recovery_end_ = now + (feedback_delay_ != 0 ?
+                         bptime::microseconds(feedback_delay_) :
+                         RudpParameters::default_send_timeout);
+  UpdateSendDelay();
+}
+
+void RudpCubicCongestion::UpdateSendDelay() {
+  if (feedback_delay_ == 0)
+    return;
+  double gain(window_ < slow_start_threshold_ ? kSlowStartPacingGain :
+                                                kPacingGain);
+  send_delay_ = std::min(
+      bptime::time_duration(bptime::microseconds(static_cast<boost::int64_t>(
+          feedback_delay_ / (gain * window_)))),
+      RudpParameters::default_send_delay);
+}
+
+size_t RudpCubicCongestion::SendWindowSize() const {
+  return static_cast<size_t>(window_);
+}
+
+size_t RudpCubicCongestion::SendDataSize() const {
+  return RudpParameters::max_data_size;
+}
+
+bptime::time_duration RudpCubicCongestion::SendDelay() const {
+  return send_delay_;
+}
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -0,0 +1,85 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_CUBIC_CONGESTION_H_
+#define MAIDSAFE_TRANSPORT_RUDP_CUBIC_CONGESTION_H_
+
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+// A loss-based algorithm after CUBIC (RFC 8312). The window doubles each
+// round trip until the first loss. After a loss it is cut to 70%, and then
+// grows along a cubic curve which flattens out as it approaches the window at
+// which the loss occurred, before probing beyond it ever faster. At most one
+// cut is made per round trip. Packets are paced to spread the window over the
+// time until it is acknowledged, and are always of the maximum size.
+class RudpCubicCongestion : public RudpCongestionAlgorithm {
+ public:
+  RudpCubicCongestion();
+
+  virtual void OnAck(const RudpAckSample &sample);
+  virtual void OnNegativeAck(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now);
+  virtual void OnSendTimeout(boost::uint32_t seqnum,
+                             const boost::posix_time::ptime &now);
+  virtual void OnAckOfAck(boost::uint32_t round_trip_time,
+                          const boost::posix_time::ptime &now);
+
+  virtual size_t SendWindowSize() const;
+  virtual size_t SendDataSize() const;
+  virtual boost::posix_time::time_duration SendDelay() const;
+
+ private:
+  // Reduce the window after a loss, unless it has already been reduced within
+  // the last round trip.
+  void OnLoss(const boost::posix_time::ptime &now);
+  void UpdateSendDelay();
+
+  // The window and the slow start threshold, in packets.
+  double window_, slow_start_threshold_;
+  // The window before the last reduction, the time the current cubic epoch
+  // began, and the time in seconds the curve takes to return to window_max_.
+  double window_max_;
+  boost::posix_time::ptime epoch_start_;
+  double k_;
+  // The window standard TCP would have reached in the current epoch.
+  double tcp_window_;
+  // Losses before this time belong to a loss event already responded to.
+  boost::posix_time::ptime recovery_end_;
+  // The round trip time plus the acknowledgement interval, in microseconds.
+  boost::uint32_t feedback_delay_;
+  boost::posix_time::time_duration send_delay_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_CUBIC_CONGESTION_H_
@@ -46,7 +46,21 @@ RudpDataPacket::RudpDataPacket()
     message_number_(0),
     time_stamp_(0),
     destination_socket_id_(0),
-    data_() {}
+    data_(),
+    payload_(),
+    payload_owner_() {}
+
+void RudpDataPacket::Clear() {
+  packet_sequence_number_ = 0;
+  first_packet_in_message_ = false;
+  last_packet_in_message_ = false;
+  in_order_ = false;
+  message_number_ = 0;
+  time_stamp_ = 0;
+  destination_socket_id_ = 0;
+  data_.clear();
+  ReleasePayload();
+}
 
 boost::uint32_t RudpDataPacket::PacketSequenceNumber() const {
   return packet_sequence_number_;
@@ -111,21 +125,52 @@ const std::string &RudpDataPacket::Data() const {
 }
 
 void RudpDataPacket::SetData(const std::string &data) {
+  ReleasePayload();
   data_ = data;
 }
 
+asio::const_buffer RudpDataPacket::Payload() const {
+  return payload_owner_ ? payload_ : asio::buffer(data_);
+}
+
+void RudpDataPacket::ReleasePayload() {
+  payload_ = asio::const_buffer();
+  payload_owner_.reset();
+}
+
 bool RudpDataPacket::IsValid(const asio::const_buffer &buffer) {
   return ((asio::buffer_size(buffer) >= 16) &&
           ((asio::buffer_cast<const unsigned char *>(buffer)[0] & 0x80) == 0));
 }
 
 bool RudpDataPacket::Decode(const asio::const_buffer &buffer) {
+  if (!DecodeHeader(buffer))
+    return false;
+
+  const unsigned char *p = asio::buffer_cast<const unsigned char *>(buffer);
+  ReleasePayload();
+  data_.assign(p + kHeaderSize, p + asio::buffer_size(buffer));
+  return true;
+}
+
+bool RudpDataPacket::Decode(const asio::const_buffer &buffer,
+                            const std::shared_ptr<const void> &owner) {
+  assert(owner);
+  if (!DecodeHeader(buffer))
+    return false;
+
+  data_.clear();
+  payload_ = buffer + kHeaderSize;
+  payload_owner_ = owner;
+  return true;
+}
+
+bool RudpDataPacket::DecodeHeader(const asio::const_buffer &buffer) {
   // Refuse to decode if the input buffer is not valid.
   if (!IsValid(buffer))
     return false;
 
   const unsigned char *p = asio::buffer_cast<const unsigned char *>(buffer);
-  size_t length = asio::buffer_size(buffer);
 
   packet_sequence_number_ = (p[0] & 0x7f);
   packet_sequence_number_ = ((packet_sequence_number_ << 8) | p[1]);
@@ -140,14 +185,15 @@ bool RudpDataPacket::Decode(const asio::const_buffer &buffer) {
   message_number_ = ((message_number_ << 8) | p[7]);
   DecodeUint32(&time_stamp_, p + 8);
   DecodeUint32(&destination_socket_id_, p + 12);
-  data_.assign(p + 16, p + length);
 
   return true;
 }
 
 size_t RudpDataPacket::Encode(const asio::mutable_buffer &buffer) const {
   // Refuse to encode if the output buffer is not big enough.
-  if (asio::buffer_size(buffer) < kHeaderSize + data_.size())
+  asio::const_buffer payload = Payload();
+  size_t payload_size = asio::buffer_size(payload);
+  if (asio::buffer_size(buffer) < kHeaderSize + payload_size)
     return 0;
 
   unsigned char *p = asio::buffer_cast<unsigned char *>(buffer);
@@ -165,9 +211,10 @@ size_t RudpDataPacket::Encode(const asio::mutable_buffer &buffer) const {
   p[7] = (message_number_ & 0xff);
   EncodeUint32(time_stamp_, p + 8);
   EncodeUint32(destination_socket_id_, p + 12);
-  std::memcpy(p + kHeaderSize, data_.data(), data_.size());
+  std::memcpy(p + kHeaderSize,
+              asio::buffer_cast<const unsigned char *>(payload), payload_size);
 
-  return kHeaderSize + data_.size();
+  return kHeaderSize + payload_size;
 }
 
 }  // namespace transport
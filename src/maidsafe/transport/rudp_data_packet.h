@@ -30,6 +30,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_RUDP_DATA_PACKET_H_
 #define MAIDSAFE_TRANSPORT_RUDP_DATA_PACKET_H_
 
+#include <memory>
 #include <string>
 
 #include "boost/asio/buffer.hpp"
@@ -48,6 +49,9 @@ class RudpDataPacket : public RudpPacket {
 
   RudpDataPacket();
 
+  // Returns the packet to its initial state, keeping the data's storage.
+  void Clear();
+
   boost::uint32_t PacketSequenceNumber() const;
   void SetPacketSequenceNumber(boost::uint32_t n);
 
@@ -69,19 +73,40 @@ class RudpDataPacket : public RudpPacket {
   boost::uint32_t DestinationSocketId() const;
   void SetDestinationSocketId(boost::uint32_t n);
 
+  // The payload held by the packet itself. This is empty for a packet decoded
+  // by reference, whose payload is only available through Payload().
   const std::string &Data() const;
   void SetData(const std::string &data);
 
   template <typename Iterator>
   void SetData(Iterator begin, Iterator end) {
+    ReleasePayload();
     data_.assign(begin, end);
   }
 
+  template <typename Iterator>
+  void AppendData(Iterator begin, Iterator end) {
+    data_.insert(data_.end(), begin, end);
+  }
+
+  // The payload, wherever it is held.
+  boost::asio::const_buffer Payload() const;
+
   static bool IsValid(const boost::asio::const_buffer &buffer);
   bool Decode(const boost::asio::const_buffer &buffer);
+
+  // Decode without copying the payload, which is left in the buffer. The
+  // packet, and any copy of it, holds a reference to owner so that the buffer
+  // outlives it.
+  bool Decode(const boost::asio::const_buffer &buffer,
+              const std::shared_ptr<const void> &owner);
+
   size_t Encode(const boost::asio::mutable_buffer &buffer) const;
 
  private:
+  bool DecodeHeader(const boost::asio::const_buffer &buffer);
+  void ReleasePayload();
+
   boost::uint32_t packet_sequence_number_;
   bool first_packet_in_message_;
   bool last_packet_in_message_;
@@ -90,6 +115,10 @@ class RudpDataPacket : public RudpPacket {
   boost::uint32_t time_stamp_;
   boost::uint32_t destination_socket_id_;
   std::string data_;
+  // The payload of a packet decoded by reference, and the owner of the buffer
+  // it lies in. payload_owner_ is null when the payload is held in data_.
+  boost::asio::const_buffer payload_;
+  std::shared_ptr<const void> payload_owner_;
 };
 
 }  // namespace transport
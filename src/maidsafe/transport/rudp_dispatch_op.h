@@ -30,29 +30,41 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_RUDP_DISPATCH_OP_H_
 #define MAIDSAFE_TRANSPORT_RUDP_DISPATCH_OP_H_
 
+#include <memory>
+#include <vector>
+
 #include "boost/asio/buffer.hpp"
 #include "boost/asio/handler_alloc_hook.hpp"
 #include "boost/asio/handler_invoke_hook.hpp"
 #include "boost/system/error_code.hpp"
 #include "maidsafe/transport/transport.h"
 #include "maidsafe/transport/rudp_dispatcher.h"
+#include "maidsafe/transport/shared_pool.h"
 
 namespace maidsafe {
 
 namespace transport {
 
-// Helper class to perform an asynchronous dispatch operation.
+// Helper class to perform an asynchronous dispatch operation. Packets are
+// received into a buffer from the pool, which a socket may keep a reference to
+// rather than copying the packet's payload out of it. The next packet is then
+// received into another buffer.
 template <typename DispatchHandler>
 class RudpDispatchOp {
  public:
+  typedef std::shared_ptr<std::vector<unsigned char>> BufferPtr;
+  typedef SharedPool<std::vector<unsigned char>> BufferPool;
+
   RudpDispatchOp(DispatchHandler handler,
                  boost::asio::ip::udp::socket *socket,
-                 const boost::asio::mutable_buffer &buffer,
+                 BufferPtr *buffer,
+                 BufferPool *buffer_pool,
                  boost::asio::ip::udp::endpoint *sender_endpoint,
                  RudpDispatcher *dispatcher)
     : handler_(handler),
       socket_(socket),
       buffer_(buffer),
+      buffer_pool_(buffer_pool),
       sender_endpoint_(sender_endpoint),
       dispatcher_(dispatcher) {
   }
@@ -61,6 +73,7 @@ class RudpDispatchOp {
     : handler_(L.handler_),
       socket_(L.socket_),
       buffer_(L.buffer_),
+      buffer_pool_(L.buffer_pool_),
       sender_endpoint_(L.sender_endpoint_),
       dispatcher_(L.dispatcher_) {
   }
@@ -74,6 +87,7 @@ class RudpDispatchOp {
       handler_ = L.handler_;
       socket_ = L.socket_;
       buffer_ = L.buffer_;
+      buffer_pool_ = L.buffer_pool_;
       sender_endpoint_ = L.sender_endpoint_;
       dispatcher_ = L.dispatcher_;
     }
@@ -85,11 +99,14 @@ class RudpDispatchOp {
     boost::system::error_code local_ec = ec;
 
     while (!local_ec) {
-      dispatcher_->HandleReceiveFrom(boost::asio::buffer(buffer_,
+      long use_count = buffer_->use_count();  // NOLINT
+      dispatcher_->HandleReceiveFrom(boost::asio::buffer(**buffer_,
                                                          bytes_transferred),
-                                     *sender_endpoint_);
+                                     *sender_endpoint_, *buffer_);
+      if (buffer_->use_count() != use_count)
+        *buffer_ = buffer_pool_->Acquire();
 
-      bytes_transferred = socket_->receive_from(boost::asio::buffer(buffer_),
+      bytes_transferred = socket_->receive_from(boost::asio::buffer(**buffer_),
                                                 *sender_endpoint_, 0, local_ec);
     }
 
@@ -119,7 +136,8 @@ class RudpDispatchOp {
 
   DispatchHandler handler_;
   boost::asio::ip::udp::socket *socket_;
-  boost::asio::mutable_buffer buffer_;
+  BufferPtr *buffer_;
+  BufferPool *buffer_pool_;
   boost::asio::ip::udp::endpoint *sender_endpoint_;
   RudpDispatcher *dispatcher_;
 };
@@ -74,8 +74,10 @@ void RudpDispatcher::RemoveSocket(boost::uint32_t id) {
     sockets_.erase(id);
 }
 
-void RudpDispatcher::HandleReceiveFrom(const asio::const_buffer &data,
-                                       const ip::udp::endpoint &endpoint) {
+void RudpDispatcher::HandleReceiveFrom(
+    const asio::const_buffer &data,
+    const ip::udp::endpoint &endpoint,
+    const std::shared_ptr<const void> &owner) {
   boost::uint32_t id = 0;
   if (RudpPacket::DecodeDestinationSocketId(&id, data)) {
     if (id == 0) {
@@ -90,7 +92,7 @@ void RudpDispatcher::HandleReceiveFrom(const asio::const_buffer &data,
       // This packet is intended for a specific connection.
       SocketMap::iterator socket_iter = sockets_.find(id);
       if (socket_iter != sockets_.end()) {
-        socket_iter->second->HandleReceiveFrom(data, endpoint);
+        socket_iter->second->HandleReceiveFrom(data, endpoint, owner);
       } else {
         const unsigned char *p = asio::buffer_cast<const unsigned char*>(data);
         DLOG(ERROR) << "Received a packet \"0x" << std::hex
@@ -30,6 +30,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_RUDP_DISPATCHER_H_
 #define MAIDSAFE_TRANSPORT_RUDP_DISPATCHER_H_
 
+#include <memory>
 #include <unordered_map>
 #include "boost/asio/buffer.hpp"
 #include "boost/asio/ip/udp.hpp"
@@ -60,8 +61,10 @@ class RudpDispatcher {
   void RemoveSocket(boost::uint32_t id);
 
   // Handle a new packet by dispatching to the appropriate socket or acceptor.
+  // The socket may keep a reference to owner, the storage holding data.
   void HandleReceiveFrom(const boost::asio::const_buffer &data,
-                         const boost::asio::ip::udp::endpoint &endpoint);
+                         const boost::asio::ip::udp::endpoint &endpoint,
+                         const std::shared_ptr<const void> &owner);
 
  private:
   // Disallow copying and assignment.
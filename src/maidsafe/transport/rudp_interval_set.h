@@ -0,0 +1,179 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_INTERVAL_SET_H_
+#define MAIDSAFE_TRANSPORT_RUDP_INTERVAL_SET_H_
+
+#include <cassert>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "boost/cstdint.hpp"
+
+namespace maidsafe {
+
+namespace transport {
+
+// A set of packet indices held as disjoint, non-adjacent intervals. Indices
+// count packets from the start of a connection, so unlike sequence numbers
+// they never wrap around. Adding or removing a value or an interval costs
+// O(log n) in the number of intervals, plus the number of intervals merged or
+// removed, however many values they cover.
+class RudpIntervalSet {
+ public:
+  // An interval from first to last, inclusive.
+  typedef std::pair<boost::uint64_t, boost::uint64_t> Interval;
+  typedef std::map<boost::uint64_t, boost::uint64_t>::const_iterator
+      const_iterator;
+
+  RudpIntervalSet() : intervals_() {}
+
+  // Add the values from first to last. The parts of the interval which were
+  // not already in the set are appended to added, if it is not null.
+  void Insert(boost::uint64_t first,
+              boost::uint64_t last,
+              std::vector<Interval> *added) {
+    assert(first <= last);
+    // Start from the interval which overlaps or adjoins first, if any.
+    auto it = intervals_.upper_bound(first);
+    if (it != intervals_.begin()) {
+      auto previous = it;
+      --previous;
+      if (previous->second + 1 >= first)
+        it = previous;
+    }
+
+    boost::uint64_t merged_first(first), merged_last(last), next(first);
+    while (it != intervals_.end() && it->first <= last + 1) {
+      if (added && it->first > next)
+        added->push_back(Interval(next, it->first - 1));
+      if (it->second + 1 > next)
+        next = it->second + 1;
+      if (it->first < merged_first)
+        merged_first = it->first;
+      if (it->second > merged_last)
+        merged_last = it->second;
+      intervals_.erase(it++);
+    }
+    if (added && next <= last)
+      added->push_back(Interval(next, last));
+    intervals_.insert(it, std::make_pair(merged_first, merged_last));
+  }
+
+  // Remove a single value.
+  void Erase(boost::uint64_t value) {
+    auto it = intervals_.upper_bound(value);
+    if (it == intervals_.begin())
+      return;
+    --it;
+    if (it->second < value)
+      return;
+    Interval interval(*it);
+    intervals_.erase(it);
+    if (interval.first < value)
+      intervals_.insert(Interval(interval.first, value - 1));
+    if (value < interval.second)
+      intervals_.insert(Interval(value + 1, interval.second));
+  }
+
+  // Remove every value less than the one given.
+  void EraseBelow(boost::uint64_t value) {
+    while (!intervals_.empty() && intervals_.begin()->first < value) {
+      Interval interval(*intervals_.begin());
+      intervals_.erase(intervals_.begin());
+      if (interval.second >= value) {
+        intervals_.insert(Interval(value, interval.second));
+        break;
+      }
+    }
+  }
+
+  // Determine whether a value is in the set.
+  bool Contains(boost::uint64_t value) const {
+    auto it = intervals_.upper_bound(value);
+    if (it == intervals_.begin())
+      return false;
+    --it;
+    return value <= it->second;
+  }
+
+  // Append the parts of the interval from first to last which are in the set
+  // to intervals, in ascending order.
+  void GetIntervals(boost::uint64_t first,
+                    boost::uint64_t last,
+                    std::vector<Interval> *intervals) const {
+    auto it = intervals_.upper_bound(first);
+    if (it != intervals_.begin()) {
+      auto previous = it;
+      --previous;
+      if (previous->second >= first)
+        it = previous;
+    }
+    for (; it != intervals_.end() && it->first <= last; ++it)
+      intervals->push_back(Interval(it->first < first ? first : it->first,
+                                    it->second > last ? last : it->second));
+  }
+
+  // Get the lowest value in the set.
+  // Precondition: !IsEmpty().
+  boost::uint64_t Front() const {
+    assert(!IsEmpty());
+    return intervals_.begin()->first;
+  }
+
+  bool IsEmpty() const {
+    return intervals_.empty();
+  }
+
+  void Clear() {
+    intervals_.clear();
+  }
+
+  // Get the number of intervals in the set.
+  size_t IntervalCount() const {
+    return intervals_.size();
+  }
+
+  // The intervals in ascending order, as (first, last) pairs.
+  const_iterator begin() const {
+    return intervals_.begin();
+  }
+
+  const_iterator end() const {
+    return intervals_.end();
+  }
+
+ private:
+  std::map<boost::uint64_t, boost::uint64_t> intervals_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_INTERVAL_SET_H_
@@ -0,0 +1,102 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_MEDIAN_FILTER_H_
+#define MAIDSAFE_TRANSPORT_RUDP_MEDIAN_FILTER_H_
+
+#include <algorithm>
+#include <cassert>
+
+#include "boost/cstdint.hpp"
+
+namespace maidsafe {
+
+namespace transport {
+
+// Keeps the last Capacity values added in a ring buffer, for the median and
+// the mean of the values near it to be read. Adding a value is a single
+// store. The median is found by selection rather than sorting, working on a
+// copy of the values held in a fixed scratch array, so nothing is allocated.
+template <size_t Capacity>
+class RudpMedianFilter {
+ public:
+  RudpMedianFilter() : values_(), scratch_(), next_(0), size_(0) {}
+
+  // Add a value, discarding the oldest once the filter is full.
+  void Add(boost::uint64_t value) {
+    values_[next_] = value;
+    next_ = (next_ + 1) % Capacity;
+    if (size_ != Capacity)
+      ++size_;
+  }
+
+  void Clear() {
+    next_ = 0;
+    size_ = 0;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool IsEmpty() const {
+    return size_ == 0;
+  }
+
+  // The middle value, or the higher of the two middle values if there is an
+  // even number. Must not be empty.
+  boost::uint64_t Median() const {
+    assert(size_ != 0);
+    std::copy(values_, values_ + size_, scratch_);
+    std::nth_element(scratch_, scratch_ + size_ / 2, scratch_ + size_);
+    return scratch_[size_ / 2];
+  }
+
+  // Get the number and the sum of the values from low to high inclusive.
+  void SumRange(boost::uint64_t low, boost::uint64_t high,
+                size_t *count, boost::uint64_t *total) const {
+    *count = 0;
+    *total = 0;
+    for (size_t i = 0; i != size_; ++i) {
+      if (low <= values_[i] && values_[i] <= high) {
+        ++*count;
+        *total += values_[i];
+      }
+    }
+  }
+
+ private:
+  boost::uint64_t values_[Capacity];
+  mutable boost::uint64_t scratch_[Capacity];
+  size_t next_, size_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_MEDIAN_FILTER_H_
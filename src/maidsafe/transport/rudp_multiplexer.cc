@@ -42,9 +42,17 @@ namespace maidsafe {
 
 namespace transport {
 
+// The number of full-sized packets the socket's receive buffer is asked to
+// hold. Packets are read as soon as they arrive, so the buffer only has to
+// absorb a burst, but the system's default holds just a few full-sized
+// packets. The system may limit the buffer to less than this.
+static const int kReceiveBufferPackets(64);
+
 RudpMultiplexer::RudpMultiplexer(asio::io_service &asio_service) //NOLINT
   : socket_(asio_service),
-    receive_buffer_(RudpParameters::max_size),
+    buffer_pool_(&RudpMultiplexer::CreateBuffer,
+                 RudpParameters::maximum_window_size),
+    receive_buffer_(buffer_pool_.Acquire()),
     sender_endpoint_(),
     dispatcher_() {}
 
@@ -64,6 +72,13 @@ TransportCondition RudpMultiplexer::Open(const ip::udp &protocol) {
   ip::udp::socket::non_blocking_io nbio(true);
   socket_.io_control(nbio, ec);
 
+  if (ec)
+    return kSetOptionFailure;
+
+  asio::socket_base::receive_buffer_size receive_buffer_size(
+      kReceiveBufferPackets * RudpParameters::max_size);
+  socket_.set_option(receive_buffer_size, ec);
+
   if (ec)
     return kSetOptionFailure;
 
@@ -86,6 +101,13 @@ TransportCondition RudpMultiplexer::Open(const ip::udp::endpoint &endpoint) {
   ip::udp::socket::non_blocking_io nbio(true);
   socket_.io_control(nbio, ec);
 
+  if (ec)
+    return kSetOptionFailure;
+
+  asio::socket_base::receive_buffer_size receive_buffer_size(
+      kReceiveBufferPackets * RudpParameters::max_size);
+  socket_.set_option(receive_buffer_size, ec);
+
   if (ec)
     return kSetOptionFailure;
 
@@ -106,6 +128,14 @@ void RudpMultiplexer::Close() {
   socket_.close(ec);
 }
 
+size_t RudpMultiplexer::buffer_pool_allocations() const {
+  return buffer_pool_.allocations();
+}
+
+std::shared_ptr<std::vector<unsigned char>> RudpMultiplexer::CreateBuffer() {
+  return std::make_shared<std::vector<unsigned char>>(RudpParameters::max_size);
+}
+
 }  // namespace transport
 
 }  // namespace maidsafe
@@ -31,6 +31,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAIDSAFE_TRANSPORT_RUDP_MULTIPLEXER_H_
 
 #include <array>  // NOLINT
+#include <memory>
 #include <vector>
 
 #include "boost/asio/io_service.hpp"
@@ -40,6 +41,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "maidsafe/transport/rudp_dispatcher.h"
 #include "maidsafe/transport/rudp_packet.h"
 #include "maidsafe/transport/rudp_parameters.h"
+#include "maidsafe/transport/shared_pool.h"
 
 namespace maidsafe {
 
@@ -62,13 +64,18 @@ class RudpMultiplexer {
   // Close the multiplexer.
   void Close();
 
+  // The number of receive buffers created. Buffers are reused once the packets
+  // received into them have been read, so this stops growing under steady
+  // traffic.
+  size_t buffer_pool_allocations() const;
+
   // Asynchronously receive a single packet and dispatch it.
   template <typename DispatchHandler>
   void AsyncDispatch(DispatchHandler handler) {
-    RudpDispatchOp<DispatchHandler> op(handler, &socket_,
-                                       boost::asio::buffer(receive_buffer_),
-                                       &sender_endpoint_, &dispatcher_);
-    socket_.async_receive_from(boost::asio::buffer(receive_buffer_),
+    RudpDispatchOp<DispatchHandler> op(handler, &socket_, &receive_buffer_,
+                                       &buffer_pool_, &sender_endpoint_,
+                                       &dispatcher_);
+    socket_.async_receive_from(boost::asio::buffer(*receive_buffer_),
                                sender_endpoint_, 0, op);
   }
 
@@ -98,8 +105,14 @@ class RudpMultiplexer {
   // The UDP socket used for all RUDP protocol communication.
   boost::asio::ip::udp::socket socket_;
 
-  // Data members used to receive information about incoming packets.
-  std::vector<unsigned char> receive_buffer_;
+  static std::shared_ptr<std::vector<unsigned char>> CreateBuffer();
+
+  // Data members used to receive information about incoming packets. Data
+  // packets with large payloads refer to the buffers they were received into
+  // until they are read, so a packet is received into a fresh buffer from the
+  // pool whenever the last one has been kept.
+  SharedPool<std::vector<unsigned char>> buffer_pool_;
+  std::shared_ptr<std::vector<unsigned char>> receive_buffer_;
   boost::asio::ip::udp::endpoint sender_endpoint_;
 
   // Dispatcher keeps track of the active sockets and the acceptor.
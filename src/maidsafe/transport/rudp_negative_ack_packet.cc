@@ -84,6 +84,21 @@ bool RudpNegativeAckPacket::ContainsSequenceNumber(boost::uint32_t n) const {
   return false;
 }
 
+void RudpNegativeAckPacket::GetRanges(std::vector<Range> *ranges) const {
+  ranges->clear();
+  for (size_t i = 0; i < sequence_numbers_.size(); ++i) {
+    if (((sequence_numbers_[i] & 0x80000000) != 0) &&
+        (i + 1 < sequence_numbers_.size())) {
+      ranges->push_back(Range(sequence_numbers_[i] & 0x7fffffff,
+                              sequence_numbers_[i + 1] & 0x7fffffff));
+      ++i;
+    } else {
+      boost::uint32_t n = (sequence_numbers_[i] & 0x7fffffff);
+      ranges->push_back(Range(n, n));
+    }
+  }
+}
+
 bool RudpNegativeAckPacket::HasSequenceNumbers() const {
   return !sequence_numbers_.empty();
 }
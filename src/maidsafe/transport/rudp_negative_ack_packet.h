@@ -30,6 +30,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_RUDP_NEGATIVE_ACK_PACKET_H_
 #define MAIDSAFE_TRANSPORT_RUDP_NEGATIVE_ACK_PACKET_H_
 
+#include <utility>
 #include <vector>
 
 #include "boost/asio/buffer.hpp"
@@ -49,6 +50,11 @@ class RudpNegativeAckPacket : public RudpControlPacket {
   void AddSequenceNumber(boost::uint32_t n);
   void AddSequenceNumbers(boost::uint32_t first, boost::uint32_t last);
   bool ContainsSequenceNumber(boost::uint32_t n) const;
+  // Get the sequence numbers as ranges from first to last inclusive, where a
+  // single sequence number is a range of one. A range may wrap around past
+  // the maximum sequence number.
+  typedef std::pair<boost::uint32_t, boost::uint32_t> Range;
+  void GetRanges(std::vector<Range> *ranges) const;
   bool HasSequenceNumbers() const;
 
   static bool IsValid(const boost::asio::const_buffer &buffer);
@@ -0,0 +1,84 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_RUDP_PACER_H_
+#define MAIDSAFE_TRANSPORT_RUDP_PACER_H_
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+
+namespace maidsafe {
+
+namespace transport {
+
+// Spaces the data packets sent on a connection at a given interval. Ticks
+// rarely arrive exactly when the next packet is due, so when a tick is late
+// the packets which fell due since are released together, as a burst of up to
+// a given size. Sending less often than the interval doesn't build up credit
+// for more than one burst.
+class RudpPacer {
+ public:
+  RudpPacer()
+      : interval_(), next_send_time_(boost::posix_time::neg_infin),
+        max_burst_(1) {}
+
+  // Set the interval between packets and the most which may be sent at once.
+  void SetRate(const boost::posix_time::time_duration &interval,
+               size_t max_burst) {
+    interval_ = interval;
+    max_burst_ = max_burst == 0 ? 1 : max_burst;
+  }
+
+  // Determine whether a packet may be sent now.
+  bool CanSend(const boost::posix_time::ptime &now) const {
+    return next_send_time_ <= now;
+  }
+
+  // Record that a packet has been sent.
+  void OnSend(const boost::posix_time::ptime &now) {
+    boost::posix_time::ptime earliest =
+        now - interval_ * static_cast<int>(max_burst_ - 1);
+    if (next_send_time_ < earliest)
+      next_send_time_ = earliest;
+    next_send_time_ += interval_;
+  }
+
+  // Get the time at which the next packet may be sent.
+  boost::posix_time::ptime NextSendTime() const {
+    return next_send_time_;
+  }
+
+ private:
+  boost::posix_time::time_duration interval_;
+  boost::posix_time::ptime next_send_time_;
+  size_t max_burst_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_RUDP_PACER_H_
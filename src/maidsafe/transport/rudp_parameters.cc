@@ -46,6 +46,7 @@ boost::posix_time::time_duration RudpParameters::default_receive_timeout(
     bptime::milliseconds(200));
 boost::posix_time::time_duration RudpParameters::default_send_delay(
     bptime::milliseconds(1000));
+boost::uint32_t RudpParameters::max_send_burst(4);
 boost::posix_time::time_duration RudpParameters::default_receive_delay(
   bptime::milliseconds(100));
 boost::posix_time::time_duration RudpParameters::default_ack_timeout(
@@ -59,6 +60,8 @@ boost::posix_time::time_duration RudpParameters::client_connect_timeout(
     bptime::milliseconds(1000));
 RudpParameters::ConnectionType RudpParameters::connection_type(
     RudpParameters::kWireless);
+RudpParameters::CongestionAlgorithm RudpParameters::congestion_algorithm(
+    RudpParameters::kAimd);
 }  // namespace transport
 
 }  // namespace maidsafe
@@ -70,9 +70,15 @@ struct RudpParameters {
   static boost::posix_time::time_duration default_receive_timeout;
 
   // Machine dependent parameter of send delay,
-  // depending on computation power and I/O speed
+  // depending on computation power and I/O speed. This is the interval
+  // between data packets until the congestion control has estimates of the
+  // path, and the longest interval it will choose.
   static boost::posix_time::time_duration default_send_delay;
 
+  // The most data packets sent at once when ticks arrive later than the send
+  // delay. Larger bursts overflow socket buffers on fast links.
+  static boost::uint32_t max_send_burst;
+
   // Machine dependent parameter of receive delay,
   // depending on computation power and I/O speed
   static boost::posix_time::time_duration default_receive_delay;
@@ -103,6 +109,22 @@ struct RudpParameters {
   };
   static ConnectionType connection_type;
 
+  // Defined congestion control algorithms, which decide the send window, the
+  // packet size and the interval between packets of each connection.
+  //   kAimd  - grows the window and the packet size while the peer has buffer
+  //            space, and shrinks them when packets are lost
+  //   kCubic - loss-based, with the window following a cubic curve in the
+  //            time since the last loss
+  //   kBbr   - model-based, pacing at the measured bottleneck bandwidth with
+  //            a window of twice the bandwidth-delay product
+  enum CongestionAlgorithm {
+    kAimd,
+    kCubic,
+    kBbr
+  };
+  // The algorithm used by connections for which none is chosen explicitly.
+  static CongestionAlgorithm congestion_algorithm;
+
  private:
   // Disallow copying and assignment.
   RudpParameters(const RudpParameters&);
@@ -57,6 +57,10 @@ RudpReceiver::RudpReceiver(RudpPeer &peer,  // NOLINT (Fraser)
     tick_timer_(tick_timer),
     congestion_control_(congestion_control),
     unread_packets_(),
+    begin_index_(0),
+    missing_packets_(),
+    reservations_(),
+    missing_intervals_(),
     acks_(),
     last_ack_packet_sequence_number_(0),
     ack_sent_time_(tick_timer_.Now()) {
@@ -64,6 +68,9 @@ RudpReceiver::RudpReceiver(RudpPeer &peer,  // NOLINT (Fraser)
 
 void RudpReceiver::Reset(boost::uint32_t initial_sequence_number) {
   unread_packets_.Reset(initial_sequence_number);
+  begin_index_ = 0;
+  missing_packets_.Clear();
+  reservations_.clear();
   last_ack_packet_sequence_number_ = initial_sequence_number;
 }
 
@@ -82,18 +89,24 @@ size_t RudpReceiver::ReadData(const boost::asio::mutable_buffer &data) {
        (n != unread_packets_.End()) && (ptr < end);
        n = unread_packets_.Next(n)) {
     UnreadPacket &p = unread_packets_[n];
-    if (p.lost) {
+    if (p.lost)
       break;
-    } else if (p.packet.Data().size() > p.bytes_read) {
-      size_t length = std::min<size_t>(end - ptr,
-                                       p.packet.Data().size() - p.bytes_read);
-      std::memcpy(ptr, p.packet.Data().data() + p.bytes_read, length);
+    asio::const_buffer payload = p.packet.Payload();
+    size_t size = asio::buffer_size(payload);
+    if (size > p.bytes_read) {
+      size_t length = std::min<size_t>(end - ptr, size - p.bytes_read);
+      std::memcpy(ptr, asio::buffer_cast<const unsigned char*>(payload) +
+                       p.bytes_read, length);
       ptr += length;
       p.bytes_read += length;
-      if (p.packet.Data().size() == p.bytes_read)
-        unread_packets_.Remove();
-    } else {
+    }
+    // A packet which has been read releases the buffer it was received into
+    // straight away, rather than when its slot is reused, so that the buffer
+    // can go back to the multiplexer's pool.
+    if (size == p.bytes_read) {
+      p.Reset();
       unread_packets_.Remove();
+      ++begin_index_;
     }
   }
 
@@ -110,10 +123,23 @@ void RudpReceiver::HandleData(const RudpDataPacket &packet) {
   // i.e. any un-received packet, having previous seqnum, will be given an empty
   // reserved slot.
   // Later arrvied packet, having less seqnum, will not affect sliding window
+  boost::uint64_t end_index = begin_index_ + unread_packets_.Size();
   while (unread_packets_.IsComingSoon(seqnum) && !unread_packets_.IsFull())
-    // New entries are marked "lost" by default, and reserve_time set to now
+    // New entries are marked "lost" by default
     unread_packets_.Append();
 
+  // The reserved slots are missing until their packets arrive.
+  boost::uint64_t new_end_index = begin_index_ + unread_packets_.Size();
+  if (new_end_index != end_index) {
+    missing_packets_.Insert(end_index, new_end_index - 1, NULL);
+    bptime::ptime now = tick_timer_.Now();
+    if (!reservations_.empty() && reservations_.back().time == now &&
+        reservations_.back().last + 1 == end_index)
+      reservations_.back().last = new_end_index - 1;
+    else
+      reservations_.push_back(Reservation(now, end_index, new_end_index - 1));
+  }
+
   // Ignore any packet which isn't in the window.
   // The empty slot will got populated here, if the packet arrived later having
   // a seqnum falls in the window
@@ -125,6 +151,7 @@ void RudpReceiver::HandleData(const RudpDataPacket &packet) {
       p.packet = packet;
       p.lost = false;
       p.bytes_read = 0;
+      missing_packets_.Erase(SequenceNumberToIndex(seqnum));
     }
   }
   if (tick_timer_.Expired()) {
@@ -186,25 +213,7 @@ void RudpReceiver::HandleTick() {
   // Generate a negative acknowledgement packet to request corruptted packets.
   RudpNegativeAckPacket negative_ack;
   negative_ack.SetDestinationSocketId(peer_.Id());
-  boost::uint32_t n = unread_packets_.Begin();
-  while (n != unread_packets_.End()) {
-    if (unread_packets_[n].Missing(congestion_control_.ReceiveTimeout())) {
-      boost::uint32_t begin = n;
-      boost::uint32_t end;
-      do {
-        end = n;
-        unread_packets_[n].reserve_time = now;
-        n = unread_packets_.Next(n);
-      } while (n != unread_packets_.End() && unread_packets_[n].Missing(
-                                      congestion_control_.ReceiveTimeout()));
-      if (begin == end)
-        negative_ack.AddSequenceNumber(begin);
-      else
-        negative_ack.AddSequenceNumbers(begin, end);
-    } else {
-      n = unread_packets_.Next(n);
-    }
-  }
+  AddMissingPackets(now, &negative_ack);
   if (negative_ack.HasSequenceNumbers()) {
     peer_.Send(negative_ack);
 //     tick_timer_.TickAt(now + congestion_control_.AckTimeout());
@@ -226,12 +235,55 @@ boost::uint32_t RudpReceiver::AvailableBufferSize() const {
 }
 
 boost::uint32_t RudpReceiver::AckPacketSequenceNumber() const {
-  // Work out what sequence number we need to acknowledge up to.
-  boost::uint32_t ack_packet_seqnum = unread_packets_.Begin();
-  while (ack_packet_seqnum != unread_packets_.End() &&
-         !unread_packets_[ack_packet_seqnum].lost)
-    ack_packet_seqnum = unread_packets_.Next(ack_packet_seqnum);
-  return ack_packet_seqnum;
+  // Acknowledge up to the first missing packet, or the whole window if none
+  // are missing.
+  if (missing_packets_.IsEmpty())
+    return unread_packets_.End();
+  return IndexToSequenceNumber(missing_packets_.Front());
+}
+
+boost::uint64_t RudpReceiver::SequenceNumberToIndex(boost::uint32_t n) const {
+  return begin_index_ + ((n - unread_packets_.Begin()) &
+                         UnreadPacketWindow::kMaxSequenceNumber);
+}
+
+boost::uint32_t RudpReceiver::IndexToSequenceNumber(
+    boost::uint64_t index) const {
+  return (unread_packets_.Begin() +
+          static_cast<boost::uint32_t>(index - begin_index_)) &
+         UnreadPacketWindow::kMaxSequenceNumber;
+}
+
+void RudpReceiver::AddMissingPackets(const bptime::ptime &now,
+                                     RudpNegativeAckPacket *negative_ack) {
+  // Gather the missing packets from the reservations which have come due,
+  // merging adjacent ranges.
+  RudpIntervalSet requested;
+  while (!reservations_.empty() &&
+         (reservations_.front().time + congestion_control_.ReceiveTimeout()) <
+             now) {
+    Reservation reservation(reservations_.front());
+    reservations_.pop_front();
+    missing_intervals_.clear();
+    missing_packets_.GetIntervals(reservation.first, reservation.last,
+                                  &missing_intervals_);
+    if (missing_intervals_.empty())
+      continue;
+    for (auto it = missing_intervals_.begin(); it != missing_intervals_.end();
+         ++it)
+      requested.Insert(it->first, it->second, NULL);
+    // Request them again if they are still missing after another timeout.
+    reservations_.push_back(Reservation(now, missing_intervals_.front().first,
+                                        missing_intervals_.back().second));
+  }
+
+  for (auto it = requested.begin(); it != requested.end(); ++it) {
+    if (it->first == it->second)
+      negative_ack->AddSequenceNumber(IndexToSequenceNumber(it->first));
+    else
+      negative_ack->AddSequenceNumbers(IndexToSequenceNumber(it->first),
+                                       IndexToSequenceNumber(it->second));
+  }
 }
 
 }  // namespace transport
@@ -31,6 +31,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAIDSAFE_TRANSPORT_RUDP_RECEIVER_H_
 
 #include <deque>
+#include <vector>
 
 #include "boost/asio/buffer.hpp"
 #include "boost/asio/deadline_timer.hpp"
@@ -40,6 +41,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "maidsafe/transport/rudp_ack_packet.h"
 #include "maidsafe/transport/rudp_ack_of_ack_packet.h"
 #include "maidsafe/transport/rudp_data_packet.h"
+#include "maidsafe/transport/rudp_interval_set.h"
 #include "maidsafe/transport/rudp_sliding_window.h"
 
 namespace maidsafe {
@@ -47,6 +49,7 @@ namespace maidsafe {
 namespace transport {
 
 class RudpCongestionControl;
+class RudpNegativeAckPacket;
 class RudpPeer;
 class RudpTickTimer;
 
@@ -66,7 +69,8 @@ class RudpReceiver {
   // Reads some application data. Returns number of bytes copied.
   size_t ReadData(const boost::asio::mutable_buffer &data);
 
-  // Handle a data packet.
+  // Handle a data packet. The packet is kept until it has been read, along
+  // with any buffer holding its payload.
   void HandleData(const RudpDataPacket &packet);
 
   // Handle an acknowledgement of an acknowledgement packet.
@@ -86,6 +90,17 @@ class RudpReceiver {
   // Calculate the sequence number which should be sent in an acknowledgement.
   boost::uint32_t AckPacketSequenceNumber() const;
 
+  // Helper functions to convert between sequence numbers in the window and
+  // packet indices, which count the packets since the receiver was reset and
+  // so never wrap around.
+  boost::uint64_t SequenceNumberToIndex(boost::uint32_t n) const;
+  boost::uint32_t IndexToSequenceNumber(boost::uint64_t index) const;
+
+  // Add the packets which are still missing after the receive timeout to a
+  // negative acknowledgement.
+  void AddMissingPackets(const boost::posix_time::ptime &now,
+                         RudpNegativeAckPacket *negative_ack);
+
   // The peer with which we are communicating.
   RudpPeer &peer_;
 
@@ -99,17 +114,27 @@ class RudpReceiver {
     UnreadPacket()
         : packet(),
           lost(true),
-          bytes_read(0),
-          reserve_time(boost::asio::deadline_timer::traits_type::now()) {}
+          bytes_read(0) {}
+    // Called by the window when the slot is reused.
+    void Reset() {
+      packet.Clear();
+      lost = true;
+      bytes_read = 0;
+    }
     RudpDataPacket packet;
     bool lost;
     size_t bytes_read;
-    bptime::ptime reserve_time;
+  };
 
-    bool Missing(bptime::time_duration time_out) {
-      bptime::ptime now = boost::asio::deadline_timer::traits_type::now();
-      return (lost && ((reserve_time + time_out) < now));
-    }
+  // A range of packet indices which were reserved in the window, or last
+  // requested in a negative acknowledgement, at the same time.
+  struct Reservation {
+    Reservation(const boost::posix_time::ptime &time_in,
+                boost::uint64_t first_in,
+                boost::uint64_t last_in)
+        : time(time_in), first(first_in), last(last_in) {}
+    boost::posix_time::ptime time;
+    boost::uint64_t first, last;
   };
 
   // The receiver's window of unread packets. If this window fills up, any new
@@ -118,6 +143,23 @@ class RudpReceiver {
   typedef RudpSlidingWindow<UnreadPacket> UnreadPacketWindow;
   UnreadPacketWindow unread_packets_;
 
+  // The packet index of the first packet in the window.
+  boost::uint64_t begin_index_;
+
+  // The indices of the packets reserved in the window which haven't arrived.
+  // The lowest is the sequence number to acknowledge up to, and negative
+  // acknowledgements are built from the intervals, so both cost depends on
+  // the number of holes in the window rather than on its size.
+  RudpIntervalSet missing_packets_;
+
+  // The packets reserved or requested, in time order. A reservation comes due
+  // after the receive timeout, when the packets in it which are still missing
+  // are requested, and it is renewed to cover them.
+  std::deque<Reservation> reservations_;
+
+  // Scratch space for building negative acknowledgements.
+  std::vector<RudpIntervalSet::Interval> missing_intervals_;
+
   struct Ack {
     Ack() : packet(),
             send_time(boost::asio::deadline_timer::traits_type::now()) {}
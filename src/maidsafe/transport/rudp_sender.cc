@@ -53,7 +53,13 @@ RudpSender::RudpSender(RudpPeer &peer,  // NOLINT (Fraser)
     tick_timer_(tick_timer),
     congestion_control_(congestion_control),
     unacked_packets_(),
-    send_timeout_() {}
+    begin_index_(0),
+    next_unsent_index_(0),
+    lost_packets_(),
+    send_times_(),
+    pacer_(),
+    negative_ack_ranges_(),
+    newly_lost_() {}
 
 boost::uint32_t RudpSender::GetNextPacketSequenceNumber() const {
   return unacked_packets_.End();
@@ -64,17 +70,28 @@ bool RudpSender::Flushed() const {
 }
 
 size_t RudpSender::AddData(const asio::const_buffer &data) {
+  return AddData(std::vector<asio::const_buffer>(1, data));
+}
+
+size_t RudpSender::AddData(const std::vector<asio::const_buffer> &data) {
   if ((congestion_control_.SendWindowSize() == 0) &&
       (unacked_packets_.Size() == 0)) {
     unacked_packets_.SetMaximumSize(RudpParameters::default_window_size);
   } else {
     unacked_packets_.SetMaximumSize(congestion_control_.SendWindowSize());
   }
-  const unsigned char *begin = asio::buffer_cast<const unsigned char*>(data);
-  const unsigned char *ptr = begin;
-  const unsigned char *end = begin + asio::buffer_size(data);
+  auto buffer = data.begin();
+  size_t offset(0), copied(0);
+
+  while (!unacked_packets_.IsFull()) {
+    // Skip past any buffers which have been used up.
+    while (buffer != data.end() && offset == asio::buffer_size(*buffer)) {
+      ++buffer;
+      offset = 0;
+    }
+    if (buffer == data.end())
+      break;
 
-  while (!unacked_packets_.IsFull() && (ptr < end)) {
     boost::uint32_t n = unacked_packets_.Append();
 
     UnackedPacket &p = unacked_packets_[n];
@@ -85,29 +102,57 @@ size_t RudpSender::AddData(const asio::const_buffer &data) {
     p.packet.SetMessageNumber(0);
     p.packet.SetTimeStamp(0);
     p.packet.SetDestinationSocketId(peer_.Id());
-    size_t length = std::min<size_t>(congestion_control_.SendDataSize(),
-                                     end - ptr);
-    p.packet.SetData(ptr, ptr + length);
-    p.lost = true;  // Mark as lost so that DoSend() will send it.
-
-    ptr += length;
+    p.packet.SetData(std::string());
+    size_t space = congestion_control_.SendDataSize();
+    while (space > 0 && buffer != data.end()) {
+      const unsigned char *ptr =
+          asio::buffer_cast<const unsigned char*>(*buffer) + offset;
+      size_t length = std::min(space, asio::buffer_size(*buffer) - offset);
+      p.packet.AppendData(ptr, ptr + length);
+      space -= length;
+      copied += length;
+      offset += length;
+      if (offset == asio::buffer_size(*buffer)) {
+        ++buffer;
+        offset = 0;
+      }
+    }
   }
 
   DoSend();
 
-  return ptr - begin;
+  return copied;
 }
 
 void RudpSender::HandleAck(const RudpAckPacket &packet) {
   boost::uint32_t seqnum = packet.PacketSequenceNumber();
 
+  // The window is advanced first, so that the congestion control learns how
+  // many packets the acknowledgement delivered.
+  size_t packets_acknowledged(0);
+  bool advanced(unacked_packets_.Contains(seqnum) ||
+                unacked_packets_.End() == seqnum);
+  if (advanced) {
+    while (unacked_packets_.Begin() != seqnum) {
+      unacked_packets_.Remove();
+      ++begin_index_;
+      ++packets_acknowledged;
+    }
+    if (next_unsent_index_ < begin_index_)
+      next_unsent_index_ = begin_index_;
+    lost_packets_.EraseBelow(begin_index_);
+  }
+
   if (packet.HasOptionalFields()) {
     congestion_control_.OnAck(seqnum,
                               packet.RoundTripTime(),
                               packet.RoundTripTimeVariance(),
                               packet.AvailableBufferSize(),
                               packet.PacketsReceivingRate(),
-                              packet.EstimatedLinkCapacity());
+                              packet.EstimatedLinkCapacity(),
+                              packets_acknowledged,
+                              static_cast<size_t>(next_unsent_index_ -
+                                                  begin_index_));
   } else {
     congestion_control_.OnAck(seqnum);
   }
@@ -117,22 +162,20 @@ void RudpSender::HandleAck(const RudpAckPacket &packet) {
   response_packet.SetAckSequenceNumber(packet.AckSequenceNumber());
   peer_.Send(response_packet);
 
-  if (unacked_packets_.Contains(seqnum) || unacked_packets_.End() == seqnum) {
-    while (unacked_packets_.Begin() != seqnum)
-      unacked_packets_.Remove();
-
+  if (advanced)
     DoSend();
-  }
 }
 
 void RudpSender::HandleNegativeAck(const RudpNegativeAckPacket &packet) {
-  // Mark the specified packets as lost.
-  for (boost::uint32_t n = unacked_packets_.Begin();
-       n != unacked_packets_.End();
-       n = unacked_packets_.Next(n)) {
-    if (packet.ContainsSequenceNumber(n)) {
-      congestion_control_.OnNegativeAck(n);
-      unacked_packets_[n].lost = true;
+  // Mark the specified packets as lost. Only the packets which weren't
+  // already lost are visited.
+  packet.GetRanges(&negative_ack_ranges_);
+  for (auto range = negative_ack_ranges_.begin();
+       range != negative_ack_ranges_.end(); ++range) {
+    MarkLost(range->first, range->second);
+    for (auto it = newly_lost_.begin(); it != newly_lost_.end(); ++it) {
+      for (boost::uint64_t index = it->first; index <= it->second; ++index)
+        congestion_control_.OnNegativeAck(IndexToSequenceNumber(index));
     }
   }
 
@@ -140,20 +183,23 @@ void RudpSender::HandleNegativeAck(const RudpNegativeAckPacket &packet) {
 }
 
 void RudpSender::HandleTick() {
-  if (send_timeout_ <= tick_timer_.Now()) {
-    // Clear timeout. Will be reset next time a data packet is sent.
-    send_timeout_ = bptime::pos_infin;
-
-    // Mark all timedout unacknowledged packets as lost.
-    for (boost::uint32_t n = unacked_packets_.Begin();
-        n != unacked_packets_.End();
-        n = unacked_packets_.Next(n)) {
-      if ((unacked_packets_[n].last_send_time
-           + congestion_control_.SendTimeout()) < tick_timer_.Now()) {
-        congestion_control_.OnSendTimeout(n);
-        unacked_packets_[n].lost = true;
-      }
-    }
+  bptime::ptime now = tick_timer_.Now();
+
+  // Mark all timedout unacknowledged packets as lost. Packets are timed out
+  // in the order they were sent, skipping those which have since been
+  // acknowledged, marked lost or sent again.
+  while (!send_times_.empty() &&
+         (send_times_.front().first + congestion_control_.SendTimeout()) <
+             now) {
+    SendRecord record(send_times_.front());
+    send_times_.pop_front();
+    if (record.second < begin_index_ || lost_packets_.Contains(record.second))
+      continue;
+    boost::uint32_t n = IndexToSequenceNumber(record.second);
+    if (unacked_packets_[n].last_send_time != record.first)
+      continue;
+    congestion_control_.OnSendTimeout(n);
+    lost_packets_.Insert(record.second, record.second, NULL);
   }
 
   DoSend();
@@ -161,35 +207,91 @@ void RudpSender::HandleTick() {
 
 void RudpSender::DoSend() {
   bptime::ptime now = tick_timer_.Now();
-
-  for (boost::uint32_t n = unacked_packets_.Begin();
-       n != unacked_packets_.End();
-       n = unacked_packets_.Next(n)) {
+  pacer_.SetRate(congestion_control_.SendDelay(),
+                 RudpParameters::max_send_burst);
+
+  boost::uint64_t index;
+  bool retransmission;
+  for (size_t burst = 0; burst != RudpParameters::max_send_burst &&
+       pacer_.CanSend(now) && NextPacketToSend(&index, &retransmission);
+       ++burst) {
+    boost::uint32_t n = IndexToSequenceNumber(index);
     UnackedPacket &p = unacked_packets_[n];
-    if (p.lost) {
-      // peer_.Send is a blockable function call, it will only returned when
-      // the UDP socket sent out the packet successfully. So here the all
-      // un-acked packets can be sent out one-by-one in a bunch, i.e. the whole
-      // buffer (packet_size * window_size) will be sent out at once.
-      // If we make the Send to be unblockable, i.e. handled by a seperate
-      // thread, then we will need to first Check whether we are allowed to
-      // send another packet at this time, and then once request a packet to be
-      // sent, set the ticker to be with a fixed interval or
-      // tick_timer_.TickAt(now + congestion_control_.SendDelay());
-      if (peer_.Send(p.packet) == kSuccess) {
-        p.lost = false;
-        p.last_send_time = now;
-        congestion_control_.OnDataPacketSent(n);
-        tick_timer_.TickAt(now + congestion_control_.SendDelay());
-        return;
-      }
-    }
+    // peer_.Send is a blockable function call, it will only returned when
+    // the UDP socket sent out the packet successfully.
+    if (peer_.Send(p.packet) != kSuccess)
+      break;
+    if (retransmission)
+      lost_packets_.Erase(index);
+    else
+      ++next_unsent_index_;
+    p.last_send_time = now;
+    send_times_.push_back(SendRecord(now, index));
+    congestion_control_.OnDataPacketSent(n);
+    // Every sixteenth packet is followed immediately by the next, so that the
+    // peer can estimate the link capacity from the pair's arrival times.
+    if (n % 16 != 0)
+      pacer_.OnSend(now);
   }
-  // Set the send timeout so that unacknowledged packets can be marked as lost.
-  if (!unacked_packets_.IsEmpty()) {
-    send_timeout_ = unacked_packets_.Front().last_send_time +
-                    congestion_control_.SendTimeout();
+
+  // Tick when the next packet may be sent, or failing that, when the oldest
+  // unacknowledged packet times out.
+  if (NextPacketToSend(&index, &retransmission))
+    tick_timer_.TickAt(std::max(now, pacer_.NextSendTime()));
+  else if (!send_times_.empty())
+    tick_timer_.TickAt(send_times_.front().first +
+                       congestion_control_.SendTimeout());
+}
+
+bool RudpSender::NextPacketToSend(boost::uint64_t *index,
+                                  bool *retransmission) const {
+  *retransmission = !lost_packets_.IsEmpty();
+  if (*retransmission)
+    *index = lost_packets_.Front();
+  else if (next_unsent_index_ < begin_index_ + unacked_packets_.Size())
+    *index = next_unsent_index_;
+  else
+    return false;
+  return true;
+}
+
+boost::uint64_t RudpSender::SequenceNumberToIndex(boost::uint32_t n) const {
+  return begin_index_ + ((n - unacked_packets_.Begin()) &
+                         UnackedPacketWindow::kMaxSequenceNumber);
+}
+
+boost::uint32_t RudpSender::IndexToSequenceNumber(
+    boost::uint64_t index) const {
+  return (unacked_packets_.Begin() +
+          static_cast<boost::uint32_t>(index - begin_index_)) &
+         UnackedPacketWindow::kMaxSequenceNumber;
+}
+
+void RudpSender::MarkLost(boost::uint32_t first, boost::uint32_t last) {
+  newly_lost_.clear();
+  const boost::uint32_t kMask = UnackedPacketWindow::kMaxSequenceNumber;
+  boost::uint64_t sent = next_unsent_index_ - begin_index_;
+  if (sent == 0)
+    return;
+
+  // Clip the range to the packets which have been sent and not acknowledged.
+  // Part of the range may precede the window if it has already been
+  // acknowledged.
+  boost::uint64_t length = ((last - first) & kMask) + 1;
+  boost::uint64_t first_offset = SequenceNumberToIndex(first) - begin_index_;
+  boost::uint64_t begin_offset, end_offset;
+  if (first_offset < sent) {
+    begin_offset = first_offset;
+    end_offset = std::min(begin_offset + length, sent) - 1;
+  } else {
+    boost::uint64_t preceding = (unacked_packets_.Begin() - first) & kMask;
+    if (preceding >= length)
+      return;
+    begin_offset = 0;
+    end_offset = std::min(length - preceding, sent) - 1;
   }
+  lost_packets_.Insert(begin_index_ + begin_offset, begin_index_ + end_offset,
+                       &newly_lost_);
 }
 
 void RudpSender::NotifyClose() {
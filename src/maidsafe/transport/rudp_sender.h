@@ -30,13 +30,18 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_RUDP_SENDER_H_
 #define MAIDSAFE_TRANSPORT_RUDP_SENDER_H_
 
+#include <deque>
+#include <utility>
+#include <vector>
 #include "boost/asio/buffer.hpp"
 #include "boost/asio/ip/udp.hpp"
 #include "boost/cstdint.hpp"
 #include "boost/date_time/posix_time/posix_time_types.hpp"
 #include "maidsafe/transport/rudp_ack_packet.h"
 #include "maidsafe/transport/rudp_data_packet.h"
+#include "maidsafe/transport/rudp_interval_set.h"
 #include "maidsafe/transport/rudp_negative_ack_packet.h"
+#include "maidsafe/transport/rudp_pacer.h"
 #include "maidsafe/transport/rudp_shutdown_packet.h"
 #include "maidsafe/transport/rudp_sliding_window.h"
 
@@ -44,6 +49,10 @@ namespace maidsafe {
 
 namespace transport {
 
+namespace test {
+class RudpSenderTest;
+}  // namespace test
+
 class RudpCongestionControl;
 class RudpPeer;
 class RudpTickTimer;
@@ -63,6 +72,11 @@ class RudpSender {
   // Adds some application data to be sent. Returns number of bytes copied.
   size_t AddData(const boost::asio::const_buffer &data);
 
+  // Adds some application data to be sent, gathered from a sequence of
+  // buffers. Packets are filled across the boundaries between buffers. Returns
+  // number of bytes copied.
+  size_t AddData(const std::vector<boost::asio::const_buffer> &data);
+
   // Notify the other side that the current connection is to be dropped
   void NotifyClose();
 
@@ -76,13 +90,29 @@ class RudpSender {
   void HandleTick();
 
  private:
+  friend class test::RudpSenderTest;
+
   // Disallow copying and assignment.
   RudpSender(const RudpSender&);
   RudpSender &operator=(const RudpSender&);
 
-  // Send waiting packets.
+  // Send waiting packets, as fast as the pacer allows.
   void DoSend();
 
+  // Get the index of the next packet to send, returning false if there is
+  // none. Lost packets are sent again before any new packets are sent.
+  bool NextPacketToSend(boost::uint64_t *index, bool *retransmission) const;
+
+  // Helper functions to convert between sequence numbers in the window and
+  // packet indices, which count the packets sent since the sender was created
+  // and so never wrap around.
+  boost::uint64_t SequenceNumberToIndex(boost::uint32_t n) const;
+  boost::uint32_t IndexToSequenceNumber(boost::uint64_t index) const;
+
+  // Mark the sent packets in a range of sequence numbers as lost. The
+  // intervals of packets which were not already lost are left in newly_lost_.
+  void MarkLost(boost::uint32_t first, boost::uint32_t last);
+
   // The peer with which we are communicating.
   RudpPeer &peer_;
 
@@ -94,10 +124,13 @@ class RudpSender {
 
   struct UnackedPacket {
     UnackedPacket() : packet(),
-                      lost(false),
                       last_send_time() {}
+    // Called by the window when the slot is reused.
+    void Reset() {
+      packet.Clear();
+      last_send_time = boost::posix_time::ptime();
+    }
     RudpDataPacket packet;
-    bool lost;
     boost::posix_time::ptime last_send_time;
   };
 
@@ -105,8 +138,30 @@ class RudpSender {
   typedef RudpSlidingWindow<UnackedPacket> UnackedPacketWindow;
   UnackedPacketWindow unacked_packets_;
 
-  // The next time at which all unacked packets will be considered lost.
-  boost::posix_time::ptime send_timeout_;
+  // The packet index of the first packet in the window, and of the first
+  // packet which has not yet been sent. Packets from next_unsent_index_ to the
+  // end of the window are sent in order once any lost packets have been.
+  boost::uint64_t begin_index_, next_unsent_index_;
+
+  // The indices of the sent packets which have been reported lost by a
+  // negative acknowledgement or have timed out, and are to be sent again in
+  // ascending order. Reported ranges are merged into the set as intervals, so
+  // a report costs O(log n) however many packets it covers.
+  RudpIntervalSet lost_packets_;
+
+  // The time at which each packet was sent, in the order sent. An entry is
+  // stale once its packet has been acknowledged, marked lost or sent again,
+  // and is dropped when it reaches the front. Packets are timed out from the
+  // front, so a tick only looks at the packets which have timed out.
+  typedef std::pair<boost::posix_time::ptime, boost::uint64_t> SendRecord;
+  std::deque<SendRecord> send_times_;
+
+  // Spaces the data packets at the congestion control's send delay.
+  RudpPacer pacer_;
+
+  // Scratch space for the ranges of a negative acknowledgement.
+  std::vector<RudpNegativeAckPacket::Range> negative_ack_ranges_;
+  std::vector<RudpIntervalSet::Interval> newly_lost_;
 };
 
 }  // namespace transport
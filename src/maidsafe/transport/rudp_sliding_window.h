@@ -31,7 +31,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAIDSAFE_TRANSPORT_RUDP_SLIDING_WINDOW_H_
 
 #include <cassert>
-#include <deque>
+#include <vector>
 
 #include "boost/cstdint.hpp"
 #include "maidsafe/common/utils.h"
@@ -42,6 +42,13 @@ namespace maidsafe {
 
 namespace transport {
 
+// The items are held in a ring buffer whose capacity is the smallest power of
+// two not less than RudpParameters::maximum_window_size, so a sequence number
+// maps to its slot with a mask, and the wraparound of sequence numbers needs
+// no special handling. Slots are reused as the window moves on rather than
+// reallocated. An item type holding storage worth keeping from one lap of the
+// ring to the next, such as a packet's payload, may provide a Reset() member,
+// which Append() calls in place of assigning a default-constructed item.
 template <typename T>
 class RudpSlidingWindow {
  public:
@@ -51,23 +58,28 @@ class RudpSlidingWindow {
 
   // Construct to start with a random sequence number.
   RudpSlidingWindow()
-      : items_(), maximum_size_(0), begin_(0), end_(0) {
+      : items_(), mask_(0), maximum_size_(0), size_(0), begin_(0), end_(0) {
     Reset(GenerateSequenceNumber());
   }
 
   // Construct to start with a specified sequence number.
   explicit RudpSlidingWindow(boost::uint32_t initial_sequence_number)
-      : items_(),
-        maximum_size_(RudpParameters::default_window_size),
-        begin_(initial_sequence_number),
-        end_(initial_sequence_number) {}
+      : items_(), mask_(0), maximum_size_(0), size_(0), begin_(0), end_(0) {
+    Reset(initial_sequence_number);
+  }
 
   // Reset to empty starting with the specified sequence number.
   void Reset(boost::uint32_t initial_sequence_number) {
     assert(initial_sequence_number <= kMaxSequenceNumber);
-    maximum_size_ = RudpParameters::default_window_size;
+    size_t capacity(1);
+    while (capacity < RudpParameters::maximum_window_size)
+      capacity <<= 1;
+    if (items_.size() < capacity)
+      items_.resize(capacity);
+    mask_ = items_.size() - 1;
+    SetMaximumSize(RudpParameters::default_window_size);
+    size_ = 0;
     begin_ = end_ = initial_sequence_number;
-    items_.clear();
   }
 
   // Get the sequence number of the first item in window.
@@ -101,80 +113,88 @@ class RudpSlidingWindow {
   }
 
   // Set the maximum size of the window.
+  // The size is also limited to the capacity of the ring.
   void SetMaximumSize(size_t size) {
-    maximum_size_ = size < RudpParameters::maximum_window_size
-                    ? size : RudpParameters::maximum_window_size;
+    size_t limit = RudpParameters::maximum_window_size < items_.size()
+                   ? RudpParameters::maximum_window_size : items_.size();
+    maximum_size_ = size < limit ? size : limit;
   }
 
   // Get the current size of the window.
   size_t Size() const {
-    return items_.size();
+    return size_;
   }
 
   // Get whether the window is empty.
   bool IsEmpty() const {
-    return items_.empty();
+    return size_ == 0;
   }
 
   // Get whether the window is full.
   bool IsFull() const {
-    return items_.size() >= maximum_size_;
+    return size_ >= maximum_size_;
   }
 
-  // Add a new item to the end.
+  // Add a new item to the end, reusing the slot of an item removed earlier.
   // Precondition: !IsFull().
   boost::uint32_t Append() {
     assert(!IsFull());
-    items_.push_back(T());
+    ResetItem(&items_[end_ & mask_], 0);
+    ++size_;
     boost::uint32_t n = end_;
     end_ = Next(end_);
     return n;
   }
 
-  // Remove the first item from the window.
+  // Remove the first item from the window. The item isn't destroyed until its
+  // slot is reused.
   // Precondition: !IsEmpty().
   void Remove() {
     assert(!IsEmpty());
-    items_.erase(items_.begin());
+    --size_;
     begin_ = Next(begin_);
   }
 
   // Get the item with the specified sequence number.
   // Precondition: Contains(n).
   T &operator[](boost::uint32_t n) {
-    return items_[SequenceNumberToIndex(n)];
+    assert(Contains(n));
+    return items_[n & mask_];
   }
 
   // Get the item with the specified sequence number.
   // Precondition: Contains(n).
   const T &operator[](boost::uint32_t n) const {
-    return items_[SequenceNumberToIndex(n)];
+    assert(Contains(n));
+    return items_[n & mask_];
   }
 
   // Get the element at the front of the window.
   // Precondition: !IsEmpty().
   T &Front() {
-    return items_.front();
+    assert(!IsEmpty());
+    return items_[begin_ & mask_];
   }
 
   // Get the element at the front of the window.
   // Precondition: !IsEmpty().
   const T &Front() const {
-    return items_.front();
+    assert(!IsEmpty());
+    return items_[begin_ & mask_];
   }
 
   // Get the element at the back of the window.
   // Precondition: !IsEmpty().
   T &Back() {
     assert(!IsEmpty());
-    return items_.front();
+    return items_[(end_ - 1) & mask_];
   }
 
   // Get the element at the back of the window.
   // Precondition: !IsEmpty().
   const T &Back() const {
     assert(!IsEmpty());
-    return items_.back();
+    return items_[(end_ - 1) & mask_];
   }
 
   // Get the sequence number that follows a given number.
@@ -187,15 +207,16 @@ class RudpSlidingWindow {
   RudpSlidingWindow(const RudpSlidingWindow&);
   RudpSlidingWindow &operator=(const RudpSlidingWindow&);
 
-  // Helper function to convert a sequence number into an index in the window.
-  size_t SequenceNumberToIndex(boost::uint32_t n) const {
-    assert(Contains(n));
-    if (begin_ <= end_)
-      return n - begin_;
-    else if (n < end_)
-      return kMaxSequenceNumber - begin_ + n + 1;
-    else
-      return n - begin_;
+  // Helper functions to return a reused item to its initial state, using the
+  // item's Reset() member if it has one.
+  template <typename U>
+  static auto ResetItem(U *item, int) -> decltype(item->Reset(), void()) {
+    item->Reset();
+  }
+
+  template <typename U>
+  static void ResetItem(U *item, long) {  // NOLINT
+    *item = U();
   }
 
   // Helper function to generate an initial sequence number.
@@ -216,12 +237,18 @@ class RudpSlidingWindow {
       return (n < end) || ((n >= begin) && (n <= kMaxSequenceNumber));
   }
 
-  // The items in the window.
-  std::deque<T> items_;
+  // The ring of item slots. The slot for sequence number n is n & mask_,
+  // which respects the wraparound of sequence numbers as the number of slots
+  // is a power of two.
+  std::vector<T> items_;
+  size_t mask_;
 
   // The maximum number of items allowed in the window.
   size_t maximum_size_;
 
+  // The number of items in the window.
+  size_t size_;
+
   // The sequence number of the first item in window.
   boost::uint32_t begin_;
 
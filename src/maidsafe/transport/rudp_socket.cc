@@ -50,6 +50,11 @@ namespace maidsafe {
 
 namespace transport {
 
+// Data packets with payloads up to this size are copied out of the
+// multiplexer's receive buffer, so that packets waiting to be read don't each
+// pin a full-sized buffer. Only larger payloads are left in the buffer.
+static const size_t kMaxCopiedPayloadSize(4096);
+
 RudpSocket::RudpSocket(RudpMultiplexer &multiplexer)  // NOLINT (Fraser)
   : dispatcher_(multiplexer.dispatcher_),
     peer_(multiplexer),
@@ -61,7 +66,7 @@ RudpSocket::RudpSocket(RudpMultiplexer &multiplexer)  // NOLINT (Fraser)
     waiting_connect_(multiplexer.socket_.get_io_service()),
     waiting_connect_ec_(),
     waiting_write_(multiplexer.socket_.get_io_service()),
-    waiting_write_buffer_(),
+    waiting_write_buffers_(),
     waiting_write_ec_(),
     waiting_write_bytes_transferred_(0),
     waiting_read_(multiplexer.socket_.get_io_service()),
@@ -150,7 +155,7 @@ void RudpSocket::StartConnect() {
                 RudpSession::kServer);
 }
 
-void RudpSocket::StartWrite(const asio::const_buffer &data) {
+void RudpSocket::StartWrite(const std::vector<asio::const_buffer> &data) {
   // Check for a no-op write.
   if (asio::buffer_size(data) == 0) {
     waiting_write_ec_.clear();
@@ -161,23 +166,33 @@ void RudpSocket::StartWrite(const asio::const_buffer &data) {
   // Try processing the write immediately. If there's space in the write buffer
   // then the operation will complete immediately. Otherwise, it will wait until
   // some other event frees up space in the buffer.
-  waiting_write_buffer_ = data;
+  waiting_write_buffers_ = data;
   waiting_write_bytes_transferred_ = 0;
   ProcessWrite();
 }
 
 void RudpSocket::ProcessWrite() {
-  // There's only a waiting write if the write buffer is non-empty.
-  if (asio::buffer_size(waiting_write_buffer_) == 0)
+  // There's only a waiting write if the write buffers are non-empty.
+  if (asio::buffer_size(waiting_write_buffers_) == 0)
     return;
 
-  // Copy whatever data we can into the write buffer.
-  size_t length = sender_.AddData(waiting_write_buffer_);
-  waiting_write_buffer_ = waiting_write_buffer_ + length;
+  // Copy whatever data we can into the write buffer, then drop the data that
+  // has been consumed from the front of the waiting buffers.
+  size_t length = sender_.AddData(waiting_write_buffers_);
   waiting_write_bytes_transferred_ += length;
+  auto buffer = waiting_write_buffers_.begin();
+  while (buffer != waiting_write_buffers_.end() &&
+         asio::buffer_size(*buffer) <= length) {
+    length -= asio::buffer_size(*buffer);
+    ++buffer;
+  }
+  buffer = waiting_write_buffers_.erase(waiting_write_buffers_.begin(), buffer);
+  if (buffer != waiting_write_buffers_.end())
+    *buffer = *buffer + length;
+
   // If we have finished writing all of the data then it's time to trigger the
   // write's completion handler.
-  if (asio::buffer_size(waiting_write_buffer_) == 0) {
+  if (asio::buffer_size(waiting_write_buffers_) == 0) {
     sent_length_ = 0;
     // The write is done. Trigger the write's completion handler.
     waiting_write_ec_.clear();
@@ -235,27 +250,64 @@ void RudpSocket::ProcessFlush() {
 }
 
 void RudpSocket::HandleReceiveFrom(const asio::const_buffer &data,
-                                   const ip::udp::endpoint &endpoint) {
+                                   const ip::udp::endpoint &endpoint,
+                                   const std::shared_ptr<const void> &owner) {
   if (endpoint == peer_.Endpoint()) {
-    RudpDataPacket data_packet;
-    RudpAckPacket ack_packet;
-    RudpAckOfAckPacket ack_of_ack_packet;
-    RudpNegativeAckPacket negative_ack_packet;
-    RudpHandshakePacket handshake_packet;
-    RudpShutdownPacket shutdown_packet;
-    if (data_packet.Decode(data)) {
-      HandleData(data_packet);
-    } else if (ack_packet.Decode(data)) {
-      HandleAck(ack_packet);
-    } else if (ack_of_ack_packet.Decode(data)) {
-      HandleAckOfAck(ack_of_ack_packet);
-    } else if (negative_ack_packet.Decode(data)) {
-      HandleNegativeAck(negative_ack_packet);
-    } else if (handshake_packet.Decode(data)) {
-      HandleHandshake(handshake_packet);
-    } else if (shutdown_packet.Decode(data)) {
-      Close();
-    } else {
+    // The header says which type the packet is, so it is decoded only as
+    // that type.
+    boost::uint16_t control_packet_type(0);
+    bool decoded(false);
+    if (RudpDataPacket::IsValid(data)) {
+      RudpDataPacket packet;
+      if (asio::buffer_size(data) - RudpDataPacket::kHeaderSize <=
+          kMaxCopiedPayloadSize)
+        decoded = packet.Decode(data);
+      else
+        decoded = packet.Decode(data, owner);
+      if (decoded)
+        HandleData(packet);
+    } else if (RudpControlPacket::DecodeType(&control_packet_type, data)) {
+      switch (control_packet_type) {
+        case RudpAckPacket::kPacketType: {
+          RudpAckPacket packet;
+          decoded = packet.Decode(data);
+          if (decoded)
+            HandleAck(packet);
+          break;
+        }
+        case RudpAckOfAckPacket::kPacketType: {
+          RudpAckOfAckPacket packet;
+          decoded = packet.Decode(data);
+          if (decoded)
+            HandleAckOfAck(packet);
+          break;
+        }
+        case RudpNegativeAckPacket::kPacketType: {
+          RudpNegativeAckPacket packet;
+          decoded = packet.Decode(data);
+          if (decoded)
+            HandleNegativeAck(packet);
+          break;
+        }
+        case RudpHandshakePacket::kPacketType: {
+          RudpHandshakePacket packet;
+          decoded = packet.Decode(data);
+          if (decoded)
+            HandleHandshake(packet);
+          break;
+        }
+        case RudpShutdownPacket::kPacketType: {
+          RudpShutdownPacket packet;
+          decoded = packet.Decode(data);
+          if (decoded)
+            Close();
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    if (!decoded) {
       DLOG(ERROR) << "Socket " << session_.Id()
                   << " ignoring invalid packet from "
                   << endpoint << std::endl;
@@ -39,6 +39,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <deque>
+#include <vector>
 
 #include "boost/asio/buffer.hpp"
 #include "boost/asio/deadline_timer.hpp"
@@ -103,6 +104,12 @@ class RudpSocket {
     return congestion_control_.IsSlowTransmission(length);
   }
 
+  // Choose the congestion control algorithm for the connection. This should
+  // be done before connecting, as the algorithm starts afresh.
+  void SetCongestionAlgorithm(RudpParameters::CongestionAlgorithm algorithm) {
+    congestion_control_.SetAlgorithm(algorithm);
+  }
+
   // Asynchronously process one "tick". The internal tick size varies based on
   // the next time-based event that is of interest to the socket.
   template <typename TickHandler>
@@ -139,6 +146,13 @@ class RudpSocket {
   template <typename WriteHandler>
   void AsyncWrite(const boost::asio::const_buffer &data,
                   WriteHandler handler) {
+    AsyncWrite(std::vector<boost::asio::const_buffer>(1, data), handler);
+  }
+
+  // As above, but gathering the data to be written from a sequence of buffers.
+  template <typename WriteHandler>
+  void AsyncWrite(const std::vector<boost::asio::const_buffer> &data,
+                  WriteHandler handler) {
     RudpWriteOp<WriteHandler> op(handler, &waiting_write_ec_,
                                 &waiting_write_bytes_transferred_);
     waiting_write_.async_wait(op);
@@ -173,7 +187,7 @@ class RudpSocket {
 
   void StartConnect(const boost::asio::ip::udp::endpoint &remote);
   void StartConnect();
-  void StartWrite(const boost::asio::const_buffer &data);
+  void StartWrite(const std::vector<boost::asio::const_buffer> &data);
   void ProcessWrite();
   void StartRead(const boost::asio::mutable_buffer &data,
                  size_t transfer_at_least);
@@ -181,9 +195,13 @@ class RudpSocket {
   void StartFlush();
   void ProcessFlush();
 
-  // Called by the RudpDispatcher when a new packet arrives for the socket.
+  // Called by the RudpDispatcher when a new packet arrives for the socket. A
+  // data packet's payload of up to 4096 bytes is copied out of data. A larger
+  // payload is left in data, and the packet holds a reference to owner until
+  // the payload has been read.
   void HandleReceiveFrom(const boost::asio::const_buffer &data,
-                         const boost::asio::ip::udp::endpoint &endpoint);
+                         const boost::asio::ip::udp::endpoint &endpoint,
+                         const std::shared_ptr<const void> &owner);
 
   // Called to process a newly received handshake packet.
   void HandleHandshake(const RudpHandshakePacket &packet);
@@ -237,7 +255,7 @@ class RudpSocket {
   // time. The following data members store the pending write, and the result
   // that is intended for its completion handler.
   boost::asio::deadline_timer waiting_write_;
-  boost::asio::const_buffer waiting_write_buffer_;
+  std::vector<boost::asio::const_buffer> waiting_write_buffers_;
   boost::system::error_code waiting_write_ec_;
   size_t waiting_write_bytes_transferred_;
 
@@ -32,6 +32,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cassert>
 #include <functional>
 
+#include "maidsafe/transport/outbound_limiter.h"
 #include "maidsafe/transport/rudp_acceptor.h"
 #include "maidsafe/transport/rudp_connection.h"
 #include "maidsafe/transport/rudp_multiplexer.h"
@@ -55,7 +56,10 @@ RudpTransport::RudpTransport(asio::io_service &asio_service)   // NOLINT
     strand_(asio_service),
     multiplexer_(new RudpMultiplexer(asio_service)),
     acceptor_(),
-    connections_() {}
+    connections_(),
+    outbound_limiter_(std::make_shared<OutboundLimiter>(asio_service,
+                                                        on_writable_)),
+    congestion_algorithm_(RudpParameters::congestion_algorithm) {}
 
 RudpTransport::~RudpTransport() {
   for (auto it = connections_.begin(); it != connections_.end(); ++it)
@@ -76,7 +80,10 @@ TransportCondition RudpTransport::StartListening(const Endpoint &endpoint) {
   transport_details_.endpoint.port = listening_port_;
   transport_details_.endpoint.ip = endpoint.ip;
 
-  StartAccept();
+  // The accept is started inside the strand, so that its connection is given
+  // the algorithm most recently chosen.
+  strand_.dispatch(std::bind(&RudpTransport::StartAccept, shared_from_this(),
+                             acceptor_));
   StartDispatch();
 
   return kSuccess;
@@ -120,17 +127,17 @@ void RudpTransport::HandleDispatch(MultiplexerPtr multiplexer,
   StartDispatch();
 }
 
-void RudpTransport::StartAccept() {
+void RudpTransport::StartAccept(AcceptorPtr acceptor) {
+  if (!acceptor->IsOpen())
+    return;
+
   ip::udp::endpoint endpoint;  // Endpoint is assigned when socket is accepted.
-  ConnectionPtr connection(std::make_shared<RudpConnection>(shared_from_this(),
-                                                           strand_,
-                                                           multiplexer_,
-                                                           endpoint));
+  ConnectionPtr connection(NewConnection(endpoint));
 
-  acceptor_->AsyncAccept(connection->Socket(),
-                         strand_.wrap(std::bind(&RudpTransport::HandleAccept,
-                                                shared_from_this(), acceptor_,
-                                                connection, args::_1)));
+  acceptor->AsyncAccept(connection->Socket(),
+                        strand_.wrap(std::bind(&RudpTransport::HandleAccept,
+                                               shared_from_this(), acceptor,
+                                               connection, args::_1)));
 }
 
 void RudpTransport::HandleAccept(AcceptorPtr acceptor,
@@ -146,7 +153,7 @@ void RudpTransport::HandleAccept(AcceptorPtr acceptor,
     connection->StartReceiving();
   }
 
-  StartAccept();
+  StartAccept(acceptor);
 }
 
 void RudpTransport::Send(const std::string &data,
@@ -178,12 +185,53 @@ void RudpTransport::ConnectCallback(const int &result,
 void RudpTransport::Send(const std::string &data,
                          const Endpoint &endpoint,
                          const Timeout &timeout) {
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>(data));
+  Send(ConstBuffers(1, asio::buffer(*owner)), owner, endpoint, timeout);
+}
+
+void RudpTransport::Send(const ConstBuffers &data,
+                         const std::shared_ptr<const void> &owner,
+                         const Endpoint &endpoint,
+                         const Timeout &timeout) {
+  // The message is counted against the outbound limits for as long as its
+  // connection holds on to the owner.
+  std::shared_ptr<const void> ticket(owner);
+  if (!outbound_limiter_->Acquire(endpoint, asio::buffer_size(data), &ticket)) {
+    (*on_error_)(kSendStalled, endpoint);
+    return;
+  }
   strand_.dispatch(std::bind(&RudpTransport::DoSend,
                              shared_from_this(),
-                             data, endpoint, timeout));
+                             data, ticket, endpoint, timeout));
+}
+
+void RudpTransport::SetOutboundLimits(const OutboundLimits &limits) {
+  outbound_limiter_->set_limits(limits);
+}
+
+void RudpTransport::SetCongestionAlgorithm(
+    RudpParameters::CongestionAlgorithm algorithm) {
+  strand_.dispatch(std::bind(&RudpTransport::DoSetCongestionAlgorithm,
+                             shared_from_this(), algorithm));
 }
 
-void RudpTransport::DoSend(const std::string &data,
+void RudpTransport::DoSetCongestionAlgorithm(
+    RudpParameters::CongestionAlgorithm algorithm) {
+  congestion_algorithm_ = algorithm;
+}
+
+RudpTransport::ConnectionPtr RudpTransport::NewConnection(
+    const ip::udp::endpoint &remote) {
+  ConnectionPtr connection(std::make_shared<RudpConnection>(shared_from_this(),
+                                                           strand_,
+                                                           multiplexer_,
+                                                           remote));
+  connection->Socket().SetCongestionAlgorithm(congestion_algorithm_);
+  return connection;
+}
+
+void RudpTransport::DoSend(const ConstBuffers &data,
+                           const std::shared_ptr<const void> &owner,
                            const Endpoint &endpoint,
                            const Timeout &timeout) {
   ip::udp::endpoint ep(endpoint.ip, endpoint.port);
@@ -199,12 +247,10 @@ void RudpTransport::DoSend(const std::string &data,
     // StartDispatch();
   }
 
-  ConnectionPtr connection(std::make_shared<RudpConnection>(shared_from_this(),
-                                                           strand_,
-                                                           multiplexer_, ep));
+  ConnectionPtr connection(NewConnection(ep));
 
   DoInsertConnection(connection);
-  connection->StartSending(data, timeout);
+  connection->StartSending(data, owner, timeout);
 // Moving StartDispatch() after StartSending(), as on Windows - client-socket's
 // attempt to call async_receive_from() will result in EINVAL error until it is
 // either bound to any port or a sendto() operation is performed by the socket.
@@ -234,9 +280,7 @@ void RudpTransport::DoConnect(const Endpoint &endpoint,
     // StartDispatch();
   }
 
-  ConnectionPtr connection(std::make_shared<RudpConnection>(shared_from_this(),
-                                                            strand_,
-                                                            multiplexer_, ep));
+  ConnectionPtr connection(NewConnection(ep));
   DoInsertConnection(connection);
   connection->Connect(timeout, callback);
 
@@ -35,6 +35,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <vector>
 #include "boost/asio/io_service.hpp"
+#include "boost/asio/ip/udp.hpp"
 #include "boost/asio/strand.hpp"
 #include "maidsafe/transport/transport.h"
 #include "maidsafe/transport/contact.h"
@@ -53,6 +54,7 @@ namespace transport {
 class RudpAcceptor;
 class RudpConnection;
 class RudpMultiplexer;
+class OutboundLimiter;
 class RudpSocket;
 
 typedef std::function<void(const TransportCondition&)> ConnectFunctor;
@@ -85,6 +87,15 @@ class RudpTransport : public Transport,
   virtual void Send(const std::string &data,
                     const Contact &remote_contact,
                     const Timeout &timeout);
+  virtual void Send(const ConstBuffers &data,
+                    const std::shared_ptr<const void> &owner,
+                    const Endpoint &endpoint,
+                    const Timeout &timeout);
+  virtual void SetOutboundLimits(const OutboundLimits &limits);
+  // Choose the congestion control algorithm used by connections made from
+  // now on. An accept already awaiting a peer keeps the algorithm it was
+  // started with. By default RudpParameters::congestion_algorithm is used.
+  void SetCongestionAlgorithm(RudpParameters::CongestionAlgorithm algorithm);
   void Connect(const Endpoint &endpoint, const Timeout &timeout,
                ConnectFunctor callback);
   static DataSize kMaxTransportMessageSize() { return 67108864; }
@@ -106,16 +117,19 @@ class RudpTransport : public Transport,
   void HandleDispatch(MultiplexerPtr multiplexer,
                       const boost::system::error_code &ec);
 
-  void StartAccept();
+  void StartAccept(AcceptorPtr acceptor);
   void HandleAccept(AcceptorPtr acceptor,
                     ConnectionPtr connection,
                     const boost::system::error_code &ec);
 
-  void DoSend(const std::string &data,
+  void DoSend(const ConstBuffers &data,
+              const std::shared_ptr<const void> &owner,
               const Endpoint &endpoint,
               const Timeout &timeout);
   void DoConnect(const Endpoint &endpoint, const Timeout &timeout,
                  ConnectFunctor callback);
+  void DoSetCongestionAlgorithm(RudpParameters::CongestionAlgorithm algorithm);
+  ConnectionPtr NewConnection(const boost::asio::ip::udp::endpoint &remote);
 
   void ConnectCallback(const int &result,
                        const std::string &data,
@@ -136,6 +150,11 @@ class RudpTransport : public Transport,
   // async operations (after calling PrepareSend()), they are kept alive with
   // a shared_ptr in this map, as well as in the async operation handlers.
   ConnectionSet connections_;
+
+  // Accounts for the messages accepted by Send() until they are written out.
+  std::shared_ptr<OutboundLimiter> outbound_limiter_;
+
+  RudpParameters::CongestionAlgorithm congestion_algorithm_;
 };
 
 typedef std::shared_ptr<RudpTransport> RudpTransportPtr;
@@ -0,0 +1,110 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_SHARED_POOL_H_
+#define MAIDSAFE_TRANSPORT_SHARED_POOL_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "boost/thread/mutex.hpp"
+
+namespace maidsafe {
+
+namespace transport {
+
+// A pool of objects handed out by shared_ptr, for objects such as datagram
+// buffers which are needed for every message but only briefly. The pool keeps
+// a reference to each object it creates, and an object is free again once
+// that is the only reference left, so users may pass objects on to other
+// threads without returning them. Acquire looks at the few objects following
+// the one last handed out, which in steady traffic have usually been released
+// by then, and only creates an object if none of them is free. At most
+// max_size objects are kept; beyond that, objects are created as needed and
+// destroyed when released.
+template <typename T>
+class SharedPool {
+ public:
+  typedef std::function<std::shared_ptr<T>()> Factory;
+
+  SharedPool(const Factory &factory, size_t max_size)
+      : factory_(factory),
+        max_size_(max_size),
+        objects_(),
+        cursor_(0),
+        allocations_(0),
+        mutex_() {}
+
+  std::shared_ptr<T> Acquire() {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      size_t probes(objects_.size() < kProbeCount ? objects_.size() :
+                                                    kProbeCount);
+      for (size_t i = 0; i != probes; ++i) {
+        cursor_ = (cursor_ + 1) % objects_.size();
+        if (objects_[cursor_].use_count() == 1) {
+          // Pairs with the release of the last user's reference, so that its
+          // writes to the object are visible here.
+          std::atomic_thread_fence(std::memory_order_acquire);
+          return objects_[cursor_];
+        }
+      }
+    }
+
+    std::shared_ptr<T> object(factory_());
+    ++allocations_;
+    boost::mutex::scoped_lock lock(mutex_);
+    if (objects_.size() < max_size_) {
+      objects_.push_back(object);
+      cursor_ = objects_.size() - 1;
+    }
+    return object;
+  }
+
+  // The number of objects the pool has created.
+  size_t allocations() const { return allocations_; }
+
+ private:
+  SharedPool(const SharedPool&);
+  SharedPool &operator=(const SharedPool&);
+
+  static const size_t kProbeCount = 4;
+
+  Factory factory_;
+  size_t max_size_;
+  std::vector<std::shared_ptr<T>> objects_;
+  size_t cursor_;
+  std::atomic<size_t> allocations_;
+  boost::mutex mutex_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_SHARED_POOL_H_
@@ -29,12 +29,14 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <algorithm>
 #include <array>  // NOLINT
+#include <cstring>
 #include <functional>
 
 #include "boost/asio/read.hpp"
 #include "boost/asio/write.hpp"
 #include "boost/date_time/posix_time/posix_time.hpp"
 
+#include "maidsafe/transport/tcp_parameters.h"
 #include "maidsafe/transport/tcp_transport.h"
 #include "maidsafe/transport/log.h"
 
@@ -48,19 +50,54 @@ namespace maidsafe {
 
 namespace transport {
 
+// Set in the first byte of the size field to mark a framed message. Message
+// sizes are well below 2^31, so the bit is never set by an unframed sender.
+static const unsigned char kFramedFlag = 0x80;
+// Size of the request id and reply-to id following the size of a frame.
+static const size_t kFrameIdsSize = 2 * sizeof(uint64_t);
+// Bounds on the amount of a message read in a single operation. Reads start at
+// kMaxTransportChunkSize and grow towards kMaxReadSize while they complete
+// well within the stall timeout.
+static const size_t kMaxReadSize = 16 * 1024 * 1024;
+// A message received whole is read into a buffer allocated up to this size
+// from its header. A larger buffer is doubled as the data arrives, so that a
+// peer has to send the data it claims before the memory is committed.
+static const size_t kMaxInitialDataBufferSize = 4 * 1024 * 1024;
+
 TcpConnection::TcpConnection(const std::shared_ptr<TcpTransport> &tcp_transport,
-                             ip::tcp::endpoint const &remote)
+                             ip::tcp::endpoint const &remote,
+                             bool framed)
   : transport_(tcp_transport),
     strand_(tcp_transport->asio_service_),
     socket_(tcp_transport->asio_service_),
-    timer_(tcp_transport->asio_service_),
+    timing_wheel_(tcp_transport->timing_wheel_),
+    timer_(),
+    deadline_(bptime::pos_infin),
+    timeout_expiry_(bptime::pos_infin),
     response_deadline_(),
     remote_endpoint_(remote),
     size_buffer_(sizeof(DataSize)),
     data_buffer_(),
+    write_buffers_(),
+    write_owner_(),
     data_size_(0),
     data_received_(0),
-    timeout_for_response_(kDefaultInitialTimeout) {
+    read_size_(kMaxTransportChunkSize),
+    read_started_(),
+    stream_(),
+    stream_strand_(tcp_transport->asio_service_),
+    timeout_for_response_(kDefaultInitialTimeout),
+    idle_(false),
+    framed_(framed),
+    write_pending_(false),
+    reading_frame_(false),
+    next_request_id_(1),
+    send_queue_(),
+    frames_in_write_(0),
+    frame_writes_(0),
+    frames_written_(0),
+    outstanding_requests_(),
+    pending_dispatches_(0) {
   static_assert((sizeof(DataSize)) == 4, "DataSize must be 4 bytes.");
 }
 
@@ -70,14 +107,20 @@ ip::tcp::socket &TcpConnection::Socket() {
   return socket_;
 }
 
+const ip::tcp::endpoint &TcpConnection::RemoteEndpoint() const {
+  return remote_endpoint_;
+}
+
 void TcpConnection::Close() {
   strand_.dispatch(std::bind(&TcpConnection::DoClose, shared_from_this()));
 }
 
 void TcpConnection::DoClose() {
+  FailStream(kNoConnection);
   bs::error_code ignored_ec;
   socket_.close(ignored_ec);
-  timer_.cancel();
+  timing_wheel_->Cancel(&timer_);
+  timeout_expiry_ = bptime::pos_infin;
   if (std::shared_ptr<TcpTransport> transport = transport_.lock())
     transport->RemoveConnection(shared_from_this());
 }
@@ -88,44 +131,129 @@ void TcpConnection::StartReceiving() {
 }
 
 void TcpConnection::DoStartReceiving() {
-  StartReadSize();
+  // Messages are always written whole, so there's nothing for Nagle's
+  // algorithm to gain and it would only delay small responses.
   bs::error_code ignored_ec;
-  CheckTimeout(ignored_ec);
+  socket_.set_option(ip::tcp::no_delay(true), ignored_ec);
+  StartReadSize();
+  CheckTimeout();
 }
 
-void TcpConnection::StartSending(const std::string &data,
+void TcpConnection::StartSending(const ConstBuffers &data,
+                                 const std::shared_ptr<const void> &owner,
                                  const Timeout &timeout) {
-  EncodeData(data);
+  if (framed_) {
+    strand_.dispatch(std::bind(&TcpConnection::DoSendFrame, shared_from_this(),
+                               data, owner, timeout, 0));
+    return;
+  }
+  EncodeData(data, owner);
   timeout_for_response_ = timeout;
   strand_.dispatch(std::bind(&TcpConnection::DoStartSending,
                              shared_from_this()));
 }
 
 void TcpConnection::DoStartSending() {
-  StartConnect();
-}
+  if (idle_) {
+    idle_ = false;
+    if (socket_.is_open() && !IsStale())
+      return StartWrite();
 
-void TcpConnection::CheckTimeout(const bs::error_code &ec) {
-  if (ec && ec != boost::asio::error::operation_aborted) {
-    DLOG(ERROR) << "TcpConnection check timeout error: " << ec.message();
+    // The idle connection has been closed, either by the peer or by its idle
+    // timeout expiring, so fall back to establishing a new one.
     bs::error_code ignored_ec;
     socket_.close(ignored_ec);
-    return;
+    if (std::shared_ptr<TcpTransport> transport = transport_.lock())
+      transport->InsertConnection(shared_from_this());
   }
+  StartConnect();
+}
 
+void TcpConnection::CheckTimeout() {
   // If the socket is closed, it means the connection has been shut down.
   if (!socket_.is_open())
     return;
 
-  if (timer_.expires_at() <= asio::deadline_timer::traits_type::now()) {
+  if (deadline_ <= TimingWheel::Now()) {
+    // An idle connection which hasn't been reused in time is closed quietly,
+    // as there is no conversation in progress to report an error for.
+    if (idle_)
+      return DoClose();
+
     // Time has run out. Close the socket to cancel outstanding operations.
     bs::error_code ignored_ec;
     socket_.close(ignored_ec);
   } else {
     // Timeout not yet reached. Go back to sleep.
-    timer_.async_wait(strand_.wrap(std::bind(&TcpConnection::CheckTimeout,
-                                             shared_from_this(), args::_1)));
+    ScheduleTimeout();
+  }
+}
+
+void TcpConnection::HandleTimeout() {
+  timeout_expiry_ = bptime::pos_infin;
+  CheckTimeout();
+}
+
+void TcpConnection::SetDeadline(const bptime::ptime &deadline) {
+  deadline_ = deadline;
+  ScheduleTimeout();
+}
+
+void TcpConnection::ScheduleTimeout() {
+  // The wheel is only told about a deadline earlier than the one it already
+  // holds for us. A later deadline is picked up by CheckTimeout() when the
+  // earlier one fires, so moving the deadline on at every read and write step
+  // costs nothing.
+  if (deadline_ >= timeout_expiry_)
+    return;
+  timeout_expiry_ = deadline_;
+  timing_wheel_->Schedule(&timer_, deadline_, strand_.wrap(std::bind(
+      &TcpConnection::HandleTimeout, shared_from_this())));
+}
+
+void TcpConnection::StartIdle() {
+  std::shared_ptr<TcpTransport> transport = transport_.lock();
+  if (!transport || TcpParameters::max_idle_connections == 0 ||
+      !socket_.is_open())
+    return DoClose();
+
+  idle_ = true;
+  if (remote_endpoint_ != ip::tcp::endpoint()) {
+    // We initiated this connection, so hand it back to the transport to be
+    // reused by a later Send() to the same endpoint.
+    SetDeadline(TimingWheel::Now() + TcpParameters::idle_timeout);
+    transport->ReleaseConnection(shared_from_this());
+  } else {
+    // We accepted this connection, so wait for the peer to send another
+    // request over it. We wait a little longer than the peer keeps the
+    // connection in its idle pool, so that it is the peer which normally
+    // closes the connection rather than us closing it under a new request.
+    asio::async_read(socket_, asio::buffer(size_buffer_),
+                     strand_.wrap(std::bind(&TcpConnection::HandleReadSize,
+                                            shared_from_this(), args::_1)));
+    SetDeadline(TimingWheel::Now() + TcpParameters::idle_timeout +
+                kStallTimeout);
   }
+
+  CheckTimeout();
+}
+
+bool TcpConnection::IsStale() {
+  // There is no read outstanding on an idle outgoing connection, so if the
+  // peer has closed its end in the meantime the socket will be readable.
+  bs::error_code ec;
+  ip::tcp::socket::non_blocking_io nbio(true);
+  socket_.io_control(nbio, ec);
+  if (ec)
+    return true;
+
+  unsigned char byte;
+  socket_.receive(asio::buffer(&byte, 1), ip::tcp::socket::message_peek, ec);
+
+  bs::error_code ignored_ec;
+  ip::tcp::socket::non_blocking_io blocking(false);
+  socket_.io_control(blocking, ignored_ec);
+  return ec != asio::error::would_block;
 }
 
 void TcpConnection::StartReadSize() {
@@ -135,14 +263,31 @@ void TcpConnection::StartReadSize() {
                    strand_.wrap(std::bind(&TcpConnection::HandleReadSize,
                                           shared_from_this(), args::_1)));
 
-  boost::posix_time::ptime now = asio::deadline_timer::traits_type::now();
+  // A framed connection is always waiting for the next frame, so only its
+  // idle timeout applies here.
+  if (framed_)
+    return SetFramedTimeout();
+
+  bptime::ptime now = TimingWheel::Now();
   response_deadline_ = now + timeout_for_response_;
-  timer_.expires_at(std::min(response_deadline_, now + kStallTimeout));
+  SetDeadline(std::min(response_deadline_, now + kStallTimeout));
 }
 
 void TcpConnection::HandleReadSize(const bs::error_code &ec) {
-  bs::error_code ignored_ec;
-  CheckTimeout(ignored_ec);
+  CheckTimeout();
+
+  if (idle_) {
+    // The peer closing the connection or the idle timeout expiring are both
+    // normal ways for an idle connection to end.
+    if (!socket_.is_open() || ec)
+      return DoClose();
+
+    // A new request has arrived, so apply the usual initial timeout to it.
+    idle_ = false;
+    timeout_for_response_ = kDefaultInitialTimeout;
+    response_deadline_ = TimingWheel::Now() +
+                         timeout_for_response_;
+  }
 
   // If the socket is closed, it means the timeout has been triggered.
   if (!socket_.is_open()) {
@@ -153,38 +298,99 @@ void TcpConnection::HandleReadSize(const bs::error_code &ec) {
     return CloseOnError(kReceiveFailure);
   }
 
+  // The peer's choice of framing determines ours for the connection.
+  bool framed_message((size_buffer_.at(0) & kFramedFlag) != 0);
+  if (framed_message) {
+    framed_ = true;
+    reading_frame_ = true;
+    response_deadline_ = bptime::pos_infin;
+    size_buffer_.at(0) &= ~kFramedFlag;
+  }
+
   DataSize size = (((((size_buffer_.at(0) << 8) | size_buffer_.at(1)) << 8) |
                     size_buffer_.at(2)) << 8) | size_buffer_.at(3);
 
+  // The message buffer is allocated from the size, so the size is checked
+  // before trusting it.
+  if (size < 0 || size > TcpTransport::kMaxTransportMessageSize()) {
+    DLOG(ERROR) << "Incoming data size " << size << " bytes (exceeds limit of "
+                << TcpTransport::kMaxTransportMessageSize() << ")";
+    return CloseOnError(kReceiveSizeFailure);
+  }
+
   data_size_ = size;
+  if (framed_message)
+    data_size_ += kFrameIdsSize;
   data_received_ = 0;
 
+  // Framed messages are always received whole, as their responses are matched
+  // to requests once the message has been read.
+  if (!framed_message) {
+    if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
+      Info info;
+      stream_ = transport->SignalStreamStarted(size, info);
+    }
+  }
+
+  // A message received whole is read straight into a buffer of its final
+  // size, rather than one grown as each part arrives, unless it is large.
+  if (!stream_)
+    ResizeDataBuffer(std::min(data_size_, kMaxInitialDataBufferSize));
+
   StartReadData();
 }
 
 void TcpConnection::StartReadData() {
   assert(socket_.is_open());
 
-  size_t buffer_size = data_received_;
-  buffer_size += std::min(static_cast<size_t>(kMaxTransportChunkSize),
-                          data_size_ - data_received_);
-  data_buffer_.resize(buffer_size);
-
-  asio::mutable_buffer data_buffer = asio::buffer(data_buffer_) +
-                                     data_received_;
+  // A streamed message is read a chunk at a time into storage of its own,
+  // which is handed over to the stream once filled. Otherwise the next part
+  // of the message is read into its place in the message buffer.
+  asio::mutable_buffer data_buffer;
+  if (stream_) {
+    ResizeDataBuffer(std::min(static_cast<size_t>(kMaxTransportChunkSize),
+                              data_size_ - data_received_));
+    data_buffer = asio::buffer(data_buffer_);
+  } else {
+    if (data_received_ == data_buffer_.size())
+      ResizeDataBuffer(std::min(data_size_, 2 * data_buffer_.size()));
+    data_buffer = asio::buffer(asio::buffer(data_buffer_) + data_received_,
+                               read_size_);
+  }
   asio::async_read(socket_, asio::buffer(data_buffer),
                    strand_.wrap(std::bind(&TcpConnection::HandleReadData,
                                           shared_from_this(),
                                           args::_1, args::_2)));
 
-  boost::posix_time::ptime now = asio::deadline_timer::traits_type::now();
-  timer_.expires_at(std::min(response_deadline_, now + kStallTimeout));
+  bptime::ptime now = TimingWheel::Now();
+  read_started_ = now;
+  SetDeadline(std::min(response_deadline_, now + kStallTimeout));
 //  timer_.expires_from_now(kDefaultInitialTimeout);
 }
 
+void TcpConnection::AdaptReadSize() {
+  // Each read must complete within the stall timeout. Reads which take a
+  // small fraction of it are doubled, so that a large message on a fast
+  // connection costs few handlers, while those which take a good part of it
+  // are halved again.
+  bptime::time_duration elapsed(TimingWheel::Now() - read_started_);
+  if (elapsed < kStallTimeout / 8)
+    read_size_ = std::min(read_size_ * 2, kMaxReadSize);
+  else if (elapsed > kStallTimeout / 2)
+    read_size_ = std::max(read_size_ / 2,
+                          static_cast<size_t>(kMaxTransportChunkSize));
+}
+
+void TcpConnection::ResizeDataBuffer(size_t size) {
+  if (size > data_buffer_.capacity()) {
+    if (std::shared_ptr<TcpTransport> transport = transport_.lock())
+      ++transport->receive_buffer_allocations_;
+  }
+  data_buffer_.resize(size);
+}
+
 void TcpConnection::HandleReadData(const bs::error_code &ec, size_t length) {
-  bs::error_code ignored_ec;
-  CheckTimeout(ignored_ec);
+  CheckTimeout();
 
   // If the socket is closed, it means the timeout has been triggered.
   if (!socket_.is_open()) {
@@ -197,52 +403,119 @@ void TcpConnection::HandleReadData(const bs::error_code &ec, size_t length) {
 
   data_received_ += length;
 
+  if (stream_) {
+    std::shared_ptr<std::vector<unsigned char>> storage(
+        std::make_shared<std::vector<unsigned char>>());
+    storage->swap(data_buffer_);
+    SharedBuffer chunk(storage, 0, storage->size());
+    MessageStreamPtr stream(stream_);
+    if (data_received_ == data_size_) {
+      // The last chunk and the completion are delivered after the others,
+      // and the response is then sent as for a message received whole.
+      stream_.reset();
+      SetDeadline(bptime::pos_infin);
+      stream_strand_.post(std::bind(&TcpConnection::DispatchStream,
+                                    shared_from_this(), stream, chunk));
+    } else {
+      // The chunk is delivered while the next is read, so that the stream's
+      // processing overlaps with receiving.
+      stream_strand_.post(std::bind(&MessageStream::OnData, stream, chunk));
+      StartReadData();
+    }
+    return;
+  }
+
   if (data_received_ == data_size_) {
+    if (reading_frame_)
+      return HandleFrame();
+
     // No timeout applies while dispatching the message.
-    timer_.expires_at(boost::posix_time::pos_infin);
+    SetDeadline(bptime::pos_infin);
+
+    // Hand the received storage over to the message, so that it can be
+    // signalled without being copied.
+    std::shared_ptr<std::vector<unsigned char>> storage(
+        std::make_shared<std::vector<unsigned char>>());
+    storage->swap(data_buffer_);
 
     // Dispatch the message outside the strand.
     strand_.get_io_service().post(std::bind(&TcpConnection::DispatchMessage,
-                                            shared_from_this()));
+                                            shared_from_this(),
+                                            SharedBuffer(storage, 0,
+                                                         storage->size())));
   } else {
     // Need more data to complete the message.
+    AdaptReadSize();
     StartReadData();
   }
 }
 
-void TcpConnection::DispatchMessage() {
+void TcpConnection::DispatchMessage(const SharedBuffer &data) {
   if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
     // Signal message received and send response if applicable
     std::string response;
     Timeout response_timeout(kImmediateTimeout);
     Info info;
     // TODO(Fraser#5#): 2011-01-18 - Add info details.
-    (*transport->on_message_received_)(std::string(data_buffer_.begin(),
-                                                   data_buffer_.end()),
-                                       info,
-                                       &response,
-                                       &response_timeout);
-    DataSize msg_size(static_cast<DataSize>(response.size()));
-    if (response.empty() || msg_size > transport->kMaxTransportMessageSize()) {
-      DLOG(INFO) << "Data size " << msg_size << " bytes ("
-                 << transport->kMaxTransportMessageSize() << ")";
-      Close();
-      return;
-    }
+    transport->SignalMessageReceived(data, info, &response, &response_timeout);
+    SendResponse(&response, response_timeout);
+  }
+}
 
-    EncodeData(response);
-    timeout_for_response_ = response_timeout;
-    strand_.dispatch(std::bind(&TcpConnection::StartWrite,
+void TcpConnection::DispatchStream(const MessageStreamPtr &stream,
+                                   const SharedBuffer &data) {
+  if (!data.empty())
+    stream->OnData(data);
+  std::string response;
+  Timeout response_timeout(kImmediateTimeout);
+  Info info;
+  stream->OnComplete(info, &response, &response_timeout);
+  SendResponse(&response, response_timeout);
+}
+
+void TcpConnection::SendResponse(std::string *response,
+                                 const Timeout &response_timeout) {
+  // Without a response the conversation is over. The connection waits for the
+  // peer's next request, or is closed if connections aren't reused.
+  if (response->empty()) {
+    strand_.dispatch(std::bind(&TcpConnection::StartIdle,
                                shared_from_this()));
+    return;
+  }
+
+  DataSize msg_size(static_cast<DataSize>(response->size()));
+  if (msg_size > TcpTransport::kMaxTransportMessageSize()) {
+    DLOG(INFO) << "Data size " << msg_size << " bytes ("
+               << TcpTransport::kMaxTransportMessageSize() << ")";
+    Close();
+    return;
   }
+
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>());
+  owner->swap(*response);
+  EncodeData(ConstBuffers(1, asio::buffer(*owner)), owner);
+  timeout_for_response_ = response_timeout;
+  strand_.dispatch(std::bind(&TcpConnection::StartWrite,
+                             shared_from_this()));
+}
+
+void TcpConnection::FailStream(const TransportCondition &error) {
+  if (!stream_)
+    return;
+  MessageStreamPtr stream(stream_);
+  stream_.reset();
+  stream_strand_.post(std::bind(&MessageStream::OnFailure, stream, error));
 }
 
-void TcpConnection::EncodeData(const std::string &data) {
-  // Serialize message to internal buffer
-  DataSize msg_size = static_cast<DataSize>(data.size());
+void TcpConnection::EncodeData(const ConstBuffers &data,
+                               const std::shared_ptr<const void> &owner) {
+  // Serialize the message size to the internal buffer. The data itself is
+  // written straight from the caller's buffers.
+  DataSize msg_size = static_cast<DataSize>(asio::buffer_size(data));
   for (int i = 0; i != 4; ++i)
     size_buffer_.at(i) = static_cast<char>(msg_size >> (8 * (3 - i)));
-  data_buffer_.assign(data.begin(), data.end());
+  write_buffers_ = data;
+  write_owner_ = owner;
 }
 
 void TcpConnection::StartConnect() {
@@ -252,7 +525,7 @@ void TcpConnection::StartConnect() {
                         strand_.wrap(std::bind(&TcpConnection::HandleConnect,
                                                shared_from_this(), args::_1)));
 
-  timer_.expires_from_now(kDefaultInitialTimeout);
+  SetDeadline(TimingWheel::Now() + kDefaultInitialTimeout);
 }
 
 void TcpConnection::HandleConnect(const bs::error_code &ec) {
@@ -265,6 +538,17 @@ void TcpConnection::HandleConnect(const bs::error_code &ec) {
     return CloseOnError(kSendFailure);
   }
 
+  bs::error_code ignored_ec;
+  socket_.set_option(ip::tcp::no_delay(true), ignored_ec);
+
+  if (framed_) {
+    write_pending_ = false;
+    StartReadSize();
+    if (!send_queue_.empty())
+      StartWriteFrame();
+    return;
+  }
+
   StartWrite();
 }
 
@@ -273,22 +557,27 @@ void TcpConnection::StartWrite() {
 
 //  timeout_for_response_ = kImmediateTimeout;
   Timeout tm_out(bptime::milliseconds(std::max(
-      static_cast<int64_t>(data_buffer_.size() * kTimeoutFactor),
+      static_cast<int64_t>(asio::buffer_size(write_buffers_) * kTimeoutFactor),
       kMinTimeout.total_milliseconds())));
 
-  std::array<boost::asio::const_buffer, 2> asio_buffer;
-  asio_buffer[0] = boost::asio::buffer(size_buffer_);
-  asio_buffer[1] = boost::asio::buffer(data_buffer_);
+  ConstBuffers asio_buffer;
+  asio_buffer.reserve(1 + write_buffers_.size());
+  asio_buffer.push_back(boost::asio::buffer(size_buffer_));
+  asio_buffer.insert(asio_buffer.end(), write_buffers_.begin(),
+                     write_buffers_.end());
   asio::async_write(socket_, asio_buffer,
                     strand_.wrap(std::bind(&TcpConnection::HandleWrite,
                                            shared_from_this(), args::_1)));
 
-  timer_.expires_from_now(tm_out);
-  bs::error_code error_code;
-  CheckTimeout(error_code);
+  SetDeadline(TimingWheel::Now() + tm_out);
+  CheckTimeout();
 }
 
 void TcpConnection::HandleWrite(const bs::error_code &ec) {
+  // The caller's data is no longer needed.
+  write_buffers_.clear();
+  write_owner_.reset();
+
   // If the socket is closed, it means the timeout has been triggered.
   if (!socket_.is_open()) {
     return CloseOnError(kSendTimeout);
@@ -302,11 +591,21 @@ void TcpConnection::HandleWrite(const bs::error_code &ec) {
   if (timeout_for_response_ != kImmediateTimeout) {
     StartReadSize();
   } else {
-    DoClose();
+    StartIdle();
   }
 }
 
 void TcpConnection::CloseOnError(const TransportCondition &error) {
+  if (framed_) {
+    // Close the socket first so that no write is still using a queued frame.
+    bs::error_code ignored_ec;
+    socket_.close(ignored_ec);
+    FailFrames(error);
+    return DoClose();
+  }
+
+  FailStream(error);
+
   if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
     Endpoint ep;
     (*transport->on_error_)(error, ep);
@@ -314,6 +613,256 @@ void TcpConnection::CloseOnError(const TransportCondition &error) {
   DoClose();
 }
 
+void TcpConnection::DoSendFrame(const ConstBuffers &data,
+                                const std::shared_ptr<const void> &owner,
+                                const Timeout &timeout,
+                                uint64_t reply_to_id) {
+  // A framed connection connects when its first frame is queued, so a closed
+  // socket after that means the connection is shutting down, and the
+  // transport handed it out just before it was removed.
+  if (!socket_.is_open() && next_request_id_ != 1) {
+    if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
+      Endpoint ep;
+      (*transport->on_error_)(kSendFailure, ep);
+    }
+    return;
+  }
+
+  uint64_t request_id(next_request_id_++);
+  DataSize msg_size = static_cast<DataSize>(asio::buffer_size(data));
+  send_queue_.push_back(Frame());
+  Frame &frame(send_queue_.back());
+  frame.header.resize(sizeof(DataSize) + kFrameIdsSize);
+  for (int i = 0; i != 4; ++i)
+    frame.header.at(i) = static_cast<char>(msg_size >> (8 * (3 - i)));
+  frame.header.at(0) |= kFramedFlag;
+  // As for UdpTransport, the ids are opaque to the peer which simply echoes
+  // them back, so they are sent in native byte order.
+  std::memcpy(&frame.header.at(sizeof(DataSize)), &request_id,
+              sizeof(request_id));
+  std::memcpy(&frame.header.at(sizeof(DataSize) + sizeof(request_id)),
+              &reply_to_id, sizeof(reply_to_id));
+  frame.data = data;
+  frame.owner = owner;
+
+  if (timeout != kImmediateTimeout) {
+    timing_wheel_->Schedule(&outstanding_requests_[request_id],
+                            TimingWheel::Now() + timeout,
+                            strand_.wrap(std::bind(
+                                &TcpConnection::HandleRequestTimeout,
+                                shared_from_this(), request_id)));
+    frame.awaiting_response = true;
+  }
+
+  if (!socket_.is_open()) {
+    // Frames queued while connecting are written once connected.
+    write_pending_ = true;
+    StartConnect();
+    CheckTimeout();
+  } else if (!write_pending_) {
+    // Rather than writing this frame straight away, let any other handlers
+    // already waiting in the strand queue their frames too, so that they can
+    // all go in one write.
+    write_pending_ = true;
+    strand_.post(std::bind(&TcpConnection::FlushFrames, shared_from_this()));
+  }
+}
+
+void TcpConnection::FlushFrames() {
+  // The connection may have failed while the flush was pending, in which case
+  // the queued frames have already been reported.
+  if (!socket_.is_open() || send_queue_.empty()) {
+    write_pending_ = false;
+    return;
+  }
+  StartWriteFrame();
+}
+
+void TcpConnection::StartWriteFrame() {
+  assert(socket_.is_open());
+  assert(!send_queue_.empty());
+
+  write_pending_ = true;
+
+  // Gather as many queued frames as the limits allow into a single write, so
+  // that a burst of small messages costs one writev rather than one each.
+  ConstBuffers asio_buffer;
+  size_t bytes_in_write(0);
+  frames_in_write_ = 0;
+  for (auto it = send_queue_.begin(); it != send_queue_.end(); ++it) {
+    size_t frame_size(it->header.size() + asio::buffer_size(it->data));
+    if (frames_in_write_ != 0 &&
+        (frames_in_write_ == TcpParameters::max_coalesced_frames ||
+         bytes_in_write + frame_size > TcpParameters::max_coalesced_bytes))
+      break;
+    asio_buffer.push_back(boost::asio::buffer(it->header));
+    asio_buffer.insert(asio_buffer.end(), it->data.begin(), it->data.end());
+    bytes_in_write += frame_size;
+    ++frames_in_write_;
+  }
+  ++frame_writes_;
+  frames_written_ += frames_in_write_;
+
+  Timeout tm_out(bptime::milliseconds(std::max(
+      static_cast<int64_t>(bytes_in_write * kTimeoutFactor),
+      kMinTimeout.total_milliseconds())));
+  asio::async_write(socket_, asio_buffer,
+                    strand_.wrap(std::bind(&TcpConnection::HandleWriteFrame,
+                                           shared_from_this(), args::_1)));
+
+  SetDeadline(TimingWheel::Now() + tm_out);
+  CheckTimeout();
+}
+
+void TcpConnection::HandleWriteFrame(const bs::error_code &ec) {
+  write_pending_ = false;
+
+  // If the socket is closed, it means the timeout has been triggered.
+  if (!socket_.is_open()) {
+    return CloseOnError(kSendTimeout);
+  }
+
+  if (ec) {
+    return CloseOnError(kSendFailure);
+  }
+
+  send_queue_.erase(send_queue_.begin(),
+                    send_queue_.begin() + frames_in_write_);
+  frames_in_write_ = 0;
+  if (!send_queue_.empty())
+    return StartWriteFrame();
+
+  SetFramedTimeout();
+}
+
+void TcpConnection::HandleFrame() {
+  reading_frame_ = false;
+
+  uint64_t request_id(0), reply_to_id(0);
+  std::memcpy(&request_id, &data_buffer_.at(0), sizeof(request_id));
+  std::memcpy(&reply_to_id, &data_buffer_.at(sizeof(request_id)),
+              sizeof(reply_to_id));
+
+  if (reply_to_id != 0) {
+    // As for UdpTransport, a response which doesn't match an outstanding
+    // request has most likely arrived after the request timed out.
+    auto it = outstanding_requests_.find(reply_to_id);
+    if (it == outstanding_requests_.end()) {
+      DLOG(INFO) << "Dropping frame replying to unknown request "
+                 << reply_to_id;
+      return StartReadSize();
+    }
+    timing_wheel_->Cancel(&it->second);
+    outstanding_requests_.erase(it);
+  }
+
+  std::shared_ptr<std::vector<unsigned char>> storage(
+      std::make_shared<std::vector<unsigned char>>());
+  storage->swap(data_buffer_);
+
+  // Dispatch the message outside the strand, and carry on reading frames
+  // meanwhile.
+  ++pending_dispatches_;
+  strand_.get_io_service().post(std::bind(
+      &TcpConnection::DispatchFrame, shared_from_this(),
+      SharedBuffer(storage, kFrameIdsSize, storage->size() - kFrameIdsSize),
+      request_id));
+  StartReadSize();
+}
+
+void TcpConnection::DispatchFrame(const SharedBuffer &data,
+                                  uint64_t request_id) {
+  std::string response;
+  Timeout response_timeout(kImmediateTimeout);
+  if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
+    Info info;
+    transport->SignalMessageReceived(data, info, &response,
+                                     &response_timeout);
+  }
+  strand_.dispatch(std::bind(&TcpConnection::HandleFrameDispatched,
+                             shared_from_this(), response, response_timeout,
+                             request_id));
+}
+
+void TcpConnection::HandleFrameDispatched(const std::string &response,
+                                          const Timeout &response_timeout,
+                                          uint64_t reply_to_id) {
+  --pending_dispatches_;
+
+  if (response.empty() || !socket_.is_open())
+    return SetFramedTimeout();
+
+  DataSize msg_size(static_cast<DataSize>(response.size()));
+  if (msg_size > TcpTransport::kMaxTransportMessageSize()) {
+    DLOG(INFO) << "Data size " << msg_size << " bytes ("
+               << TcpTransport::kMaxTransportMessageSize() << ")";
+    return SetFramedTimeout();
+  }
+
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>(response));
+  DoSendFrame(ConstBuffers(1, asio::buffer(*owner)), owner, response_timeout,
+              reply_to_id);
+}
+
+void TcpConnection::HandleRequestTimeout(uint64_t request_id) {
+  // The request may have been answered after its timer expired but before
+  // this handler ran.
+  auto it = outstanding_requests_.find(request_id);
+  if (it == outstanding_requests_.end())
+    return;
+
+  outstanding_requests_.erase(it);
+  if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
+    Endpoint ep;
+    (*transport->on_error_)(kReceiveTimeout, ep);
+  }
+  SetFramedTimeout();
+}
+
+void TcpConnection::SetFramedTimeout() {
+  // A write in progress applies its own timeout.
+  if (write_pending_ || !socket_.is_open())
+    return;
+
+  if (reading_frame_) {
+    SetDeadline(TimingWheel::Now() + kStallTimeout);
+  } else if (outstanding_requests_.empty() && pending_dispatches_ == 0) {
+    // As for idle unframed connections, the accepting side waits a little
+    // longer than the initiating side before closing.
+    if (remote_endpoint_ != ip::tcp::endpoint())
+      SetDeadline(TimingWheel::Now() + TcpParameters::idle_timeout);
+    else
+      SetDeadline(TimingWheel::Now() + TcpParameters::idle_timeout +
+                  kStallTimeout);
+  } else {
+    // Requests awaiting responses are timed out individually.
+    SetDeadline(bptime::pos_infin);
+  }
+
+  CheckTimeout();
+}
+
+void TcpConnection::FailFrames(const TransportCondition &error) {
+  // Each request awaiting a response, and each other message not yet sent,
+  // is reported as a separate failure.
+  size_t failures(outstanding_requests_.size());
+  for (auto it = outstanding_requests_.begin();
+       it != outstanding_requests_.end(); ++it)
+    timing_wheel_->Cancel(&it->second);
+  outstanding_requests_.clear();
+  for (auto it = send_queue_.begin(); it != send_queue_.end(); ++it) {
+    if (!it->awaiting_response)
+      ++failures;
+  }
+  send_queue_.clear();
+
+  if (std::shared_ptr<TcpTransport> transport = transport_.lock()) {
+    Endpoint ep;
+    for (size_t i = 0; i != failures; ++i)
+      (*transport->on_error_)(error, ep);
+  }
+}
+
 }  // namespace transport
 
 }  // namespace maidsafe
@@ -28,13 +28,16 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_TCP_CONNECTION_H_
 #define MAIDSAFE_TRANSPORT_TCP_CONNECTION_H_
 
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
-#include "boost/asio/deadline_timer.hpp"
 #include "boost/asio/io_service.hpp"
 #include "boost/asio/ip/tcp.hpp"
 #include "boost/asio/strand.hpp"
+#include "maidsafe/transport/timing_wheel.h"
 #include "maidsafe/transport/transport.h"
 
 namespace maidsafe {
@@ -43,6 +46,12 @@ namespace transport {
 
 class TcpTransport;
 
+namespace test {
+class TcpTransportTest_BEH_CoalesceFrames_Test;
+class TcpTransportTest_BEH_ReceiveBufferSizedFromHeader_Test;
+class TcpTransportTest_BEH_SlowStream_Test;
+}  // namespace test
+
 #ifdef __GNUC__
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Weffc++"
@@ -54,24 +63,51 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
  public:
   TcpConnection(const std::shared_ptr<TcpTransport> &tcp_transport,
-                const boost::asio::ip::tcp::endpoint &remote);
+                const boost::asio::ip::tcp::endpoint &remote,
+                bool framed = false);
   ~TcpConnection();
 
   boost::asio::ip::tcp::socket &Socket();
+  const boost::asio::ip::tcp::endpoint &RemoteEndpoint() const;
 
   void Close();
   void StartReceiving();
-  void StartSending(const std::string &data, const Timeout &timeout);
+  void StartSending(const ConstBuffers &data,
+                    const std::shared_ptr<const void> &owner,
+                    const Timeout &timeout);
+
+  friend class test::TcpTransportTest_BEH_CoalesceFrames_Test;
+  friend class test::TcpTransportTest_BEH_ReceiveBufferSizedFromHeader_Test;
+  friend class test::TcpTransportTest_BEH_SlowStream_Test;
 
  private:
   TcpConnection(const TcpConnection&);
   TcpConnection &operator=(const TcpConnection&);
 
+  // A message queued for sending in framed mode, together with its header.
+  struct Frame {
+    Frame() : header(), data(), owner(), awaiting_response(false) {}
+    std::vector<unsigned char> header;
+    ConstBuffers data;
+    std::shared_ptr<const void> owner;
+    bool awaiting_response;
+  };
+  // The timers of requests awaiting responses. Elements of an unordered_map
+  // aren't moved by a rehash, so the wheel can safely refer to them.
+  typedef std::unordered_map<uint64_t,
+                             TimingWheel::Timer> OutstandingRequestMap;
+
   void DoClose();
   void DoStartReceiving();
   void DoStartSending();
 
-  void CheckTimeout(const boost::system::error_code &ec);
+  void CheckTimeout();
+  void HandleTimeout();
+  void SetDeadline(const boost::posix_time::ptime &deadline);
+  void ScheduleTimeout();
+
+  void StartIdle();
+  bool IsStale();
 
   void StartConnect();
   void HandleConnect(const boost::system::error_code &ec);
@@ -81,23 +117,78 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
   void StartReadData();
   void HandleReadData(const boost::system::error_code &ec, size_t length);
+  void AdaptReadSize();
+  void ResizeDataBuffer(size_t size);
 
   void StartWrite();
   void HandleWrite(const boost::system::error_code &ec);
 
-  void DispatchMessage();
-  void EncodeData(const std::string &data);
+  void DispatchMessage(const SharedBuffer &data);
+  void DispatchStream(const MessageStreamPtr &stream, const SharedBuffer &data);
+  void SendResponse(std::string *response, const Timeout &response_timeout);
+  void FailStream(const TransportCondition &error);
+  void EncodeData(const ConstBuffers &data,
+                  const std::shared_ptr<const void> &owner);
   void CloseOnError(const TransportCondition &error);
 
+  void DoSendFrame(const ConstBuffers &data,
+                   const std::shared_ptr<const void> &owner,
+                   const Timeout &timeout,
+                   uint64_t reply_to_id);
+  void FlushFrames();
+  void StartWriteFrame();
+  void HandleWriteFrame(const boost::system::error_code &ec);
+  void HandleFrame();
+  void DispatchFrame(const SharedBuffer &data, uint64_t request_id);
+  void HandleFrameDispatched(const std::string &response,
+                             const Timeout &response_timeout,
+                             uint64_t reply_to_id);
+  void HandleRequestTimeout(uint64_t request_id);
+  void SetFramedTimeout();
+  void FailFrames(const TransportCondition &error);
+
   std::weak_ptr<TcpTransport> transport_;
   boost::asio::io_service::strand strand_;
   boost::asio::ip::tcp::socket socket_;
-  boost::asio::deadline_timer timer_;
+  // Stall and response timeouts are tracked by the transport's timing wheel
+  // rather than a deadline_timer per connection. timeout_expiry_ is the
+  // expiry last given to the wheel, or infinity once it has fired.
+  std::shared_ptr<TimingWheel> timing_wheel_;
+  TimingWheel::Timer timer_;
+  boost::posix_time::ptime deadline_, timeout_expiry_;
   boost::posix_time::ptime response_deadline_;
   boost::asio::ip::tcp::endpoint remote_endpoint_;
   std::vector<unsigned char> size_buffer_, data_buffer_;
+  // The message being written, which is gathered from the caller's buffers.
+  ConstBuffers write_buffers_;
+  std::shared_ptr<const void> write_owner_;
   size_t data_size_, data_received_;
+  // The most read into data_buffer_ at once, adapted to the connection's
+  // throughput, and the time the current read started.
+  size_t read_size_;
+  boost::posix_time::ptime read_started_;
+  // The stream an unframed message is being delivered to as it arrives, if
+  // one was set by an on_stream_started slot.
+  MessageStreamPtr stream_;
+  // Calls to the stream are made in order through their own strand, rather
+  // than the connection's, so that a slow stream doesn't hold up reading or
+  // the connection's timeouts.
+  boost::asio::io_service::strand stream_strand_;
   Timeout timeout_for_response_;
+  bool idle_;
+
+  // In framed mode each message carries a request id and the id of the
+  // request it replies to, so any number of requests and their responses can
+  // be in flight over the connection at once, in either direction.
+  bool framed_, write_pending_, reading_frame_;
+  uint64_t next_request_id_;
+  std::deque<Frame> send_queue_;
+  // The number of frames at the front of send_queue_ in the current write.
+  size_t frames_in_write_;
+  // The numbers of framed writes started and of frames they have carried.
+  size_t frame_writes_, frames_written_;
+  OutstandingRequestMap outstanding_requests_;
+  size_t pending_dispatches_;
 };
 
 }  // namespace transport
@@ -0,0 +1,88 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_TCP_PARAMETERS_H_
+#define MAIDSAFE_TRANSPORT_TCP_PARAMETERS_H_
+
+#include <cstddef>
+
+#include "boost/date_time/posix_time/posix_time_duration.hpp"
+#include "maidsafe/transport/version.h"
+
+#if MAIDSAFE_TRANSPORT_VERSION != 200
+#  error This API is not compatible with the installed library.\
+    Please update the maidsafe-transport library.
+#endif
+
+namespace maidsafe {
+
+namespace transport {
+
+// This class provides the configurability to all TCP connection parameters.
+struct TcpParameters {
+ public:
+  // Maximum number of idle outgoing connections kept open per remote endpoint
+  // so that later sends to the same peer can skip the connect. An accepted
+  // connection likewise stays open after a request which the handlers don't
+  // answer, so a requester waiting for a response to it fails with
+  // kReceiveTimeout once its own timeout expires, rather than straight away
+  // with kReceiveFailure. Setting this to 0 disables connection reuse, in
+  // which case every conversation is closed once it completes.
+  static size_t max_idle_connections;
+
+  // Period for which an idle connection is kept open waiting to be reused.
+  static boost::posix_time::time_duration idle_timeout;
+
+  // If true, all messages sent to a remote endpoint share a single connection
+  // in framed mode, where each message carries a request id so that requests
+  // can be pipelined and their responses returned in any order. A listener
+  // accepts framed connections regardless of this setting.
+  static bool multiplexing;
+
+  // Number of acceptors opened on the listening port. If greater than 1, each
+  // acceptor is bound to the same port with SO_REUSEPORT and accepts on its
+  // own strand, so that the kernel spreads incoming connections across them.
+  // This is ignored on platforms without SO_REUSEPORT.
+  static size_t acceptor_count;
+
+  // Upper bounds on the number of queued frames, and on their total size in
+  // bytes, which are gathered into a single write on a framed connection. A
+  // single frame larger than max_coalesced_bytes is still written on its own.
+  static size_t max_coalesced_frames;
+  static size_t max_coalesced_bytes;
+
+ private:
+  // Disallow copying and assignment.
+  TcpParameters(const TcpParameters&);
+  TcpParameters &operator=(const TcpParameters&);
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_TCP_PARAMETERS_H_
@@ -25,6 +25,7 @@ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
 THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
 #include <functional>
 
 #include "maidsafe/transport/tcp_transport.h"
@@ -33,23 +34,42 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "maidsafe/transport/message_handler.h"
 #include "maidsafe/transport/transport_pb.h"
+#include "maidsafe/transport/outbound_limiter.h"
 #include "maidsafe/transport/tcp_connection.h"
+#include "maidsafe/transport/tcp_parameters.h"
+#include "maidsafe/transport/timing_wheel.h"
 #include "maidsafe/transport/utils.h"
 
 namespace asio = boost::asio;
 namespace bs = boost::system;
 namespace ip = asio::ip;
+namespace bptime = boost::posix_time;
 namespace args = std::placeholders;
 
 namespace maidsafe {
 
 namespace transport {
 
+// Connection timeouts are checked at this resolution. Those due within a
+// revolution of the wheel, which covers the usual stall, response and idle
+// timeouts, cost a single visit of their slot when they come due.
+static const bptime::time_duration kTimerResolution(bptime::milliseconds(50));
+static const size_t kTimerSlotCount(1024);
+
 TcpTransport::TcpTransport(boost::asio::io_service &asio_service)  // NOLINT
     : Transport(asio_service),
-      acceptor_(),
+      acceptors_(),
+      accept_strands_(),
       connections_(),
-      strand_(asio_service) {}
+      idle_connections_(),
+      framed_connections_(),
+      strand_(asio_service),
+      timing_wheel_(std::make_shared<TimingWheel>(asio_service,
+                                                  kTimerResolution,
+                                                  kTimerSlotCount)),
+      outbound_limiter_(std::make_shared<OutboundLimiter>(asio_service,
+                                                          on_writable_)),
+      receive_buffer_allocations_(0) {}
 
 TcpTransport::~TcpTransport() {
   for (auto it = connections_.begin(); it != connections_.end();)
@@ -63,43 +83,68 @@ TransportCondition TcpTransport::StartListening(const Endpoint &endpoint) {
   if (endpoint.port == 0)
     return kInvalidPort;
 
+  size_t acceptor_count(1);
+#ifdef SO_REUSEPORT
+  acceptor_count = std::max(TcpParameters::acceptor_count, size_t(1));
+#endif
+
   ip::tcp::endpoint ep(endpoint.ip, endpoint.port);
-  acceptor_.reset(new ip::tcp::acceptor(asio_service_));
+  for (size_t i = 0; i != acceptor_count; ++i) {
+    TransportCondition condition(OpenAcceptor(ep, acceptor_count > 1));
+    if (condition != kSuccess) {
+      for (auto it = acceptors_.begin(); it != acceptors_.end(); ++it)
+        CloseAcceptor(*it);
+      acceptors_.clear();
+      accept_strands_.clear();
+      return condition;
+    }
+  }
+
+  listening_port_ = acceptors_.front()->local_endpoint().port();
+  transport_details_.endpoint.port = listening_port_;
+  transport_details_.endpoint.ip = endpoint.ip;
+
+  for (size_t i = 0; i != acceptors_.size(); ++i)
+    StartAccept(acceptors_.at(i), accept_strands_.at(i));
+  return kSuccess;
+}
+
+TransportCondition TcpTransport::OpenAcceptor(const ip::tcp::endpoint &ep,
+                                              bool reuse_port) {
+  AcceptorPtr acceptor(new ip::tcp::acceptor(asio_service_));
 
   bs::error_code ec;
-  acceptor_->open(ep.protocol(), ec);
+  acceptor->open(ep.protocol(), ec);
 
   if (ec)
     return kInvalidAddress;
 
-//  acceptor_->set_option(ip::tcp::acceptor::reuse_address(true), ec);
+//  acceptor->set_option(ip::tcp::acceptor::reuse_address(true), ec);
+
+#ifdef SO_REUSEPORT
+  if (reuse_port) {
+    typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+        ReusePort;
+    acceptor->set_option(ReusePort(true), ec);
+  }
+#endif
 
   if (ec)
     return kSetOptionFailure;
 
-  acceptor_->bind(ep, ec);
+  acceptor->bind(ep, ec);
 
   if (ec)
     return kBindError;
 
-  acceptor_->listen(asio::socket_base::max_connections, ec);
+  acceptor->listen(asio::socket_base::max_connections, ec);
 
   if (ec)
     return kListenError;
 
-  ConnectionPtr new_connection(
-      std::make_shared<TcpConnection>(shared_from_this(),
-                                      boost::asio::ip::tcp::endpoint()));
-  listening_port_ = acceptor_->local_endpoint().port();
-  transport_details_.endpoint.port = listening_port_;
-  transport_details_.endpoint.ip = endpoint.ip;
-
-  // The connection object is kept alive in the acceptor handler until
-  // HandleAccept() is called.
-  acceptor_->async_accept(new_connection->Socket(),
-                          strand_.wrap(std::bind(&TcpTransport::HandleAccept,
-                                                 shared_from_this(), acceptor_,
-                                                 new_connection, args::_1)));
+  acceptors_.push_back(acceptor);
+  accept_strands_.push_back(
+      std::make_shared<asio::io_service::strand>(asio_service_));
   return kSuccess;
 }
 
@@ -109,10 +154,12 @@ TransportCondition TcpTransport::Bootstrap(
 }
 
 void TcpTransport::StopListening() {
-  if (acceptor_)
-    strand_.dispatch(std::bind(&TcpTransport::CloseAcceptor, acceptor_));
+  for (size_t i = 0; i != acceptors_.size(); ++i)
+    accept_strands_.at(i)->dispatch(std::bind(&TcpTransport::CloseAcceptor,
+                                              acceptors_.at(i)));
   listening_port_ = 0;
-  acceptor_.reset();
+  acceptors_.clear();
+  accept_strands_.clear();
 }
 
 void TcpTransport::CloseAcceptor(AcceptorPtr acceptor) {
@@ -120,35 +167,49 @@ void TcpTransport::CloseAcceptor(AcceptorPtr acceptor) {
   acceptor->close(ec);
 }
 
+void TcpTransport::StartAccept(AcceptorPtr acceptor, StrandPtr strand) {
+  ConnectionPtr new_connection(
+      std::make_shared<TcpConnection>(shared_from_this(),
+                                      boost::asio::ip::tcp::endpoint()));
+
+  // The connection object is kept alive in the acceptor handler until
+  // HandleAccept() is called.
+  acceptor->async_accept(new_connection->Socket(),
+                         strand->wrap(std::bind(&TcpTransport::HandleAccept,
+                                                shared_from_this(), acceptor,
+                                                strand, new_connection,
+                                                args::_1)));
+}
+
 void TcpTransport::HandleAccept(AcceptorPtr acceptor,
+                                StrandPtr strand,
                                 ConnectionPtr connection,
                                 const bs::error_code &ec) {
   if (!acceptor->is_open())
     return;
 
   if (!ec) {
-    // It is safe to call DoInsertConnection directly because HandleAccept() is
-    // already being called inside the strand.
-    DoInsertConnection(connection);
+    // HandleAccept() runs in the acceptor's strand rather than the transport's
+    // one, so the connection is inserted via the transport's strand.
+    InsertConnection(connection);
     connection->StartReceiving();
   }
 
-  ConnectionPtr new_connection(
-      std::make_shared<TcpConnection>(shared_from_this(),
-                                      boost::asio::ip::tcp::endpoint()));
-
-  // The connection object is kept alive in the acceptor handler until
-  // HandleAccept() is called.
-  acceptor->async_accept(new_connection->Socket(),
-                         strand_.wrap(std::bind(&TcpTransport::HandleAccept,
-                                                shared_from_this(), acceptor,
-                                                new_connection, args::_1)));
+  StartAccept(acceptor, strand);
 }
 
 void TcpTransport::Send(const std::string &data,
                         const Endpoint &endpoint,
                         const Timeout &timeout) {
-  DataSize msg_size(static_cast<DataSize>(data.size()));
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>(data));
+  Send(ConstBuffers(1, asio::buffer(*owner)), owner, endpoint, timeout);
+}
+
+void TcpTransport::Send(const ConstBuffers &data,
+                        const std::shared_ptr<const void> &owner,
+                        const Endpoint &endpoint,
+                        const Timeout &timeout) {
+  DataSize msg_size(static_cast<DataSize>(asio::buffer_size(data)));
   if (msg_size > kMaxTransportMessageSize()) {
     DLOG(ERROR) << "Data size " << msg_size << " bytes (exceeds limit of "
                 << kMaxTransportMessageSize() << ")";
@@ -157,11 +218,58 @@ void TcpTransport::Send(const std::string &data,
     return;
   }
 
+  // The message is counted against the outbound limits for as long as its
+  // connection holds on to the owner.
+  std::shared_ptr<const void> ticket(owner);
+  if (!outbound_limiter_->Acquire(endpoint, msg_size, &ticket)) {
+    (*on_error_)(kSendStalled, endpoint);
+    return;
+  }
+
+  strand_.dispatch(std::bind(&TcpTransport::DoSend, shared_from_this(),
+                             data, ticket, endpoint, timeout));
+}
+
+void TcpTransport::SetOutboundLimits(const OutboundLimits &limits) {
+  outbound_limiter_->set_limits(limits);
+}
+
+size_t TcpTransport::receive_buffer_allocations() const {
+  return receive_buffer_allocations_;
+}
+
+void TcpTransport::DoSend(const ConstBuffers &data,
+                          const std::shared_ptr<const void> &owner,
+                          const Endpoint &endpoint,
+                          const Timeout &timeout) {
   ip::tcp::endpoint tcp_endpoint(endpoint.ip, endpoint.port);
+
+  if (TcpParameters::multiplexing) {
+    ConnectionPtr &connection(framed_connections_[tcp_endpoint]);
+    if (!connection) {
+      connection = std::make_shared<TcpConnection>(shared_from_this(),
+                                                   tcp_endpoint, true);
+      DoInsertConnection(connection);
+    }
+    connection->StartSending(data, owner, timeout);
+    return;
+  }
+
+  // Prefer the most recently released idle connection to this endpoint, as
+  // it is the one least likely to have been closed by the peer.
+  auto idle = idle_connections_.equal_range(tcp_endpoint);
+  if (idle.first != idle.second) {
+    IdleConnectionMap::iterator it = idle.second;
+    ConnectionPtr connection((--it)->second);
+    idle_connections_.erase(it);
+    connection->StartSending(data, owner, timeout);
+    return;
+  }
+
   ConnectionPtr connection(std::make_shared<TcpConnection>(shared_from_this(),
                                                            tcp_endpoint));
-  InsertConnection(connection);
-  connection->StartSending(data, timeout);
+  DoInsertConnection(connection);
+  connection->StartSending(data, owner, timeout);
 }
 
 void TcpTransport::InsertConnection(ConnectionPtr connection) {
@@ -180,6 +288,36 @@ void TcpTransport::RemoveConnection(ConnectionPtr connection) {
 
 void TcpTransport::DoRemoveConnection(ConnectionPtr connection) {
   connections_.erase(connection);
+  auto framed = framed_connections_.find(connection->RemoteEndpoint());
+  if (framed != framed_connections_.end() && framed->second == connection)
+    framed_connections_.erase(framed);
+  auto idle = idle_connections_.equal_range(connection->RemoteEndpoint());
+  for (auto it = idle.first; it != idle.second; ++it) {
+    if (it->second == connection) {
+      idle_connections_.erase(it);
+      break;
+    }
+  }
+}
+
+void TcpTransport::ReleaseConnection(ConnectionPtr connection) {
+  strand_.dispatch(std::bind(&TcpTransport::DoReleaseConnection,
+                             shared_from_this(), connection));
+}
+
+void TcpTransport::DoReleaseConnection(ConnectionPtr connection) {
+  // The connection may have been closed while the release was pending.
+  if (connections_.count(connection) == 0)
+    return;
+
+  if (idle_connections_.count(connection->RemoteEndpoint()) >=
+      TcpParameters::max_idle_connections) {
+    connection->Close();
+    return;
+  }
+
+  idle_connections_.insert(std::make_pair(connection->RemoteEndpoint(),
+                                          connection));
 }
 
 }  // namespace transport
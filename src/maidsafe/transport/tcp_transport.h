@@ -28,6 +28,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_TCP_TRANSPORT_H_
 #define MAIDSAFE_TRANSPORT_TCP_TRANSPORT_H_
 
+#include <atomic>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -50,6 +52,19 @@ namespace transport {
 
 class TcpConnection;
 class MessageHandler;
+class OutboundLimiter;
+class TimingWheel;
+
+namespace test {
+class TcpTransportTest_BEH_ReuseIdleConnection_Test;
+class TcpTransportTest_BEH_MultiplexRequests_Test;
+class TcpTransportTest_BEH_MultipleAcceptors_Test;
+class TcpTransportTest_BEH_CoalesceFrames_Test;
+class TcpTransportTest_BEH_OutboundLimits_Test;
+class TcpTransportTest_BEH_ReceiveBufferSizedFromHeader_Test;
+class TcpTransportTest_BEH_SlowStream_Test;
+class TcpTransportTest_BEH_EmptyResponse_Test;
+}  // namespace test
 
 #ifdef __GNUC__
 #pragma GCC diagnostic push
@@ -69,31 +84,85 @@ class TcpTransport : public Transport,
   virtual void Send(const std::string &data,
                     const Endpoint &endpoint,
                     const Timeout &timeout);
+  virtual void Send(const ConstBuffers &data,
+                    const std::shared_ptr<const void> &owner,
+                    const Endpoint &endpoint,
+                    const Timeout &timeout);
+  virtual void SetOutboundLimits(const OutboundLimits &limits);
   static DataSize kMaxTransportMessageSize() { return 67108864; }
+  // The number of buffers its connections have allocated to receive messages
+  // into. A message received whole needs just one.
+  size_t receive_buffer_allocations() const;
+
+  friend class test::TcpTransportTest_BEH_ReuseIdleConnection_Test;
+  friend class test::TcpTransportTest_BEH_MultiplexRequests_Test;
+  friend class test::TcpTransportTest_BEH_MultipleAcceptors_Test;
+  friend class test::TcpTransportTest_BEH_CoalesceFrames_Test;
+  friend class test::TcpTransportTest_BEH_OutboundLimits_Test;
+  friend class test::TcpTransportTest_BEH_ReceiveBufferSizedFromHeader_Test;
+  friend class test::TcpTransportTest_BEH_SlowStream_Test;
+  friend class test::TcpTransportTest_BEH_EmptyResponse_Test;
 
  private:
   TcpTransport(const TcpTransport&);
   TcpTransport& operator=(const TcpTransport&);
   friend class TcpConnection;
   typedef std::shared_ptr<boost::asio::ip::tcp::acceptor> AcceptorPtr;
+  typedef std::shared_ptr<boost::asio::io_service::strand> StrandPtr;
   typedef std::shared_ptr<TcpConnection> ConnectionPtr;
   typedef std::set<ConnectionPtr> ConnectionSet;
+  typedef std::multimap<boost::asio::ip::tcp::endpoint,
+                        ConnectionPtr> IdleConnectionMap;
+  typedef std::map<boost::asio::ip::tcp::endpoint,
+                   ConnectionPtr> FramedConnectionMap;
   static void CloseAcceptor(AcceptorPtr acceptor);
-  void HandleAccept(AcceptorPtr acceptor, ConnectionPtr connection,
+  TransportCondition OpenAcceptor(const boost::asio::ip::tcp::endpoint &ep,
+                                  bool reuse_port);
+  void StartAccept(AcceptorPtr acceptor, StrandPtr strand);
+  void HandleAccept(AcceptorPtr acceptor, StrandPtr strand,
+                    ConnectionPtr connection,
                     const boost::system::error_code &ec);
 
+  void DoSend(const ConstBuffers &data,
+              const std::shared_ptr<const void> &owner,
+              const Endpoint &endpoint,
+              const Timeout &timeout);
+
   void InsertConnection(ConnectionPtr connection);
   void DoInsertConnection(ConnectionPtr connection);
   void RemoveConnection(ConnectionPtr connection);
   void DoRemoveConnection(ConnectionPtr connection);
+  void ReleaseConnection(ConnectionPtr connection);
+  void DoReleaseConnection(ConnectionPtr connection);
 
-  AcceptorPtr acceptor_;
+  // The listening acceptors, each of which accepts on the strand at the same
+  // index in accept_strands_.
+  std::vector<AcceptorPtr> acceptors_;
+  std::vector<StrandPtr> accept_strands_;
 
   // Because the connections can be in an idle initial state with no pending
   // async operations (after calling PrepareSend()), they are kept alive with
   // a shared_ptr in this map, as well as in the async operation handlers.
   ConnectionSet connections_;
+
+  // Outgoing connections which have completed their conversation and are
+  // waiting to be reused by a later Send() to the same endpoint. Each of these
+  // is also held in connections_. Within an endpoint's range the most recently
+  // released connection comes last.
+  IdleConnectionMap idle_connections_;
+
+  // The single outgoing connection per endpoint used when multiplexing. Each
+  // of these is also held in connections_.
+  FramedConnectionMap framed_connections_;
   boost::asio::io_service::strand strand_;
+
+  // Shared by all connections to track their timeouts.
+  std::shared_ptr<TimingWheel> timing_wheel_;
+
+  // Accounts for the messages accepted by Send() until they are written out.
+  std::shared_ptr<OutboundLimiter> outbound_limiter_;
+
+  std::atomic<size_t> receive_buffer_allocations_;
 };
 
 }  // namespace transport
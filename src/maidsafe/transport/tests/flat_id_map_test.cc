@@ -0,0 +1,110 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <map>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/flat_id_map.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+TEST(FlatIdMapTest, BEH_InsertFindErase) {
+  FlatIdMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(nullptr, map.Find(1));
+  EXPECT_FALSE(map.Erase(1));
+
+  // Sequential ids, as the transports generate, grow the map several times.
+  const uint64_t kFirstId(0xfffffffffffffff0ULL);
+  const int kCount(1000);
+  std::map<uint64_t, int> expected;
+  for (int i = 0; i != kCount; ++i) {
+    uint64_t id(kFirstId + static_cast<uint64_t>(i));
+    if (id == 0)
+      continue;
+    map.Insert(id, i);
+    expected[id] = i;
+  }
+  EXPECT_EQ(expected.size(), map.size());
+  EXPECT_LE(2 * map.size(), map.capacity());
+
+  // Replacing a value doesn't add an entry.
+  map.Insert(kFirstId, -1);
+  expected[kFirstId] = -1;
+  EXPECT_EQ(expected.size(), map.size());
+
+  // Erasing every third entry leaves the rest reachable, however the erased
+  // entries' probe sequences overlapped theirs.
+  for (auto it = expected.begin(); it != expected.end();) {
+    if (it->second % 3 == 0) {
+      EXPECT_TRUE(map.Erase(it->first));
+      EXPECT_FALSE(map.Erase(it->first));
+      expected.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  EXPECT_EQ(expected.size(), map.size());
+  for (auto it = expected.begin(); it != expected.end(); ++it) {
+    int *value(map.Find(it->first));
+    ASSERT_NE(nullptr, value);
+    EXPECT_EQ(it->second, *value);
+  }
+
+  // Random ids exercise probe sequences which wrap around the array.
+  for (int i = 0; i != kCount; ++i) {
+    uint64_t id(RandomUint32());
+    id = (id << 32) | RandomUint32();
+    if (id == 0)
+      continue;
+    map.Insert(id, i);
+    expected[id] = i;
+  }
+  for (auto it = expected.begin(); it != expected.end(); ++it) {
+    int *value(map.Find(it->first));
+    ASSERT_NE(nullptr, value);
+    EXPECT_EQ(it->second, *value);
+    EXPECT_TRUE(map.Erase(it->first));
+  }
+  EXPECT_TRUE(map.empty());
+
+  map.Insert(1, 1);
+  map.Clear();
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(nullptr, map.Find(1));
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
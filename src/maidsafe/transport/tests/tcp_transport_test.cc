@@ -25,15 +25,879 @@ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
 THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <iostream>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "boost/asio/write.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "maidsafe/common/asio_service.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/outbound_limiter.h"
+#include "maidsafe/transport/tcp_connection.h"
+#include "maidsafe/transport/tcp_parameters.h"
 #include "maidsafe/transport/tcp_transport.h"
 #include "maidsafe/transport/tests/transport_api_test.h"
 
+namespace bptime = boost::posix_time;
+
 namespace maidsafe {
 
 namespace transport {
 
 namespace test {
 
+namespace {
+
+// Counts received requests without replying, so that each conversation ends
+// as soon as the request has been read.
+void CountRequest(std::atomic<size_t> *count,
+                  const std::string&,
+                  const Info&,
+                  std::string*,
+                  Timeout*) {
+  ++(*count);
+}
+
+void CountBuffer(std::atomic<size_t> *count,
+                 const SharedBuffer&,
+                 const Info&,
+                 std::string*,
+                 Timeout*) {
+  ++(*count);
+}
+
+void CountWritable(std::atomic<size_t> *count, const Endpoint&) {
+  ++(*count);
+}
+
+// Sends kConnections requests over fresh connections from kSenders transports
+// to a listener with the given number of acceptors, and returns the rate at
+// which they were accepted and read in connections per second.
+double MeasureAcceptRate(size_t acceptor_count) {
+  const size_t kSenders(8), kConnections(2000);
+  TcpParameters::acceptor_count = acceptor_count;
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  std::atomic<size_t> count(0);
+  listener->on_message_received()->connect(
+      boost::bind(&CountRequest, &count, _1, _2, _3, _4));
+  std::vector<std::shared_ptr<TcpTransport>> senders;
+  for (size_t i = 0; i != kSenders; ++i)
+    senders.push_back(std::make_shared<TcpTransport>(asio_service.service()));
+
+  bptime::ptime start(bptime::microsec_clock::universal_time());
+  for (size_t i = 0; i != kConnections; ++i)
+    senders.at(i % kSenders)->Send("Request", Endpoint(kIP, port),
+                                   kImmediateTimeout);
+  int wait(0);
+  while (count < kConnections && wait++ < 600)
+    Sleep(bptime::milliseconds(10));
+  bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                start);
+  EXPECT_EQ(kConnections, count.load());
+
+  listener->StopListening();
+  senders.clear();
+  listener.reset();
+  asio_service.Stop();
+  return count.load() * 1000000.0 / elapsed.total_microseconds();
+}
+
+// Sends kMessages messages of the given size one after another over a single
+// connection, and reports the rate at which they were received in MB/s and the
+// number of receive buffers the listener allocated per message.
+void MeasureReceiveRate(size_t message_size,
+                        double *megabytes_per_second,
+                        double *allocations_per_message) {
+  const size_t kMessages(std::max(size_t(2), (size_t(32) << 20) /
+                                             message_size));
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  // The messages are received without being copied, so that only the
+  // receive path itself is measured.
+  std::atomic<size_t> count(0);
+  listener->on_buffer_received()->connect(
+      boost::bind(&CountBuffer, &count, _1, _2, _3, _4));
+  std::string message(message_size, 'a');
+
+  bptime::ptime start(bptime::microsec_clock::universal_time());
+  for (size_t i = 0; i != kMessages; ++i) {
+    sender->Send(message, Endpoint(kIP, port), kImmediateTimeout);
+    int wait(0);
+    while (count == i && wait++ < 30000)
+      Sleep(bptime::milliseconds(1));
+  }
+  bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                start);
+  size_t allocations(listener->receive_buffer_allocations());
+  EXPECT_EQ(kMessages, count.load());
+
+  listener->StopListening();
+  sender.reset();
+  listener.reset();
+  asio_service.Stop();
+  *megabytes_per_second = static_cast<double>(count.load() * message_size) /
+                          elapsed.total_microseconds();
+  *allocations_per_message = static_cast<double>(allocations) / kMessages;
+}
+
+// Collects the parts of a streamed message.
+class TestStream : public MessageStream {
+ public:
+  TestStream()
+      : data(), part_sizes(), completed(false), error(kSuccess), mutex() {}
+  virtual void OnData(const SharedBuffer &part) {
+    boost::mutex::scoped_lock lock(mutex);
+    data += part.ToString();
+    part_sizes.push_back(part.size());
+  }
+  virtual void OnComplete(const Info&, std::string *response,
+                          Timeout *timeout) {
+    boost::mutex::scoped_lock lock(mutex);
+    completed = true;
+    *response = "Streamed " + boost::lexical_cast<std::string>(data.size());
+    *timeout = kImmediateTimeout;
+  }
+  virtual void OnFailure(const TransportCondition &condition) {
+    boost::mutex::scoped_lock lock(mutex);
+    error = condition;
+  }
+  std::string data;
+  std::vector<size_t> part_sizes;
+  bool completed;
+  TransportCondition error;
+  boost::mutex mutex;
+};
+
+// Holds up the delivery of the first part of a message until opened.
+class GatedStream : public TestStream {
+ public:
+  GatedStream() : open_(false), gate_mutex_(), opened_() {}
+  virtual void OnData(const SharedBuffer &part) {
+    {
+      boost::mutex::scoped_lock lock(gate_mutex_);
+      bptime::ptime give_up(bptime::microsec_clock::universal_time() +
+                            bptime::seconds(10));
+      while (!open_ && opened_.timed_wait(lock, give_up)) {}
+    }
+    TestStream::OnData(part);
+  }
+  void Open() {
+    boost::mutex::scoped_lock lock(gate_mutex_);
+    open_ = true;
+    opened_.notify_all();
+  }
+ private:
+  bool open_;
+  boost::mutex gate_mutex_;
+  boost::condition_variable opened_;
+};
+
+void StartStream(const MessageStreamPtr &stream,
+                 DataSize *streamed_size,
+                 const DataSize &size,
+                 const Info&,
+                 MessageStreamPtr *result) {
+  *streamed_size = size;
+  *result = stream;
+}
+
+}  // unnamed namespace
+
+// Puts back any TcpParameters a test changes, even if the test fails part way
+// through.
+class TcpTransportTest : public testing::Test {
+ protected:
+  TcpTransportTest()
+      : max_idle_connections_(TcpParameters::max_idle_connections),
+        idle_timeout_(TcpParameters::idle_timeout),
+        multiplexing_(TcpParameters::multiplexing),
+        acceptor_count_(TcpParameters::acceptor_count),
+        max_coalesced_frames_(TcpParameters::max_coalesced_frames),
+        max_coalesced_bytes_(TcpParameters::max_coalesced_bytes) {}
+
+  virtual void TearDown() {
+    TcpParameters::max_idle_connections = max_idle_connections_;
+    TcpParameters::idle_timeout = idle_timeout_;
+    TcpParameters::multiplexing = multiplexing_;
+    TcpParameters::acceptor_count = acceptor_count_;
+    TcpParameters::max_coalesced_frames = max_coalesced_frames_;
+    TcpParameters::max_coalesced_bytes = max_coalesced_bytes_;
+  }
+
+ private:
+  size_t max_idle_connections_;
+  bptime::time_duration idle_timeout_;
+  bool multiplexing_;
+  size_t acceptor_count_, max_coalesced_frames_, max_coalesced_bytes_;
+};
+
+TEST_F(TcpTransportTest, BEH_ReuseIdleConnection) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  const size_t kMessageCount(5);
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    sender->Send(RandomString(23), Endpoint(kIP, port), bptime::seconds(1));
+    int count(0);
+    while (msgh_sender->responses_received().size() == i && count++ < 20)
+      Sleep(bptime::milliseconds(100));
+    ASSERT_EQ(i + 1, msgh_sender->responses_received().size());
+    // Give the connection time to be handed back to the idle pool.
+    Sleep(bptime::milliseconds(100));
+  }
+
+  // Every request should have been sent over the same connection.
+  EXPECT_EQ(kMessageCount, msgh_listener->requests_received().size());
+  EXPECT_EQ(1U, sender->connections_.size());
+  EXPECT_EQ(1U, sender->idle_connections_.size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+
+  // Once its idle timeout expires, the pooled connection should be closed.
+  TcpParameters::idle_timeout = bptime::milliseconds(200);
+  sender->Send(RandomString(23), Endpoint(kIP, port), bptime::seconds(1));
+  int count(0);
+  while (msgh_sender->responses_received().size() == kMessageCount &&
+         count++ < 20)
+    Sleep(bptime::milliseconds(100));
+  Sleep(bptime::milliseconds(500));
+  EXPECT_TRUE(sender->connections_.empty());
+  EXPECT_TRUE(sender->idle_connections_.empty());
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_EmptyResponse) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  sender->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  std::atomic<size_t> count(0);
+  listener->on_message_received()->connect(
+      boost::bind(&CountRequest, &count, _1, _2, _3, _4));
+
+  // The listener keeps the connection open after a request it doesn't
+  // answer, so a requester waiting for a response times out.
+  bptime::ptime start(bptime::microsec_clock::universal_time());
+  sender->Send(RandomString(23), Endpoint(kIP, port),
+               bptime::milliseconds(500));
+  int wait(0);
+  while (msgh_sender->results().empty() && wait++ < 30)
+    Sleep(bptime::milliseconds(100));
+  bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                start);
+  ASSERT_EQ(1U, msgh_sender->results().size());
+  EXPECT_EQ(kReceiveTimeout, msgh_sender->results().at(0));
+  EXPECT_LE(bptime::milliseconds(400), elapsed);
+  EXPECT_EQ(1U, count);
+
+  // Messages which don't wait for a response share one connection.
+  for (size_t i = 0; i != 2; ++i) {
+    sender->Send(RandomString(23), Endpoint(kIP, port), kImmediateTimeout);
+    wait = 0;
+    while (count == i + 1 && wait++ < 20)
+      Sleep(bptime::milliseconds(50));
+    ASSERT_EQ(i + 2, count);
+    Sleep(bptime::milliseconds(100));
+  }
+  EXPECT_EQ(1U, sender->connections_.size());
+  EXPECT_EQ(1U, sender->idle_connections_.size());
+
+  // Without connection reuse the listener closes the connection instead, so
+  // a requester waiting for a response fails straight away.
+  TcpParameters::max_idle_connections = 0;
+  start = bptime::microsec_clock::universal_time();
+  sender->Send(RandomString(23), Endpoint(kIP, port), bptime::seconds(2));
+  wait = 0;
+  while (msgh_sender->results().size() == 1 && wait++ < 30)
+    Sleep(bptime::milliseconds(100));
+  elapsed = bptime::microsec_clock::universal_time() - start;
+  ASSERT_EQ(2U, msgh_sender->results().size());
+  EXPECT_EQ(kReceiveFailure, msgh_sender->results().at(1));
+  EXPECT_GT(bptime::seconds(1), elapsed);
+  EXPECT_EQ(4U, count);
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_MultiplexRequests) {
+  TcpParameters::multiplexing = true;
+  TcpParameters::idle_timeout = bptime::milliseconds(200);
+
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  sender->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  // Send a burst of requests without waiting for any of the responses.
+  const size_t kMessageCount(20);
+  for (size_t i = 0; i != kMessageCount; ++i)
+    sender->Send(RandomString(1 + i * 1000), Endpoint(kIP, port),
+                 bptime::seconds(5));
+  int count(0);
+  while (msgh_sender->responses_received().size() < kMessageCount &&
+         count++ < 50)
+    Sleep(bptime::milliseconds(100));
+
+  // All requests should have shared a single connection.
+  ASSERT_EQ(kMessageCount, msgh_sender->responses_received().size());
+  EXPECT_EQ(kMessageCount, msgh_listener->requests_received().size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+  EXPECT_EQ(1U, sender->connections_.size());
+  EXPECT_EQ(1U, sender->framed_connections_.size());
+
+  // Each response should match one sent for a request.
+  IncomingMessages responses(msgh_sender->responses_received());
+  OutgoingResponses responses_sent(msgh_listener->responses_sent());
+  for (auto it = responses.begin(); it != responses.end(); ++it)
+    EXPECT_NE(responses_sent.end(), std::find(responses_sent.begin(),
+                                              responses_sent.end(),
+                                              it->first));
+
+  // Once idle, the connection should be closed.
+  Sleep(bptime::milliseconds(500));
+  EXPECT_TRUE(sender->connections_.empty());
+  EXPECT_TRUE(sender->framed_connections_.empty());
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_CoalesceFrames) {
+  TcpParameters::multiplexing = true;
+  TcpParameters::idle_timeout = bptime::milliseconds(200);
+  TcpParameters::max_coalesced_frames = 3;
+  TcpParameters::max_coalesced_bytes = 5000;
+
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  sender->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  // Messages both smaller and larger than the byte limit are queued together,
+  // and should be split across writes without being corrupted.
+  const size_t kMessageCount(30);
+  std::vector<std::string> requests;
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    requests.push_back(RandomString(i % 3 == 0 ? 8000 : 10 + i));
+    sender->Send(requests.back(), Endpoint(kIP, port), bptime::seconds(5));
+  }
+  int count(0);
+  while (msgh_sender->responses_received().size() < kMessageCount &&
+         count++ < 50)
+    Sleep(bptime::milliseconds(100));
+
+  ASSERT_EQ(kMessageCount, msgh_sender->responses_received().size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+  // Requests are dispatched concurrently, so may be handled in any order.
+  IncomingMessages requests_received(msgh_listener->requests_received());
+  ASSERT_EQ(kMessageCount, requests_received.size());
+  std::vector<std::string> received;
+  for (auto it = requests_received.begin(); it != requests_received.end(); ++it)
+    received.push_back(it->first);
+  std::sort(requests.begin(), requests.end());
+  std::sort(received.begin(), received.end());
+  EXPECT_TRUE(requests == received);
+
+  // The requests should have been gathered into fewer writes than there
+  // were requests, none with more frames than the limit.
+  ASSERT_EQ(1U, sender->framed_connections_.size());
+  std::shared_ptr<TcpConnection> connection(
+      sender->framed_connections_.begin()->second);
+  EXPECT_EQ(kMessageCount, connection->frames_written_);
+  EXPECT_GT(kMessageCount, connection->frame_writes_);
+  EXPECT_LE(kMessageCount / 3, connection->frame_writes_);
+
+  // Nagle's algorithm should be disabled on the connection.
+  boost::asio::ip::tcp::no_delay no_delay;
+  connection->Socket().get_option(no_delay);
+  EXPECT_TRUE(no_delay.value());
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_StreamMessage) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+  std::shared_ptr<TestStream> stream(new TestStream);
+  DataSize streamed_size(0);
+  listener->on_stream_started()->connect(
+      boost::bind(&StartStream, stream, &streamed_size, _1, _2, _3));
+
+  // The message should arrive in parts no larger than a chunk, and no other
+  // signal should fire for it.
+  std::string request(RandomString(1000000));
+  sender->Send(request, Endpoint(kIP, port), bptime::seconds(1));
+  int count(0);
+  while (msgh_sender->responses_received().empty() && count++ < 50)
+    Sleep(bptime::milliseconds(100));
+  ASSERT_EQ(1U, msgh_sender->responses_received().size());
+  EXPECT_EQ("Streamed 1000000", msgh_sender->responses_received().at(0).first);
+  EXPECT_TRUE(msgh_listener->requests_received().empty());
+  {
+    boost::mutex::scoped_lock lock(stream->mutex);
+    EXPECT_EQ(request.size(), streamed_size);
+    EXPECT_TRUE(stream->completed);
+    EXPECT_EQ(kSuccess, stream->error);
+    EXPECT_TRUE(request == stream->data);
+    EXPECT_LT(1U, stream->part_sizes.size());
+    for (auto it = stream->part_sizes.begin(); it != stream->part_sizes.end();
+         ++it)
+      EXPECT_GE(static_cast<size_t>(kMaxTransportChunkSize), *it);
+  }
+
+  // A message cut short by the peer should fail its stream.
+  std::shared_ptr<TestStream> failed_stream(new TestStream);
+  listener->on_stream_started()->disconnect_all_slots();
+  listener->on_stream_started()->connect(
+      boost::bind(&StartStream, failed_stream, &streamed_size, _1, _2, _3));
+  {
+    boost::asio::ip::tcp::socket socket(asio_service.service());
+    socket.connect(boost::asio::ip::tcp::endpoint(kIP, port));
+    const unsigned char kPartialMessage[] = { 0, 0, 3, 232, 'a', 'b', 'c' };
+    boost::asio::write(socket, boost::asio::buffer(kPartialMessage));
+    Sleep(bptime::milliseconds(100));
+  }
+  count = 0;
+  while (count++ < 20) {
+    boost::mutex::scoped_lock lock(failed_stream->mutex);
+    if (failed_stream->error != kSuccess)
+      break;
+    lock.unlock();
+    Sleep(bptime::milliseconds(100));
+  }
+  {
+    boost::mutex::scoped_lock lock(failed_stream->mutex);
+    EXPECT_EQ(1000U, streamed_size);
+    EXPECT_FALSE(failed_stream->completed);
+    EXPECT_EQ(kReceiveFailure, failed_stream->error);
+    EXPECT_TRUE(failed_stream->data.empty());
+  }
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_SlowStream) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  std::shared_ptr<GatedStream> stream(new GatedStream);
+  DataSize streamed_size(0);
+  listener->on_stream_started()->connect(
+      boost::bind(&StartStream, stream, &streamed_size, _1, _2, _3));
+
+  // The message is far larger than the socket buffers, but is read in full
+  // while the stream is still held up on its first part.
+  std::string request(RandomString(16 << 20));
+  sender->Send(request, Endpoint(kIP, port), bptime::seconds(10));
+  bool read(false);
+  int count(0);
+  while (!read && count++ < 50) {
+    Sleep(bptime::milliseconds(100));
+    for (auto it = listener->connections_.begin();
+         it != listener->connections_.end(); ++it)
+      read = read || ((*it)->data_size_ == request.size() &&
+                      (*it)->data_received_ == request.size());
+  }
+  EXPECT_TRUE(read);
+  {
+    boost::mutex::scoped_lock lock(stream->mutex);
+    EXPECT_TRUE(stream->part_sizes.empty());
+  }
+
+  // Once the stream catches up, it gets every part in order.
+  stream->Open();
+  count = 0;
+  while (msgh_sender->responses_received().empty() && count++ < 100)
+    Sleep(bptime::milliseconds(100));
+  ASSERT_EQ(1U, msgh_sender->responses_received().size());
+  EXPECT_EQ("Streamed 16777216", msgh_sender->responses_received().at(0).first);
+  {
+    boost::mutex::scoped_lock lock(stream->mutex);
+    EXPECT_TRUE(stream->completed);
+    EXPECT_TRUE(request == stream->data);
+  }
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_ReceiveBuffer) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  // With a slot connected to the buffer signal, the message signal shouldn't
+  // fire.
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  listener->on_buffer_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnBufferReceived, msgh_listener, _1,
+                  _2, _3, _4));
+
+  std::string request(RandomString(100000));
+  sender->Send(request, Endpoint(kIP, port), bptime::seconds(1));
+  int count(0);
+  while (msgh_sender->responses_received().empty() && count++ < 20)
+    Sleep(bptime::milliseconds(100));
+
+  ASSERT_EQ(1U, msgh_listener->requests_received().size());
+  EXPECT_EQ(request, msgh_listener->requests_received().at(0).first);
+  EXPECT_TRUE(msgh_sender->requests_received().empty());
+  ASSERT_EQ(1U, msgh_sender->responses_received().size());
+  EXPECT_EQ(msgh_listener->responses_sent().at(0),
+            msgh_sender->responses_received().at(0).first);
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_ReceiveBufferSizedFromHeader) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+  std::atomic<size_t> count(0);
+  listener->on_buffer_received()->connect(
+      boost::bind(&CountBuffer, &count, _1, _2, _3, _4));
+
+  // However many reads a message takes, it is received into a single buffer
+  // allocated once its size is known, unless it is larger than 4 MiB.
+  const size_t kSizes[] = { 100, 1 << 20, 4 << 20 };
+  const size_t kMessageCount(sizeof(kSizes) / sizeof(kSizes[0]));
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    sender->Send(std::string(kSizes[i], 'a'), Endpoint(kIP, port),
+                 kImmediateTimeout);
+    int wait(0);
+    while (count == i && wait++ < 100)
+      Sleep(bptime::milliseconds(50));
+    ASSERT_EQ(i + 1, count);
+  }
+  EXPECT_EQ(kMessageCount, listener->receive_buffer_allocations());
+  EXPECT_EQ(0U, sender->receive_buffer_allocations());
+
+  // The buffer for a larger message is doubled as the data arrives.
+  sender->Send(std::string(16 << 20, 'a'), Endpoint(kIP, port),
+               kImmediateTimeout);
+  int wait(0);
+  while (count == kMessageCount && wait++ < 100)
+    Sleep(bptime::milliseconds(50));
+  ASSERT_EQ(kMessageCount + 1, count);
+  EXPECT_EQ(kMessageCount + 3, listener->receive_buffer_allocations());
+
+  // A peer which claims a large size without sending the data doesn't get
+  // the whole buffer allocated for it.
+  boost::asio::ip::tcp::socket socket(asio_service.service());
+  socket.connect(boost::asio::ip::tcp::endpoint(kIP, port));
+  const unsigned char kHeader[] = { 3, 255, 255, 255, 'a', 'b', 'c' };
+  boost::asio::write(socket, boost::asio::buffer(kHeader));
+  Sleep(bptime::milliseconds(200));
+  size_t largest(0);
+  for (auto it = listener->connections_.begin();
+       it != listener->connections_.end(); ++it)
+    largest = std::max(largest, (*it)->data_buffer_.capacity());
+  EXPECT_EQ(size_t(4 << 20), largest);
+  socket.close();
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_SendBuffers) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  // The header and payload are sent from separate buffers, which are kept
+  // alive by the owner until the write completes.
+  std::shared_ptr<std::pair<std::string, std::string>> message(
+      std::make_shared<std::pair<std::string, std::string>>(
+          RandomString(16), RandomString(100000)));
+  ConstBuffers buffers;
+  buffers.push_back(boost::asio::buffer(message->first));
+  buffers.push_back(boost::asio::buffer(message->second));
+  sender->Send(buffers, message, Endpoint(kIP, port), bptime::seconds(1));
+  int count(0);
+  while (msgh_sender->responses_received().empty() && count++ < 20)
+    Sleep(bptime::milliseconds(100));
+
+  ASSERT_EQ(1U, msgh_listener->requests_received().size());
+  EXPECT_EQ(message->first + message->second,
+            msgh_listener->requests_received().at(0).first);
+  ASSERT_EQ(1U, msgh_sender->responses_received().size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+
+  listener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_OutboundLimits) {
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> sender(
+      new TcpTransport(asio_service.service()));
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  std::atomic<size_t> writable(0);
+  sender->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  sender->on_writable()->connect(boost::bind(&CountWritable, &writable, _1));
+
+  // The peer accepts the connection but never reads from it, so a message
+  // too large for the socket buffers can't be written out.
+  boost::asio::ip::tcp::acceptor acceptor(asio_service.service());
+  boost::asio::ip::tcp::endpoint local(kIP, 0);
+  acceptor.open(local.protocol());
+  acceptor.bind(local);
+  acceptor.listen();
+  Endpoint endpoint(kIP, acceptor.local_endpoint().port());
+
+  // With one message allowed in flight, a second sent before the first has
+  // been written out is refused.
+  OutboundLimits limits;
+  limits.endpoint_messages = 1;
+  sender->SetOutboundLimits(limits);
+  sender->Send(std::string(32 * 1024 * 1024, 'a'), endpoint,
+               bptime::seconds(1));
+  sender->Send(RandomString(10), endpoint, bptime::seconds(1));
+  boost::asio::ip::tcp::socket socket(asio_service.service());
+  acceptor.accept(socket);
+  EXPECT_EQ(1U, sender->outbound_limiter_->total_messages());
+  EXPECT_EQ(0U, writable);
+  ASSERT_EQ(1U, msgh_sender->results().size());
+  EXPECT_EQ(kSendStalled, msgh_sender->results().at(0));
+
+  // Once the first has failed, the endpoint is signalled as writable.
+  Sleep(bptime::milliseconds(200));
+  socket.close();
+  acceptor.close();
+  // The message is released before its failure is reported.
+  int count(0);
+  while ((writable == 0 || msgh_sender->results().size() < 2) && count++ < 20)
+    Sleep(bptime::milliseconds(100));
+  EXPECT_EQ(1U, writable);
+  ASSERT_EQ(2U, msgh_sender->results().size());
+  EXPECT_EQ(kSendFailure, msgh_sender->results().at(1));
+  EXPECT_EQ(0U, sender->outbound_limiter_->total_messages());
+  EXPECT_EQ(0U, sender->outbound_limiter_->total_bytes());
+
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, BEH_MultipleAcceptors) {
+  TcpParameters::acceptor_count = 4;
+  AsioService asio_service;
+  asio_service.Start(kThreadGroupSize);
+  std::shared_ptr<TcpTransport> listener(
+      new TcpTransport(asio_service.service()));
+  Port port(20000);
+  while (listener->StartListening(Endpoint(kIP, port)) != kSuccess)
+    ++port;
+#ifdef SO_REUSEPORT
+  EXPECT_EQ(4U, listener->acceptors_.size());
+#else
+  EXPECT_EQ(1U, listener->acceptors_.size());
+#endif
+  EXPECT_EQ(port, listener->listening_port());
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  listener->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  // Each sender opens its own connection, whichever acceptor takes it.
+  const size_t kSenders(10);
+  std::vector<std::shared_ptr<TcpTransport>> senders;
+  for (size_t i = 0; i != kSenders; ++i) {
+    senders.push_back(std::make_shared<TcpTransport>(asio_service.service()));
+    senders.back()->on_message_received()->connect(
+        boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender,
+                    _1, _2, _3, _4));
+    senders.back()->Send(RandomString(23), Endpoint(kIP, port),
+                         bptime::seconds(1));
+  }
+  int count(0);
+  while (msgh_sender->responses_received().size() < kSenders && count++ < 30)
+    Sleep(bptime::milliseconds(100));
+  EXPECT_EQ(kSenders, msgh_listener->requests_received().size());
+  EXPECT_EQ(kSenders, msgh_sender->responses_received().size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+
+  // Once stopped, the port should be free to listen on again.
+  listener->StopListening();
+  EXPECT_TRUE(listener->acceptors_.empty());
+  senders.clear();
+  Sleep(bptime::milliseconds(100));
+  std::shared_ptr<TcpTransport> relistener(
+      new TcpTransport(asio_service.service()));
+  EXPECT_EQ(kSuccess, relistener->StartListening(Endpoint(kIP, port)));
+  relistener->StopListening();
+  asio_service.Stop();
+}
+
+TEST_F(TcpTransportTest, FUNC_AcceptRate) {
+  TcpParameters::max_idle_connections = 0;
+  double single_rate(MeasureAcceptRate(1));
+  double multiple_rate(MeasureAcceptRate(4));
+  std::cout << "Accepted " << single_rate << " connections/s with 1 acceptor, "
+            << multiple_rate << " connections/s with 4 acceptors."
+            << std::endl;
+}
+
+TEST_F(TcpTransportTest, FUNC_ReceiveRate) {
+  TcpParameters::idle_timeout = bptime::milliseconds(200);
+  const size_t kSizes[] = { 1 << 20, 16 << 20, 64 << 20 };
+  for (size_t i = 0; i != sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+    double megabytes_per_second(0), allocations_per_message(0);
+    MeasureReceiveRate(kSizes[i], &megabytes_per_second,
+                       &allocations_per_message);
+    std::cout << "Received " << (kSizes[i] >> 20) << " MiB messages at "
+              << megabytes_per_second << " MB/s with "
+              << allocations_per_message << " buffer allocations per message."
+              << std::endl;
+  }
+}
+
 }  // namespace test
 
 }  // namespace transport
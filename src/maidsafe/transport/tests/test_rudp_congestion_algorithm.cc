@@ -0,0 +1,234 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <memory>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+// A path with a bottleneck of a given capacity, in packets per second, and a
+// queue of a given length in front of it. Each step lasts from sending a
+// packet until its acknowledgement arrives, in which the algorithm's window
+// and send delay decide how many packets are offered. Those the bottleneck
+// can't carry are queued, or lost once the queue is full, and each step ends
+// with an acknowledgement of the packets delivered, carrying the round trip
+// time including the queueing delay.
+class PathSimulator {
+ public:
+  PathSimulator(RudpCongestionAlgorithm *algorithm,
+                double capacity,
+                const bptime::time_duration &base_round_trip_time,
+                double queue_size)
+      : algorithm_(algorithm),
+        capacity_(capacity),
+        base_round_trip_time_(base_round_trip_time),
+        queue_size_(queue_size),
+        queue_(0.0),
+        now_(bptime::time_from_string("2011-01-01 00:00:00")),
+        delivered_(0.0),
+        lost_(0.0) {}
+
+  void Step() {
+    bptime::time_duration round_trip_time(RoundTripTime());
+    bptime::time_duration step(round_trip_time + RudpParameters::ack_interval);
+    double step_seconds = step.total_microseconds() / 1e6;
+    double offered = static_cast<double>(algorithm_->SendWindowSize());
+    if (algorithm_->SendDelay() > bptime::time_duration())
+      offered = std::min(offered, step_seconds * 1e6 /
+                         algorithm_->SendDelay().total_microseconds());
+    double delivered = std::min(queue_ + offered, capacity_ * step_seconds);
+    queue_ += offered - delivered;
+    double lost = std::max(queue_ - queue_size_, 0.0);
+    queue_ -= lost;
+    now_ += step;
+    delivered_ += delivered;
+    lost_ += lost;
+
+    if (lost >= 1.0)
+      algorithm_->OnNegativeAck(0, now_);
+    RudpAckSample sample;
+    sample.now = now_;
+    sample.round_trip_time =
+        static_cast<boost::uint32_t>(round_trip_time.total_microseconds());
+    sample.available_buffer_size = 1 << 24;
+    sample.packets_acknowledged = static_cast<size_t>(delivered);
+    sample.packets_in_flight = static_cast<size_t>(queue_);
+    algorithm_->OnAck(sample);
+  }
+
+  // Run for a number of steps, returning the fraction of the capacity used.
+  double Run(size_t steps) {
+    bptime::ptime start(now_);
+    double delivered(delivered_);
+    for (size_t i = 0; i != steps; ++i)
+      Step();
+    return (delivered_ - delivered) /
+           (capacity_ * (now_ - start).total_microseconds() / 1e6);
+  }
+
+  bptime::time_duration RoundTripTime() const {
+    return base_round_trip_time_ + bptime::microseconds(
+        static_cast<boost::int64_t>(1e6 * queue_ / capacity_));
+  }
+  double queue() const { return queue_; }
+  double lost() const { return lost_; }
+  const bptime::ptime &now() const { return now_; }
+
+ private:
+  PathSimulator(const PathSimulator&);
+  PathSimulator &operator=(const PathSimulator&);
+
+  RudpCongestionAlgorithm *algorithm_;
+  double capacity_;
+  bptime::time_duration base_round_trip_time_;
+  double queue_size_, queue_;
+  bptime::ptime now_;
+  double delivered_, lost_;
+};
+
+TEST(RudpCongestionAlgorithmTest, BEH_Create) {
+  std::unique_ptr<RudpCongestionAlgorithm> aimd(
+      RudpCongestionAlgorithm::Create(RudpParameters::kAimd));
+  std::unique_ptr<RudpCongestionAlgorithm> cubic(
+      RudpCongestionAlgorithm::Create(RudpParameters::kCubic));
+  std::unique_ptr<RudpCongestionAlgorithm> bbr(
+      RudpCongestionAlgorithm::Create(RudpParameters::kBbr));
+  EXPECT_EQ(RudpParameters::default_data_size, aimd->SendDataSize());
+  EXPECT_EQ(RudpParameters::max_data_size, cubic->SendDataSize());
+  EXPECT_EQ(RudpParameters::max_data_size, bbr->SendDataSize());
+  EXPECT_EQ(RudpParameters::default_window_size, aimd->SendWindowSize());
+  EXPECT_EQ(RudpParameters::default_window_size, cubic->SendWindowSize());
+  EXPECT_EQ(RudpParameters::default_window_size, bbr->SendWindowSize());
+  EXPECT_EQ(RudpParameters::default_send_delay, cubic->SendDelay());
+  EXPECT_EQ(RudpParameters::default_send_delay, bbr->SendDelay());
+}
+
+TEST(RudpCongestionAlgorithmTest, BEH_AimdFollowsPeerBuffer) {
+  std::unique_ptr<RudpCongestionAlgorithm> aimd(
+      RudpCongestionAlgorithm::Create(RudpParameters::kAimd));
+  RudpAckSample sample;
+  sample.round_trip_time = 10000;
+  sample.available_buffer_size = 64 * RudpParameters::max_data_size;
+  aimd->OnAck(sample);
+  EXPECT_LT(RudpParameters::default_window_size, aimd->SendWindowSize());
+  EXPECT_LT(RudpParameters::default_data_size, aimd->SendDataSize());
+
+  // Without room at the peer, the window shrinks back to the default.
+  sample.available_buffer_size = 0;
+  for (int i = 0; i != 100; ++i)
+    aimd->OnAck(sample);
+  EXPECT_EQ(RudpParameters::default_window_size, aimd->SendWindowSize());
+}
+
+TEST(RudpCongestionAlgorithmTest, BEH_CubicCutsOncePerRoundTrip) {
+  std::unique_ptr<RudpCongestionAlgorithm> cubic(
+      RudpCongestionAlgorithm::Create(RudpParameters::kCubic));
+  bptime::ptime now(bptime::time_from_string("2011-01-01 00:00:00"));
+  RudpAckSample sample;
+  sample.now = now;
+  sample.round_trip_time = 100000;
+  sample.packets_acknowledged = 84;
+  cubic->OnAck(sample);
+  ASSERT_EQ(100U, cubic->SendWindowSize());
+
+  // Losses are responded to once until the packets sent after the cut could
+  // have been acknowledged, a round trip plus the acknowledgement interval.
+  cubic->OnNegativeAck(1, now);
+  EXPECT_EQ(70U, cubic->SendWindowSize());
+  cubic->OnNegativeAck(2, now + bptime::milliseconds(150));
+  EXPECT_EQ(70U, cubic->SendWindowSize());
+  // Nor does the window grow until then.
+  sample.now = now + bptime::milliseconds(150);
+  cubic->OnAck(sample);
+  EXPECT_EQ(70U, cubic->SendWindowSize());
+  cubic->OnNegativeAck(3, now + bptime::milliseconds(200));
+  EXPECT_EQ(49U, cubic->SendWindowSize());
+
+  // A timeout starts again from the minimum window.
+  cubic->OnSendTimeout(4, now + bptime::milliseconds(400));
+  EXPECT_EQ(2U, cubic->SendWindowSize());
+}
+
+TEST(RudpCongestionAlgorithmTest, BEH_CubicFillsBottleneck) {
+  std::unique_ptr<RudpCongestionAlgorithm> cubic(
+      RudpCongestionAlgorithm::Create(RudpParameters::kCubic));
+  // A bandwidth-delay product of 100 packets, with a queue of half that.
+  PathSimulator path(cubic.get(), 1000.0, bptime::milliseconds(100), 50.0);
+  path.Run(20);
+  EXPECT_LT(0.0, path.lost());
+  EXPECT_LT(0.8, path.Run(200));
+  EXPECT_GT(RudpParameters::maximum_window_size, cubic->SendWindowSize());
+}
+
+TEST(RudpCongestionAlgorithmTest, BEH_BbrFindsBottleneck) {
+  std::unique_ptr<RudpCongestionAlgorithm> bbr(
+      RudpCongestionAlgorithm::Create(RudpParameters::kBbr));
+  PathSimulator path(bbr.get(), 1000.0, bptime::milliseconds(100), 50.0);
+  path.Run(30);
+  double lost(path.lost());
+  EXPECT_LT(0.9, path.Run(50));
+  // Probing for more bandwidth overflows the queue now and then, but less
+  // than 5% of the 10000 packets delivered are lost.
+  EXPECT_GT(500.0, path.lost() - lost);
+  // It paces at about the bottleneck rate, with a window of about twice the
+  // bandwidth-delay product, which includes the acknowledgement interval.
+  EXPECT_LE(bptime::microseconds(750), bbr->SendDelay());
+  EXPECT_GE(bptime::microseconds(1350), bbr->SendDelay());
+  EXPECT_LE(300U, bbr->SendWindowSize());
+  EXPECT_GE(500U, bbr->SendWindowSize());
+}
+
+TEST(RudpCongestionAlgorithmTest, BEH_BbrProbesRoundTripTime) {
+  std::unique_ptr<RudpCongestionAlgorithm> bbr(
+      RudpCongestionAlgorithm::Create(RudpParameters::kBbr));
+  PathSimulator path(bbr.get(), 1000.0, bptime::milliseconds(100), 50.0);
+  // The lowest round trip time expires after ten seconds, when the window
+  // drops to a few packets for a little over a round trip.
+  bool probed(false);
+  for (int i = 0; i != 150 && !probed; ++i) {
+    path.Step();
+    probed = bbr->SendWindowSize() == 4U;
+  }
+  EXPECT_TRUE(probed);
+  path.Run(5);
+  EXPECT_LT(4U, bbr->SendWindowSize());
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -0,0 +1,161 @@
+/* Copyright (c) 2011 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/rudp_interval_set.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+typedef std::vector<RudpIntervalSet::Interval> Intervals;
+
+static Intervals Contents(const RudpIntervalSet &set) {
+  return Intervals(set.begin(), set.end());
+}
+
+TEST(RudpIntervalSetTest, BEH_InsertMerges) {
+  RudpIntervalSet set;
+  EXPECT_TRUE(set.IsEmpty());
+  Intervals added;
+  set.Insert(10, 19, &added);
+  set.Insert(30, 39, &added);
+  ASSERT_EQ(2U, added.size());
+  EXPECT_EQ(RudpIntervalSet::Interval(10, 19), added.at(0));
+  EXPECT_EQ(RudpIntervalSet::Interval(30, 39), added.at(1));
+
+  // An interval spanning the gap reports only the values which were new, and
+  // merges with both neighbours.
+  added.clear();
+  set.Insert(5, 45, &added);
+  ASSERT_EQ(3U, added.size());
+  EXPECT_EQ(RudpIntervalSet::Interval(5, 9), added.at(0));
+  EXPECT_EQ(RudpIntervalSet::Interval(20, 29), added.at(1));
+  EXPECT_EQ(RudpIntervalSet::Interval(40, 45), added.at(2));
+  EXPECT_EQ(Intervals(1, RudpIntervalSet::Interval(5, 45)), Contents(set));
+
+  // Adjoining intervals are merged, and values already present add nothing.
+  added.clear();
+  set.Insert(46, 50, &added);
+  set.Insert(1, 4, &added);
+  set.Insert(20, 30, &added);
+  EXPECT_EQ(2U, added.size());
+  EXPECT_EQ(Intervals(1, RudpIntervalSet::Interval(1, 50)), Contents(set));
+  EXPECT_EQ(1U, set.Front());
+}
+
+TEST(RudpIntervalSetTest, BEH_Erase) {
+  RudpIntervalSet set;
+  set.Insert(10, 20, NULL);
+  set.Insert(30, 40, NULL);
+
+  set.Erase(15);
+  set.Erase(10);
+  set.Erase(25);
+  EXPECT_FALSE(set.Contains(10));
+  EXPECT_TRUE(set.Contains(11));
+  EXPECT_FALSE(set.Contains(15));
+  EXPECT_TRUE(set.Contains(16));
+  EXPECT_EQ(3U, set.IntervalCount());
+  EXPECT_EQ(11U, set.Front());
+
+  // The intervals overlapping a range are clipped to it.
+  Intervals within;
+  set.GetIntervals(12, 32, &within);
+  ASSERT_EQ(3U, within.size());
+  EXPECT_EQ(RudpIntervalSet::Interval(12, 14), within.at(0));
+  EXPECT_EQ(RudpIntervalSet::Interval(16, 20), within.at(1));
+  EXPECT_EQ(RudpIntervalSet::Interval(30, 32), within.at(2));
+  within.clear();
+  set.GetIntervals(21, 29, &within);
+  EXPECT_TRUE(within.empty());
+
+  set.EraseBelow(35);
+  Intervals expected(1, RudpIntervalSet::Interval(35, 40));
+  EXPECT_EQ(expected, Contents(set));
+  set.EraseBelow(41);
+  EXPECT_TRUE(set.IsEmpty());
+}
+
+TEST(RudpIntervalSetTest, BEH_MatchesBitmap) {
+  // Random operations agree with a plain bitmap of the same values.
+  const size_t kRange(200);
+  RudpIntervalSet set;
+  std::vector<bool> bitmap(kRange, false);
+  for (int i = 0; i != 10000; ++i) {
+    boost::uint64_t first = RandomUint32() % kRange;
+    switch (RandomUint32() % 3) {
+      case 0: {
+        boost::uint64_t last =
+            std::min(first + RandomUint32() % 20, boost::uint64_t(kRange - 1));
+        Intervals added;
+        set.Insert(first, last, &added);
+        size_t new_values(0);
+        for (boost::uint64_t n = first; n <= last; ++n) {
+          if (!bitmap[n])
+            ++new_values;
+          bitmap[n] = true;
+        }
+        for (auto it = added.begin(); it != added.end(); ++it)
+          new_values -= it->second - it->first + 1;
+        ASSERT_EQ(0U, new_values);
+        break;
+      }
+      case 1:
+        set.Erase(first);
+        bitmap[first] = false;
+        break;
+      default:
+        if (RandomUint32() % 10 == 0) {
+          set.EraseBelow(first);
+          std::fill(bitmap.begin(), bitmap.begin() + first, false);
+        }
+        break;
+    }
+    for (size_t n = 0; n != kRange; ++n)
+      ASSERT_EQ(bitmap[n], set.Contains(n));
+  }
+  // No two intervals overlap or adjoin.
+  boost::uint64_t previous_last(0);
+  for (auto it = set.begin(); it != set.end(); ++it) {
+    if (it != set.begin())
+      EXPECT_LT(previous_last + 1, it->first);
+    previous_last = it->second;
+  }
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
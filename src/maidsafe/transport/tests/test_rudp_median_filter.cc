@@ -0,0 +1,238 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <deque>
+#include <iostream>  // NOLINT
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/rudp_median_filter.h"
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+static const size_t kTestPacketCount = 100000;
+static const size_t kPacketsPerAck = 16;
+
+// The receiving rate and link capacity estimates as RudpCongestionControl
+// made them before it used median filters, copying the arrival times and
+// packet pair intervals into vectors and sorting them on every ack.
+class SortingEstimator {
+ public:
+  SortingEstimator() : arrival_times_(), packet_pair_intervals_() {}
+  void OnArrival(boost::uint32_t seqnum, const bptime::ptime &now) {
+    if ((seqnum % 16 == 1) && !arrival_times_.empty()) {
+      packet_pair_intervals_.push_back(now - arrival_times_.back());
+      while (packet_pair_intervals_.size() > 16 + 1)
+        packet_pair_intervals_.pop_front();
+    }
+    arrival_times_.push_back(now);
+    while (arrival_times_.size() > 16 + 1)
+      arrival_times_.pop_front();
+  }
+  bool Estimate(boost::uint64_t *rate, boost::uint64_t *capacity) const {
+    if (arrival_times_.size() <= 8)
+      return false;
+    std::vector<boost::uint64_t> intervals;
+    for (auto iter = arrival_times_.begin() + 1;
+         iter != arrival_times_.end(); ++iter)
+      intervals.push_back((*iter - *(iter - 1)).total_microseconds());
+    std::sort(intervals.begin(), intervals.end());
+    boost::uint64_t median = intervals[intervals.size() / 2];
+    size_t count = 0;
+    boost::uint64_t total = 0;
+    for (auto iter = intervals.begin(); iter != intervals.end(); ++iter)
+      if ((median / 8 <= *iter) && (*iter <= median * 8))
+        ++count, total += *iter;
+    *rate = (total > 0 && count > 8) ? (1000000 * count) / total : 0;
+    *capacity = 0;
+    if (!packet_pair_intervals_.empty()) {
+      std::vector<boost::uint64_t> intervals;
+      for (auto iter = packet_pair_intervals_.begin();
+           iter != packet_pair_intervals_.end(); ++iter)
+        intervals.push_back(iter->total_microseconds());
+      std::sort(intervals.begin(), intervals.end());
+      boost::uint64_t median = intervals[intervals.size() / 2];
+      *capacity = (median > 0) ? 1000000 / median : 0;
+    }
+    return true;
+  }
+ private:
+  std::deque<bptime::ptime> arrival_times_;
+  std::deque<bptime::time_duration> packet_pair_intervals_;
+};
+
+// The same estimates as RudpCongestionControl now makes them.
+class FilterEstimator {
+ public:
+  FilterEstimator()
+      : arrival_intervals_(), last_arrival_time_(), packet_pair_intervals_() {}
+  void OnArrival(boost::uint32_t seqnum, const bptime::ptime &now) {
+    if (!last_arrival_time_.is_not_a_date_time()) {
+      boost::uint64_t interval =
+          (now - last_arrival_time_).total_microseconds();
+      if (seqnum % 16 == 1)
+        packet_pair_intervals_.Add(interval);
+      arrival_intervals_.Add(interval);
+    }
+    last_arrival_time_ = now;
+  }
+  bool Estimate(boost::uint64_t *rate, boost::uint64_t *capacity) const {
+    if (arrival_intervals_.Size() < 8)
+      return false;
+    boost::uint64_t median = arrival_intervals_.Median();
+    size_t count = 0;
+    boost::uint64_t total = 0;
+    arrival_intervals_.SumRange(median / 8, median * 8, &count, &total);
+    *rate = (total > 0 && count > 8) ? (1000000 * count) / total : 0;
+    *capacity = 0;
+    if (!packet_pair_intervals_.IsEmpty()) {
+      boost::uint64_t median = packet_pair_intervals_.Median();
+      *capacity = (median > 0) ? 1000000 / median : 0;
+    }
+    return true;
+  }
+ private:
+  RudpMedianFilter<16> arrival_intervals_;
+  bptime::ptime last_arrival_time_;
+  RudpMedianFilter<16 + 1> packet_pair_intervals_;
+};
+
+// Generates packet arrival times with random gaps, mostly short but with
+// the occasional long one, as when packets are lost or a sender stalls.
+static std::vector<bptime::ptime> ArrivalTimes(size_t count) {
+  std::vector<bptime::ptime> times;
+  bptime::ptime now(bptime::time_from_string("2011-01-01 00:00:00"));
+  for (size_t i = 0; i != count; ++i) {
+    boost::uint32_t gap = RandomUint32() % 100;
+    if (gap < 5)
+      gap *= 1000;
+    now += bptime::microseconds(gap);
+    times.push_back(now);
+  }
+  return times;
+}
+
+// Feeds the arrival times to an estimator, making an estimate after every
+// kPacketsPerAck packets. Returns the time taken per ack in nanoseconds.
+template <typename Estimator>
+double MeasureEstimator(const std::vector<bptime::ptime> &times,
+                        boost::uint64_t *checksum) {
+  Estimator estimator;
+  boost::uint64_t rate(0), capacity(0);
+  bptime::ptime start(bptime::microsec_clock::universal_time());
+  for (size_t i = 0; i != times.size(); ++i) {
+    estimator.OnArrival(static_cast<boost::uint32_t>(i), times[i]);
+    if (i % kPacketsPerAck == 0 && estimator.Estimate(&rate, &capacity))
+      *checksum += rate + capacity;
+  }
+  bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                start);
+  return 1000.0 * static_cast<double>(elapsed.total_microseconds()) /
+         static_cast<double>(times.size() / kPacketsPerAck);
+}
+
+TEST(RudpMedianFilterTest, BEH_MedianAndRange) {
+  RudpMedianFilter<4> filter;
+  EXPECT_TRUE(filter.IsEmpty());
+  filter.Add(30);
+  EXPECT_EQ(30U, filter.Median());
+  filter.Add(10);
+  filter.Add(20);
+  EXPECT_EQ(3U, filter.Size());
+  EXPECT_EQ(20U, filter.Median());
+
+  // Once full, the oldest value is replaced.
+  filter.Add(40);
+  filter.Add(50);
+  EXPECT_EQ(4U, filter.Size());
+  EXPECT_EQ(40U, filter.Median());
+  size_t count(0);
+  boost::uint64_t total(0);
+  filter.SumRange(15, 40, &count, &total);
+  EXPECT_EQ(2U, count);
+  EXPECT_EQ(60U, total);
+  filter.SumRange(60, 70, &count, &total);
+  EXPECT_EQ(0U, count);
+  EXPECT_EQ(0U, total);
+
+  // Equal values are each counted.
+  filter.Add(20);
+  filter.Add(20);
+  filter.Add(20);
+  filter.Add(20);
+  EXPECT_EQ(20U, filter.Median());
+  filter.SumRange(20, 20, &count, &total);
+  EXPECT_EQ(4U, count);
+
+  filter.Clear();
+  EXPECT_TRUE(filter.IsEmpty());
+}
+
+TEST(RudpMedianFilterTest, BEH_MatchesSorting) {
+  std::vector<bptime::ptime> times(ArrivalTimes(10000));
+  SortingEstimator sorting;
+  FilterEstimator filter;
+  for (size_t i = 0; i != times.size(); ++i) {
+    sorting.OnArrival(static_cast<boost::uint32_t>(i), times[i]);
+    filter.OnArrival(static_cast<boost::uint32_t>(i), times[i]);
+    boost::uint64_t sorting_rate(0), sorting_capacity(0);
+    boost::uint64_t filter_rate(0), filter_capacity(0);
+    ASSERT_EQ(sorting.Estimate(&sorting_rate, &sorting_capacity),
+              filter.Estimate(&filter_rate, &filter_capacity));
+    ASSERT_EQ(sorting_rate, filter_rate);
+    ASSERT_EQ(sorting_capacity, filter_capacity);
+  }
+}
+
+TEST(RudpMedianFilterTest, FUNC_EstimateRate) {
+  std::vector<bptime::ptime> times(ArrivalTimes(kTestPacketCount));
+  boost::uint64_t sorting_checksum(0), filter_checksum(0);
+  double sorting_time(MeasureEstimator<SortingEstimator>(times,
+                                                         &sorting_checksum));
+  double filter_time(MeasureEstimator<FilterEstimator>(times,
+                                                       &filter_checksum));
+  EXPECT_EQ(sorting_checksum, filter_checksum);
+  std::cout << "Estimated the receiving rate and link capacity every "
+            << kPacketsPerAck << " packets at " << sorting_time
+            << " ns/ack by sorting, " << filter_time
+            << " ns/ack with median filters." << std::endl;
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
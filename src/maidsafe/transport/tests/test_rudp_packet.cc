@@ -25,6 +25,11 @@ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
 THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "maidsafe/common/test.h"
 
 #include "maidsafe/transport/log.h"
@@ -218,6 +223,55 @@ TEST_F(RudpDataPacketTest, BEH_EncodeDecode) {
   }
 }
 
+TEST_F(RudpDataPacketTest, BEH_DecodeByReference) {
+  std::string data("Decode By Reference Test");
+  data_packet_.SetPacketSequenceNumber(0x12345);
+  data_packet_.SetDestinationSocketId(0x44221100);
+  data_packet_.SetData(data);
+  std::shared_ptr<std::vector<unsigned char>> buffer(
+      std::make_shared<std::vector<unsigned char>>(RudpParameters::max_size));
+  size_t length(data_packet_.Encode(boost::asio::buffer(*buffer)));
+  ASSERT_EQ(RudpDataPacket::kHeaderSize + data.size(), length);
+  RestoreDefault();
+
+  // The payload is left in the buffer, which the packet keeps alive.
+  EXPECT_TRUE(data_packet_.Decode(boost::asio::buffer(*buffer, length),
+                                  buffer));
+  EXPECT_EQ(2, buffer.use_count());
+  EXPECT_TRUE(data_packet_.Data().empty());
+  boost::asio::const_buffer payload(data_packet_.Payload());
+  EXPECT_EQ(&(*buffer)[RudpDataPacket::kHeaderSize],
+            boost::asio::buffer_cast<const unsigned char*>(payload));
+  EXPECT_EQ(data.size(), boost::asio::buffer_size(payload));
+  EXPECT_EQ(0x12345U, data_packet_.PacketSequenceNumber());
+  EXPECT_EQ(0x44221100U, data_packet_.DestinationSocketId());
+
+  // Copies share the buffer rather than the payload being copied.
+  {
+    RudpDataPacket copy(data_packet_);
+    EXPECT_EQ(3, buffer.use_count());
+    EXPECT_EQ(boost::asio::buffer_cast<const void*>(payload),
+              boost::asio::buffer_cast<const void*>(copy.Payload()));
+  }
+  EXPECT_EQ(2, buffer.use_count());
+
+  // A packet decoded by reference encodes its payload like any other.
+  char encoded[256];
+  ASSERT_EQ(length, data_packet_.Encode(boost::asio::buffer(encoded)));
+  EXPECT_EQ(0, std::memcmp(encoded, &(*buffer)[0], length));
+
+  // Clearing the packet, or giving it a payload of its own, releases the
+  // buffer.
+  data_packet_.Clear();
+  EXPECT_EQ(1, buffer.use_count());
+  EXPECT_EQ(0U, boost::asio::buffer_size(data_packet_.Payload()));
+  EXPECT_TRUE(data_packet_.Decode(boost::asio::buffer(*buffer, length),
+                                  buffer));
+  data_packet_.SetData("x");
+  EXPECT_EQ(1, buffer.use_count());
+  EXPECT_EQ(1U, boost::asio::buffer_size(data_packet_.Payload()));
+}
+
 class RudpControlPacketTest : public testing::Test {
  public:
   RudpControlPacketTest() : control_packet_() {}
@@ -324,6 +378,45 @@ TEST_F(RudpControlPacketTest, BEH_EncodeDecode) {
   TestEncodeDecode();
 }
 
+TEST(RudpControlPacketTypeTest, FUNC_DecodeType) {
+  boost::uint16_t type(0xffff);
+  {
+    // Buffer length too short
+    char d[15] = { static_cast<char>(0x80) };
+    EXPECT_FALSE(RudpControlPacket::DecodeType(&type, boost::asio::buffer(d)));
+  }
+  {
+    // A data packet
+    RudpDataPacket data_packet;
+    data_packet.SetPacketSequenceNumber(0x7fffffff);
+    char d[RudpDataPacket::kHeaderSize];
+    ASSERT_EQ(sizeof(d), data_packet.Encode(boost::asio::buffer(d)));
+    EXPECT_FALSE(RudpControlPacket::DecodeType(&type, boost::asio::buffer(d)));
+    EXPECT_EQ(0xffff, type);
+  }
+  {
+    RudpShutdownPacket shutdown_packet;
+    char d[RudpControlPacket::kHeaderSize];
+    ASSERT_EQ(sizeof(d), shutdown_packet.Encode(boost::asio::buffer(d)));
+    EXPECT_TRUE(RudpControlPacket::DecodeType(&type, boost::asio::buffer(d)));
+    EXPECT_EQ(RudpShutdownPacket::kPacketType, type);
+  }
+  {
+    RudpAckOfAckPacket ack_of_ack_packet;
+    ack_of_ack_packet.SetAckSequenceNumber(0x12345678);
+    char d[RudpControlPacket::kHeaderSize];
+    ASSERT_EQ(sizeof(d), ack_of_ack_packet.Encode(boost::asio::buffer(d)));
+    EXPECT_TRUE(RudpControlPacket::DecodeType(&type, boost::asio::buffer(d)));
+    EXPECT_EQ(RudpAckOfAckPacket::kPacketType, type);
+  }
+  {
+    // The type field is 15 bits wide
+    char d[RudpControlPacket::kHeaderSize] = { static_cast<char>(0xf4), 0x44 };
+    EXPECT_TRUE(RudpControlPacket::DecodeType(&type, boost::asio::buffer(d)));
+    EXPECT_EQ(0x7444, type);
+  }
+}
+
 class RudpAckPacketTest : public testing::Test {
  public:
   RudpAckPacketTest() : ack_packet_() {}
@@ -0,0 +1,149 @@
+/* Copyright (c) 2011 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MAIDSAFE_TRANSPORT_TESTS_TEST_RUDP_PEER_H_
+#define MAIDSAFE_TRANSPORT_TESTS_TEST_RUDP_PEER_H_
+
+#include <array>
+#include <vector>
+
+#include "boost/asio/io_service.hpp"
+#include "boost/asio/ip/udp.hpp"
+#include "boost/cstdint.hpp"
+#include "maidsafe/transport/rudp_ack_packet.h"
+#include "maidsafe/transport/rudp_control_packet.h"
+#include "maidsafe/transport/rudp_data_packet.h"
+#include "maidsafe/transport/rudp_multiplexer.h"
+#include "maidsafe/transport/rudp_negative_ack_packet.h"
+#include "maidsafe/transport/rudp_parameters.h"
+#include "maidsafe/transport/rudp_peer.h"
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+typedef std::vector<boost::uint32_t> SequenceNumbers;
+typedef std::vector<RudpNegativeAckPacket::Range> Ranges;
+
+// The remote end of a RudpSender or RudpReceiver driven directly by a test.
+// What they send to the peer goes through a multiplexer to a plain UDP
+// socket, from which the test collects the packets of interest. Loopback
+// datagrams are queued on the socket by the time the send returns, so the
+// packets sent so far can be collected without waiting.
+class TestRudpPeer {
+ public:
+  explicit TestRudpPeer(boost::asio::io_service &io_service)  // NOLINT
+      : multiplexer_(io_service),
+        peer_(multiplexer_),
+        socket_(io_service),
+        data_packets_(),
+        acks_(),
+        negative_acks_() {
+    boost::asio::ip::udp::endpoint loopback(
+        boost::asio::ip::address_v4::loopback(), 0);
+    multiplexer_.Open(loopback.protocol());
+    socket_.open(loopback.protocol());
+    socket_.bind(loopback);
+    peer_.SetEndpoint(socket_.local_endpoint());
+    peer_.SetId(1);
+  }
+
+  RudpPeer &Peer() { return peer_; }
+
+  // The sequence numbers of the data packets sent since last called, in the
+  // order sent.
+  SequenceNumbers TakeDataPackets() {
+    Receive();
+    SequenceNumbers result;
+    result.swap(data_packets_);
+    return result;
+  }
+
+  // The packet sequence numbers of the acknowledgements sent since last
+  // called.
+  SequenceNumbers TakeAcks() {
+    Receive();
+    SequenceNumbers result;
+    result.swap(acks_);
+    return result;
+  }
+
+  // The ranges of each negative acknowledgement sent since last called.
+  std::vector<Ranges> TakeNegativeAcks() {
+    Receive();
+    std::vector<Ranges> result;
+    result.swap(negative_acks_);
+    return result;
+  }
+
+ private:
+  TestRudpPeer(const TestRudpPeer&);
+  TestRudpPeer &operator=(const TestRudpPeer&);
+
+  void Receive() {
+    std::array<unsigned char, RudpParameters::kUDPPayload> buffer;
+    while (socket_.available() != 0) {
+      size_t length(socket_.receive(boost::asio::buffer(buffer)));
+      boost::asio::const_buffer data(&buffer[0], length);
+      boost::uint16_t type(0);
+      if (RudpDataPacket::IsValid(data)) {
+        RudpDataPacket packet;
+        if (packet.Decode(data))
+          data_packets_.push_back(packet.PacketSequenceNumber());
+      } else if (RudpControlPacket::DecodeType(&type, data)) {
+        if (type == RudpAckPacket::kPacketType) {
+          RudpAckPacket packet;
+          if (packet.Decode(data))
+            acks_.push_back(packet.PacketSequenceNumber());
+        } else if (type == RudpNegativeAckPacket::kPacketType) {
+          RudpNegativeAckPacket packet;
+          if (packet.Decode(data)) {
+            negative_acks_.push_back(Ranges());
+            packet.GetRanges(&negative_acks_.back());
+          }
+        }
+      }
+    }
+  }
+
+  RudpMultiplexer multiplexer_;
+  RudpPeer peer_;
+  boost::asio::ip::udp::socket socket_;
+  SequenceNumbers data_packets_, acks_;
+  std::vector<Ranges> negative_acks_;
+};
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_TESTS_TEST_RUDP_PEER_H_
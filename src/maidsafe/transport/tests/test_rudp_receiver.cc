@@ -0,0 +1,209 @@
+/* Copyright (c) 2011 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/asio/io_service.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/rudp_congestion_control.h"
+#include "maidsafe/transport/rudp_data_packet.h"
+#include "maidsafe/transport/rudp_negative_ack_packet.h"
+#include "maidsafe/transport/rudp_parameters.h"
+#include "maidsafe/transport/rudp_receiver.h"
+#include "maidsafe/transport/rudp_sliding_window.h"
+#include "maidsafe/transport/rudp_tick_timer.h"
+#include "maidsafe/transport/tests/test_rudp_peer.h"
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+namespace {
+
+const boost::uint32_t kMaxSequenceNumber =
+    RudpSlidingWindow<int>::kMaxSequenceNumber;  // NOLINT (Fraser)
+
+std::vector<Ranges> NegativeAcks(const Ranges &ranges) {
+  return std::vector<Ranges>(1, ranges);
+}
+
+}  // unnamed namespace
+
+class RudpReceiverTest : public testing::Test {
+ protected:
+  RudpReceiverTest()
+      : io_service_(),
+        peer_(io_service_),
+        tick_timer_(io_service_),
+        congestion_control_(),
+        receiver_(),
+        ack_interval_(RudpParameters::ack_interval),
+        default_receive_timeout_(RudpParameters::default_receive_timeout) {}
+
+  // An acknowledgement is sent on every tick which has something new to
+  // acknowledge, and missing packets are requested 100 ms after they were
+  // first expected.
+  virtual void SetUp() {
+    RudpParameters::ack_interval = bptime::time_duration();
+    RudpParameters::default_receive_timeout = bptime::milliseconds(100);
+    congestion_control_.reset(new RudpCongestionControl);
+    receiver_.reset(new RudpReceiver(peer_.Peer(), tick_timer_,
+                                     *congestion_control_));
+  }
+
+  virtual void TearDown() {
+    RudpParameters::ack_interval = ack_interval_;
+    RudpParameters::default_receive_timeout = default_receive_timeout_;
+  }
+
+  void Data(boost::uint32_t seqnum) {
+    RudpDataPacket packet;
+    packet.SetPacketSequenceNumber(seqnum);
+    packet.SetData(std::string(1, 'a'));
+    receiver_->HandleData(packet);
+  }
+
+  // Acknowledgements are only sent once the clock has moved on since the last
+  // tick.
+  void Tick() {
+    Sleep(bptime::milliseconds(1));
+    receiver_->HandleTick();
+  }
+
+  // Waits until the missing packets reserved so far have timed out.
+  void TickAfterTimeout() {
+    Sleep(bptime::milliseconds(150));
+    receiver_->HandleTick();
+  }
+
+  boost::asio::io_service io_service_;
+  TestRudpPeer peer_;
+  RudpTickTimer tick_timer_;
+  std::unique_ptr<RudpCongestionControl> congestion_control_;
+  std::unique_ptr<RudpReceiver> receiver_;
+
+ private:
+  bptime::time_duration ack_interval_, default_receive_timeout_;
+};
+
+TEST_F(RudpReceiverTest, BEH_OutOfOrder) {
+  receiver_->Reset(1000);
+  Data(1000);
+  Data(1001);
+  Data(1004);
+  Data(1003);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, 1002), peer_.TakeAcks());
+  EXPECT_TRUE(peer_.TakeNegativeAcks().empty());
+
+  // Nothing new to acknowledge.
+  Data(1001);
+  Tick();
+  EXPECT_TRUE(peer_.TakeAcks().empty());
+
+  // Filling the hole acknowledges everything received.
+  Data(1002);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, 1005), peer_.TakeAcks());
+  TickAfterTimeout();
+  EXPECT_TRUE(peer_.TakeNegativeAcks().empty());
+}
+
+TEST_F(RudpReceiverTest, BEH_MissingPackets) {
+  receiver_->Reset(1000);
+  Data(1000);
+  Data(1003);
+  Data(1006);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, 1001), peer_.TakeAcks());
+  EXPECT_TRUE(peer_.TakeNegativeAcks().empty());
+
+  Ranges ranges;
+  ranges.push_back(RudpNegativeAckPacket::Range(1001, 1002));
+  ranges.push_back(RudpNegativeAckPacket::Range(1004, 1005));
+  TickAfterTimeout();
+  EXPECT_EQ(NegativeAcks(ranges), peer_.TakeNegativeAcks());
+
+  // The packets requested are only requested again once the renewed
+  // reservation has timed out, and only those still missing then.
+  Data(1004);
+  Tick();
+  EXPECT_TRUE(peer_.TakeNegativeAcks().empty());
+  EXPECT_TRUE(peer_.TakeAcks().empty());
+  ranges.back().first = 1005;
+  TickAfterTimeout();
+  EXPECT_EQ(NegativeAcks(ranges), peer_.TakeNegativeAcks());
+
+  Data(1002);
+  Data(1001);
+  Data(1005);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, 1007), peer_.TakeAcks());
+  TickAfterTimeout();
+  EXPECT_TRUE(peer_.TakeNegativeAcks().empty());
+}
+
+TEST_F(RudpReceiverTest, BEH_Wraparound) {
+  receiver_->Reset(kMaxSequenceNumber - 1);
+  Data(kMaxSequenceNumber - 1);
+  Data(2);
+  Data(1);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, kMaxSequenceNumber), peer_.TakeAcks());
+
+  // The range of missing packets wraps around.
+  TickAfterTimeout();
+  EXPECT_EQ(NegativeAcks(Ranges(1, RudpNegativeAckPacket::Range(
+                kMaxSequenceNumber, 0))),
+            peer_.TakeNegativeAcks());
+
+  Data(kMaxSequenceNumber);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, 0), peer_.TakeAcks());
+  TickAfterTimeout();
+  EXPECT_EQ(NegativeAcks(Ranges(1, RudpNegativeAckPacket::Range(0, 0))),
+            peer_.TakeNegativeAcks());
+
+  Data(0);
+  Tick();
+  EXPECT_EQ(SequenceNumbers(1, 3), peer_.TakeAcks());
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
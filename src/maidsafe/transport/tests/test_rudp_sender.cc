@@ -0,0 +1,279 @@
+/* Copyright (c) 2011 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/asio/io_service.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/rudp_ack_packet.h"
+#include "maidsafe/transport/rudp_congestion_algorithm.h"
+#include "maidsafe/transport/rudp_congestion_control.h"
+#include "maidsafe/transport/rudp_negative_ack_packet.h"
+#include "maidsafe/transport/rudp_parameters.h"
+#include "maidsafe/transport/rudp_sender.h"
+#include "maidsafe/transport/rudp_sliding_window.h"
+#include "maidsafe/transport/rudp_tick_timer.h"
+#include "maidsafe/transport/tests/test_rudp_peer.h"
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+namespace {
+
+const boost::uint32_t kMaxSequenceNumber =
+    RudpSlidingWindow<int>::kMaxSequenceNumber;  // NOLINT (Fraser)
+
+// Sends fixed size packets without pacing, and records the losses reported
+// to it.
+class CountingCongestion : public RudpCongestionAlgorithm {
+ public:
+  CountingCongestion(SequenceNumbers *negative_acks,
+                     SequenceNumbers *send_timeouts)
+      : negative_acks_(negative_acks), send_timeouts_(send_timeouts) {}
+  virtual void OnAck(const RudpAckSample&) {}
+  virtual void OnNegativeAck(boost::uint32_t seqnum, const bptime::ptime&) {
+    negative_acks_->push_back(seqnum);
+  }
+  virtual void OnSendTimeout(boost::uint32_t seqnum, const bptime::ptime&) {
+    send_timeouts_->push_back(seqnum);
+  }
+  virtual void OnAckOfAck(boost::uint32_t, const bptime::ptime&) {}
+  virtual size_t SendWindowSize() const { return 64; }
+  virtual size_t SendDataSize() const { return 100; }
+  virtual bptime::time_duration SendDelay() const {
+    return bptime::time_duration();
+  }
+
+ private:
+  SequenceNumbers *negative_acks_, *send_timeouts_;
+};
+
+SequenceNumbers Sequence(boost::uint32_t first, size_t count) {
+  SequenceNumbers result;
+  for (size_t i = 0; i != count; ++i)
+    result.push_back((first + static_cast<boost::uint32_t>(i)) &
+                     kMaxSequenceNumber);
+  return result;
+}
+
+}  // unnamed namespace
+
+class RudpSenderTest : public testing::Test {
+ protected:
+  RudpSenderTest()
+      : io_service_(),
+        peer_(io_service_),
+        tick_timer_(io_service_),
+        congestion_control_(),
+        sender_(),
+        negative_acks_(),
+        send_timeouts_(),
+        max_send_burst_(RudpParameters::max_send_burst),
+        default_send_timeout_(RudpParameters::default_send_timeout) {}
+
+  virtual void SetUp() {
+    RudpParameters::max_send_burst = 64;
+    RudpParameters::default_send_timeout = bptime::milliseconds(200);
+    congestion_control_.reset(new RudpCongestionControl);
+    congestion_control_->SetAlgorithm(std::unique_ptr<RudpCongestionAlgorithm>(
+        new CountingCongestion(&negative_acks_, &send_timeouts_)));
+    sender_.reset(new RudpSender(peer_.Peer(), tick_timer_,
+                                 *congestion_control_));
+  }
+
+  virtual void TearDown() {
+    RudpParameters::max_send_burst = max_send_burst_;
+    RudpParameters::default_send_timeout = default_send_timeout_;
+  }
+
+  // Starts the sender's window at the given sequence number, and adds data
+  // for the given number of packets.
+  void Start(boost::uint32_t initial_sequence_number, size_t packet_count) {
+    sender_->unacked_packets_.Reset(initial_sequence_number);
+    std::string data(RandomString(packet_count * 100));
+    ASSERT_EQ(data.size(), sender_->AddData(boost::asio::buffer(data)));
+  }
+
+  void Ack(boost::uint32_t seqnum) {
+    RudpAckPacket packet;
+    packet.SetPacketSequenceNumber(seqnum);
+    sender_->HandleAck(packet);
+  }
+
+  void NegativeAck(const Ranges &ranges) {
+    RudpNegativeAckPacket packet;
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+      if (it->first == it->second)
+        packet.AddSequenceNumber(it->first);
+      else
+        packet.AddSequenceNumbers(it->first, it->second);
+    }
+    sender_->HandleNegativeAck(packet);
+  }
+
+  boost::asio::io_service io_service_;
+  TestRudpPeer peer_;
+  RudpTickTimer tick_timer_;
+  std::unique_ptr<RudpCongestionControl> congestion_control_;
+  std::unique_ptr<RudpSender> sender_;
+  SequenceNumbers negative_acks_, send_timeouts_;
+
+ private:
+  boost::uint32_t max_send_burst_;
+  bptime::time_duration default_send_timeout_;
+};
+
+TEST_F(RudpSenderTest, BEH_NegativeAck) {
+  Start(1000, 10);
+  EXPECT_EQ(Sequence(1000, 10), peer_.TakeDataPackets());
+
+  // The reported packets are sent again once each, in order.
+  Ranges ranges;
+  ranges.push_back(RudpNegativeAckPacket::Range(1007, 1007));
+  ranges.push_back(RudpNegativeAckPacket::Range(1002, 1004));
+  NegativeAck(ranges);
+  SequenceNumbers expected(Sequence(1002, 3));
+  expected.push_back(1007);
+  EXPECT_EQ(expected, peer_.TakeDataPackets());
+  EXPECT_EQ(4U, negative_acks_.size());
+
+  // Overlapping ranges in one report mark each packet lost only once.
+  negative_acks_.clear();
+  ranges.clear();
+  ranges.push_back(RudpNegativeAckPacket::Range(1001, 1003));
+  ranges.push_back(RudpNegativeAckPacket::Range(1002, 1005));
+  ranges.push_back(RudpNegativeAckPacket::Range(1003, 1003));
+  NegativeAck(ranges);
+  EXPECT_EQ(Sequence(1001, 5), peer_.TakeDataPackets());
+  EXPECT_EQ(Sequence(1001, 5), negative_acks_);
+
+  // A range reaching past the packets sent only covers those sent.
+  negative_acks_.clear();
+  ranges.clear();
+  ranges.push_back(RudpNegativeAckPacket::Range(1008, 1020));
+  NegativeAck(ranges);
+  EXPECT_EQ(Sequence(1008, 2), peer_.TakeDataPackets());
+  EXPECT_EQ(Sequence(1008, 2), negative_acks_);
+}
+
+TEST_F(RudpSenderTest, BEH_NegativeAckPartlyAcknowledged) {
+  Start(1000, 10);
+  EXPECT_EQ(Sequence(1000, 10), peer_.TakeDataPackets());
+  Ack(1005);
+
+  // Only the packets still awaiting acknowledgement are sent again.
+  Ranges ranges(1, RudpNegativeAckPacket::Range(1002, 1007));
+  NegativeAck(ranges);
+  EXPECT_EQ(Sequence(1005, 3), peer_.TakeDataPackets());
+  EXPECT_EQ(Sequence(1005, 3), negative_acks_);
+
+  // A range wholly acknowledged is ignored.
+  negative_acks_.clear();
+  ranges.assign(1, RudpNegativeAckPacket::Range(990, 1004));
+  NegativeAck(ranges);
+  EXPECT_TRUE(peer_.TakeDataPackets().empty());
+  EXPECT_TRUE(negative_acks_.empty());
+}
+
+TEST_F(RudpSenderTest, BEH_NegativeAckUnsentPackets) {
+  // With a burst of 4, only the first 4 packets are sent straight away.
+  RudpParameters::max_send_burst = 4;
+  Start(1000, 10);
+  EXPECT_EQ(Sequence(1000, 4), peer_.TakeDataPackets());
+
+  // Packets which haven't been sent yet can't be lost. The lost packets are
+  // sent before any new ones.
+  Ranges ranges(1, RudpNegativeAckPacket::Range(1002, 1008));
+  NegativeAck(ranges);
+  SequenceNumbers expected(Sequence(1002, 2));
+  expected.push_back(1004);
+  expected.push_back(1005);
+  EXPECT_EQ(expected, peer_.TakeDataPackets());
+  EXPECT_EQ(Sequence(1002, 2), negative_acks_);
+}
+
+TEST_F(RudpSenderTest, BEH_NegativeAckWrapped) {
+  Start(kMaxSequenceNumber - 3, 8);
+  EXPECT_EQ(Sequence(kMaxSequenceNumber - 3, 8), peer_.TakeDataPackets());
+
+  // A range wrapping past the maximum sequence number.
+  Ranges ranges(1, RudpNegativeAckPacket::Range(kMaxSequenceNumber - 1, 1));
+  NegativeAck(ranges);
+  EXPECT_EQ(Sequence(kMaxSequenceNumber - 1, 4), peer_.TakeDataPackets());
+  EXPECT_EQ(Sequence(kMaxSequenceNumber - 1, 4), negative_acks_);
+
+  // Once the packets before the wrap have been acknowledged, a wrapped range
+  // only covers the packets after it.
+  negative_acks_.clear();
+  Ack(0);
+  ranges.assign(1, RudpNegativeAckPacket::Range(kMaxSequenceNumber - 2, 2));
+  NegativeAck(ranges);
+  EXPECT_EQ(Sequence(0, 3), peer_.TakeDataPackets());
+  EXPECT_EQ(Sequence(0, 3), negative_acks_);
+}
+
+TEST_F(RudpSenderTest, BEH_SendTimeout) {
+  // The send timeout is 200 ms. Packet 1003 is reported lost, and so sent
+  // again, part way through the timeout of the first sending.
+  Start(1000, 4);
+  EXPECT_EQ(Sequence(1000, 4), peer_.TakeDataPackets());
+  Ack(1002);
+  Sleep(bptime::milliseconds(120));
+  sender_->HandleTick();
+  EXPECT_TRUE(peer_.TakeDataPackets().empty());
+  NegativeAck(Ranges(1, RudpNegativeAckPacket::Range(1003, 1003)));
+  EXPECT_EQ(SequenceNumbers(1, 1003), peer_.TakeDataPackets());
+
+  // Only the unacknowledged packet sent first has timed out.
+  Sleep(bptime::milliseconds(120));
+  sender_->HandleTick();
+  EXPECT_EQ(SequenceNumbers(1, 1002), peer_.TakeDataPackets());
+  EXPECT_EQ(SequenceNumbers(1, 1002), send_timeouts_);
+
+  // The timeout of the packet sent again runs from when it was sent again.
+  Sleep(bptime::milliseconds(120));
+  sender_->HandleTick();
+  EXPECT_EQ(SequenceNumbers(1, 1003), peer_.TakeDataPackets());
+  EXPECT_EQ(1003U, send_timeouts_.back());
+  EXPECT_EQ(2U, send_timeouts_.size());
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
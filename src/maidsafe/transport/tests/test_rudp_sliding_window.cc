@@ -27,8 +27,14 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // Author: Christopher M. Kohlhoff (chris at kohlhoff dot com)
 
+#include <deque>
+#include <iostream>  // NOLINT
+#include <string>
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
 #include "maidsafe/common/test.h"
 #include "maidsafe/transport/log.h"
+#include "maidsafe/transport/rudp_data_packet.h"
 #include "maidsafe/transport/rudp_sliding_window.h"
 
 namespace maidsafe {
@@ -39,6 +45,75 @@ namespace test {
 
 static const size_t kTestPacketCount = 100000;
 
+namespace bptime = boost::posix_time;
+
+// An item holding a packet, whose payload is kept when the slot is reused.
+struct PacketItem {
+  PacketItem() : packet() {}
+  void Reset() { packet.Clear(); }
+  RudpDataPacket packet;
+};
+
+// The window as it was before it became a ring buffer, which allocates an
+// item for every packet, for comparison.
+template <typename T>
+class DequeSlidingWindow {
+ public:
+  enum { kMaxSequenceNumber = 0x7fffffff };
+  explicit DequeSlidingWindow(boost::uint32_t initial_sequence_number)
+      : items_(), begin_(initial_sequence_number),
+        end_(initial_sequence_number) {}
+  boost::uint32_t Append() {
+    items_.push_back(T());
+    boost::uint32_t n = end_;
+    end_ = (end_ == kMaxSequenceNumber) ? 0 : end_ + 1;
+    return n;
+  }
+  void Remove() {
+    items_.erase(items_.begin());
+    begin_ = (begin_ == kMaxSequenceNumber) ? 0 : begin_ + 1;
+  }
+  T &operator[](boost::uint32_t n) {
+    if (begin_ <= end_)
+      return items_[n - begin_];
+    else if (n < end_)
+      return items_[kMaxSequenceNumber - begin_ + n + 1];
+    else
+      return items_[n - begin_];
+  }
+  boost::uint32_t Begin() const { return begin_; }
+ private:
+  std::deque<T> items_;
+  boost::uint32_t begin_, end_;
+};
+
+// Keeps a window of window_size packets moving as a sender's would, filling
+// each packet as it is appended and reading it back before it is removed.
+// Returns the time taken per packet in nanoseconds.
+template <typename Window>
+double MeasureWindow(Window *window, size_t window_size) {
+  const std::string kPayload(1000, 'x');
+  size_t checksum(0);
+  bptime::ptime start(bptime::microsec_clock::universal_time());
+  for (size_t i = 0; i != window_size; ++i) {
+    boost::uint32_t n = window->Append();
+    (*window)[n].packet.SetPacketSequenceNumber(n);
+    (*window)[n].packet.SetData(kPayload);
+  }
+  for (size_t i = 0; i != kTestPacketCount; ++i) {
+    checksum += (*window)[window->Begin()].packet.Data().size();
+    window->Remove();
+    boost::uint32_t n = window->Append();
+    (*window)[n].packet.SetPacketSequenceNumber(n);
+    (*window)[n].packet.SetData(kPayload);
+  }
+  bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                start);
+  EXPECT_EQ(kTestPacketCount * kPayload.size(), checksum);
+  return 1000.0 * static_cast<double>(elapsed.total_microseconds()) /
+         static_cast<double>(kTestPacketCount);
+}
+
 static void TestWindowRange(boost::uint32_t first_sequence_number) {
   RudpSlidingWindow<boost::uint32_t> window(first_sequence_number);
 
@@ -49,9 +124,11 @@ static void TestWindowRange(boost::uint32_t first_sequence_number) {
 
   for (size_t i = 0; i < kTestPacketCount; ++i) {
     ASSERT_EQ(window.Begin(), window[window.Begin()]);
+    ASSERT_EQ(window.Begin(), window.Front());
     window.Remove();
     boost::uint32_t n = window.Append();
     window[n] = n;
+    ASSERT_EQ(n, window.Back());
   }
 
   for (size_t i = 0; i < window.MaximumSize(); ++i) {
@@ -73,6 +150,42 @@ TEST(RudpSlidingWindowTest, BEH_Wraparound) {
                   kTestPacketCount / 2);
 }
 
+TEST(RudpSlidingWindowTest, BEH_ReuseSlots) {
+  RudpSlidingWindow<PacketItem> window(
+      RudpSlidingWindow<PacketItem>::kMaxSequenceNumber - 4);
+  boost::uint32_t first = window.Append();
+  window[first].packet.SetPacketSequenceNumber(first);
+  window[first].packet.SetData(std::string(1000, 'x'));
+  const PacketItem *slot = &window[first];
+  window.Remove();
+
+  // Once the window has gone round the ring, across the wraparound of the
+  // sequence numbers, the first slot is reused with its payload's storage but
+  // none of its content.
+  size_t appended(0);
+  boost::uint32_t n = window.Append();
+  while (&window[n] != slot && appended++ < 4096) {
+    window.Remove();
+    n = window.Append();
+  }
+  ASSERT_EQ(slot, &window[n]);
+  EXPECT_LT(n, first);
+  EXPECT_EQ(0U, window[n].packet.PacketSequenceNumber());
+  EXPECT_TRUE(window[n].packet.Data().empty());
+  EXPECT_LE(1000U, window[n].packet.Data().capacity());
+}
+
+TEST(RudpSlidingWindowTest, FUNC_AppendRemoveRate) {
+  const size_t kWindowSize(RudpParameters::default_window_size);
+  RudpSlidingWindow<PacketItem> ring(123456);
+  DequeSlidingWindow<PacketItem> deque(123456);
+  double ring_time(MeasureWindow(&ring, kWindowSize));
+  double deque_time(MeasureWindow(&deque, kWindowSize));
+  std::cout << "Moved a window of " << kWindowSize << " packets on at "
+            << ring_time << " ns/packet with a ring buffer, " << deque_time
+            << " ns/packet with a deque." << std::endl;
+}
+
 }  // namespace test
 
 }  // namespace transport
@@ -27,9 +27,13 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 // Author: Christopher M. Kohlhoff (chris at kohlhoff dot com)
 
+#include <deque>
 #include <functional>
+#include <iostream>  // NOLINT
+#include <memory>
 #include <vector>
 
+#include "boost/asio/deadline_timer.hpp"
 #include "maidsafe/common/test.h"
 #include "maidsafe/transport/log.h"
 #include "maidsafe/transport/rudp_acceptor.h"
@@ -40,6 +44,7 @@ namespace asio = boost::asio;
 namespace ip = asio::ip;
 namespace bs = boost::system;
 namespace args = std::placeholders;
+namespace bptime = boost::posix_time;
 
 namespace maidsafe {
 
@@ -62,6 +67,198 @@ void handler1(const bs::error_code &ec, bs::error_code *out_ec) {
   *out_ec = ec;
 }
 
+// Forwards datagrams between a client and a server after a fixed delay in
+// each direction, to emulate a link with a longer round trip time.
+class DelayRelay {
+ public:
+  DelayRelay(asio::io_service &io_service,  // NOLINT
+             const ip::udp::endpoint &server_endpoint,
+             const bptime::time_duration &delay)
+      : client_side_(io_service, ip::udp::endpoint(ip::address_v4::loopback(),
+                                                   0)),
+        server_side_(io_service, ip::udp::endpoint(ip::address_v4::loopback(),
+                                                   0)),
+        client_endpoint_(),
+        server_endpoint_(server_endpoint),
+        delay_(delay),
+        to_server_(io_service),
+        to_client_(io_service) {
+    StartReceive(&client_side_, &to_server_);
+    StartReceive(&server_side_, &to_client_);
+  }
+
+  // The endpoint to which the client connects.
+  ip::udp::endpoint Endpoint() const { return client_side_.local_endpoint(); }
+
+  void Close() {
+    bs::error_code ec;
+    client_side_.close(ec);
+    server_side_.close(ec);
+    to_server_.timer.cancel(ec);
+    to_client_.timer.cancel(ec);
+  }
+
+ private:
+  typedef std::shared_ptr<std::vector<unsigned char>> Datagram;
+  // The datagrams travelling in one direction, in the order they arrived.
+  struct Direction {
+    explicit Direction(asio::io_service &io_service)  // NOLINT
+        : timer(io_service), queue(), receive_buffer(), sender() {}
+    asio::deadline_timer timer;
+    std::deque<std::pair<bptime::ptime, Datagram>> queue;
+    Datagram receive_buffer;
+    ip::udp::endpoint sender;
+  };
+
+  void StartReceive(ip::udp::socket *socket, Direction *direction) {
+    direction->receive_buffer.reset(new std::vector<unsigned char>(65536));
+    socket->async_receive_from(asio::buffer(*direction->receive_buffer),
+                               direction->sender,
+                               std::bind(&DelayRelay::HandleReceive, this,
+                                         socket, direction, args::_1,
+                                         args::_2));
+  }
+
+  void HandleReceive(ip::udp::socket *socket,
+                     Direction *direction,
+                     const bs::error_code &ec,
+                     size_t length) {
+    if (ec)
+      return;
+    if (socket == &client_side_)
+      client_endpoint_ = direction->sender;
+    direction->receive_buffer->resize(length);
+    direction->queue.push_back(std::make_pair(
+        asio::deadline_timer::traits_type::now() + delay_,
+        direction->receive_buffer));
+    if (direction->queue.size() == 1)
+      StartTimer(direction);
+    StartReceive(socket, direction);
+  }
+
+  void StartTimer(Direction *direction) {
+    direction->timer.expires_at(direction->queue.front().first);
+    direction->timer.async_wait(std::bind(&DelayRelay::HandleTimer, this,
+                                          direction, args::_1));
+  }
+
+  void HandleTimer(Direction *direction, const bs::error_code &ec) {
+    if (ec)
+      return;
+    bptime::ptime now = asio::deadline_timer::traits_type::now();
+    while (!direction->queue.empty() && direction->queue.front().first <= now) {
+      bs::error_code send_ec;
+      if (direction == &to_server_)
+        server_side_.send_to(asio::buffer(*direction->queue.front().second),
+                             server_endpoint_, 0, send_ec);
+      else
+        client_side_.send_to(asio::buffer(*direction->queue.front().second),
+                             client_endpoint_, 0, send_ec);
+      direction->queue.pop_front();
+    }
+    if (!direction->queue.empty())
+      StartTimer(direction);
+  }
+
+  ip::udp::socket client_side_, server_side_;
+  ip::udp::endpoint client_endpoint_, server_endpoint_;
+  bptime::time_duration delay_;
+  Direction to_server_, to_client_;
+};
+
+// Connects a client socket to a server socket, through a relay delaying each
+// datagram by one_way_delay if that is non-zero, and writes messages of
+// message_size bytes from the client to the server for up to kMaxDuration.
+// Returns the rate at which the server read them in MB/s.
+double MeasureThroughput(RudpParameters::CongestionAlgorithm algorithm,
+                         const bptime::time_duration &one_way_delay,
+                         size_t message_size,
+                         size_t iterations) {
+  const bptime::time_duration kMaxDuration(bptime::seconds(20));
+  asio::io_service io_service;
+  bs::error_code server_ec;
+  bs::error_code client_ec;
+
+  RudpMultiplexer server_multiplexer(io_service);
+  ip::udp::endpoint server_endpoint(ip::address_v4::loopback(), 2100);
+  while (server_multiplexer.Open(server_endpoint) != kSuccess)
+    server_endpoint.port(server_endpoint.port() + 1);
+  RudpMultiplexer client_multiplexer(io_service);
+  EXPECT_EQ(kSuccess, client_multiplexer.Open(ip::udp::v4()));
+
+  std::unique_ptr<DelayRelay> relay;
+  ip::udp::endpoint connect_endpoint(server_endpoint);
+  if (one_way_delay > bptime::time_duration()) {
+    relay.reset(new DelayRelay(io_service, server_endpoint, one_way_delay));
+    connect_endpoint = relay->Endpoint();
+  }
+
+  server_multiplexer.AsyncDispatch(std::bind(&dispatch_handler, args::_1,
+                                             &server_multiplexer));
+  client_multiplexer.AsyncDispatch(std::bind(&dispatch_handler, args::_1,
+                                             &client_multiplexer));
+  RudpAcceptor server_acceptor(server_multiplexer);
+  RudpSocket server_socket(server_multiplexer);
+  server_socket.SetCongestionAlgorithm(algorithm);
+  server_ec = asio::error::would_block;
+  server_acceptor.AsyncAccept(server_socket, std::bind(&handler1, args::_1,
+                                                       &server_ec));
+  RudpSocket client_socket(client_multiplexer);
+  client_socket.SetCongestionAlgorithm(algorithm);
+  client_ec = asio::error::would_block;
+  client_socket.AsyncConnect(connect_endpoint, std::bind(&handler1, args::_1,
+                                                         &client_ec));
+  do {
+    io_service.run_one();
+  } while (server_ec == asio::error::would_block);
+  EXPECT_FALSE(server_ec);
+  server_ec = asio::error::would_block;
+  server_socket.AsyncConnect(std::bind(&handler1, args::_1, &server_ec));
+  do {
+    io_service.run_one();
+  } while (server_ec == asio::error::would_block ||
+           client_ec == asio::error::would_block);
+  EXPECT_FALSE(server_ec);
+  EXPECT_FALSE(client_ec);
+  server_socket.AsyncTick(std::bind(&tick_handler, args::_1, &server_socket));
+  client_socket.AsyncTick(std::bind(&tick_handler, args::_1, &client_socket));
+
+  std::vector<unsigned char> server_buffer(message_size);
+  std::vector<unsigned char> client_buffer(message_size, 'A');
+  size_t bytes_read(0);
+  bptime::ptime start(asio::deadline_timer::traits_type::now());
+  bptime::ptime deadline(start + kMaxDuration);
+  for (size_t i = 0; i < iterations &&
+       asio::deadline_timer::traits_type::now() < deadline; ++i) {
+    server_ec = asio::error::would_block;
+    server_socket.AsyncRead(asio::buffer(server_buffer), message_size,
+                            std::bind(&handler1, args::_1, &server_ec));
+    client_ec = asio::error::would_block;
+    client_socket.AsyncWrite(asio::buffer(client_buffer),
+                             std::bind(&handler1, args::_1, &client_ec));
+    do {
+      io_service.run_one();
+    } while ((server_ec == asio::error::would_block ||
+              client_ec == asio::error::would_block) &&
+             asio::deadline_timer::traits_type::now() < deadline);
+    if (server_ec || client_ec)
+      break;
+    bytes_read += message_size;
+  }
+  bptime::time_duration elapsed(asio::deadline_timer::traits_type::now() -
+                                start);
+
+  server_socket.Close();
+  client_socket.Close();
+  if (relay)
+    relay->Close();
+  server_multiplexer.Close();
+  client_multiplexer.Close();
+  io_service.run();
+  return static_cast<double>(bytes_read) /
+         static_cast<double>(elapsed.total_microseconds());
+}
+
 TEST(RudpSocketTest, BEH_Socket) {
   asio::io_service io_service;
   bs::error_code server_ec;
@@ -115,13 +312,17 @@ TEST(RudpSocketTest, BEH_Socket) {
 
   client_socket.AsyncTick(std::bind(&tick_handler, args::_1, &client_socket));
 
+  // The data is read straight out of the buffers it was received into, which
+  // are reused once read, so far fewer buffers are needed than packets.
   for (size_t i = 0; i < kIterations; ++i) {
     std::vector<unsigned char> server_buffer(kBufferSize);
     server_ec = asio::error::would_block;
     server_socket.AsyncRead(asio::buffer(server_buffer), kBufferSize,
                             std::bind(&handler1, args::_1, &server_ec));
 
-    std::vector<unsigned char> client_buffer(kBufferSize, 'A');
+    std::vector<unsigned char> client_buffer(kBufferSize);
+    for (size_t j = 0; j < kBufferSize; ++j)
+      client_buffer[j] = static_cast<unsigned char>(i + j);
     client_ec = asio::error::would_block;
     client_socket.AsyncWrite(asio::buffer(client_buffer),
                             std::bind(&handler1, args::_1, &client_ec));
@@ -132,7 +333,10 @@ TEST(RudpSocketTest, BEH_Socket) {
              client_ec == asio::error::would_block);
     ASSERT_TRUE(!server_ec);
     ASSERT_TRUE(!client_ec);
+    ASSERT_TRUE(client_buffer == server_buffer);
   }
+  EXPECT_GE(RudpParameters::maximum_window_size,
+            server_multiplexer.buffer_pool_allocations());
 
   server_ec = asio::error::would_block;
   server_socket.AsyncFlush(std::bind(&handler1, args::_1, &server_ec));
@@ -148,6 +352,112 @@ TEST(RudpSocketTest, BEH_Socket) {
   ASSERT_TRUE(!client_ec);
 }
 
+TEST(RudpSocketTest, BEH_SmallPacketsUnread) {
+  const size_t kPacketSize(100);
+  const size_t kPackets(16);
+  asio::io_service io_service;
+  bs::error_code server_ec;
+  bs::error_code client_ec;
+
+  RudpMultiplexer server_multiplexer(io_service);
+  ip::udp::endpoint server_endpoint(ip::address_v4::loopback(), 2000);
+  TransportCondition condition = server_multiplexer.Open(server_endpoint);
+  ASSERT_EQ(kSuccess, condition);
+
+  RudpMultiplexer client_multiplexer(io_service);
+  condition = client_multiplexer.Open(ip::udp::v4());
+  ASSERT_EQ(kSuccess, condition);
+
+  server_multiplexer.AsyncDispatch(std::bind(&dispatch_handler, args::_1,
+                                             &server_multiplexer));
+
+  RudpAcceptor server_acceptor(server_multiplexer);
+  RudpSocket server_socket(server_multiplexer);
+  server_ec = asio::error::would_block;
+  server_acceptor.AsyncAccept(server_socket, std::bind(&handler1, args::_1,
+                                                       &server_ec));
+
+  RudpSocket client_socket(client_multiplexer);
+  client_ec = asio::error::would_block;
+  client_socket.AsyncConnect(server_endpoint, std::bind(&handler1, args::_1,
+                                                        &client_ec));
+
+  do {
+    io_service.run_one();
+  } while (server_ec == asio::error::would_block);
+  ASSERT_TRUE(!server_ec);
+
+  server_ec = asio::error::would_block;
+  client_multiplexer.AsyncDispatch(std::bind(&dispatch_handler, args::_1,
+                                             &client_multiplexer));
+
+  server_socket.AsyncConnect(std::bind(&handler1, args::_1, &server_ec));
+
+  do {
+    io_service.run_one();
+  } while (server_ec == asio::error::would_block ||
+           client_ec == asio::error::would_block);
+  ASSERT_TRUE(!server_ec);
+  ASSERT_TRUE(!client_ec);
+
+  server_socket.AsyncTick(std::bind(&tick_handler, args::_1, &server_socket));
+
+  client_socket.AsyncTick(std::bind(&tick_handler, args::_1, &client_socket));
+
+  // Each write is flushed before the next, so it travels in a packet of its
+  // own, and none of them is read until all have arrived. Their payloads are
+  // copied out of the receive buffer, so the buffer is reused for every one.
+  std::vector<unsigned char> sent;
+  for (size_t i = 0; i < kPackets; ++i) {
+    std::vector<unsigned char> client_buffer(kPacketSize);
+    for (size_t j = 0; j < kPacketSize; ++j)
+      client_buffer[j] = static_cast<unsigned char>(i + j);
+    sent.insert(sent.end(), client_buffer.begin(), client_buffer.end());
+    client_ec = asio::error::would_block;
+    client_socket.AsyncWrite(asio::buffer(client_buffer),
+                             std::bind(&handler1, args::_1, &client_ec));
+    do {
+      io_service.run_one();
+    } while (client_ec == asio::error::would_block);
+    ASSERT_TRUE(!client_ec);
+
+    client_ec = asio::error::would_block;
+    client_socket.AsyncFlush(std::bind(&handler1, args::_1, &client_ec));
+    do {
+      io_service.run_one();
+    } while (client_ec == asio::error::would_block);
+    ASSERT_TRUE(!client_ec);
+  }
+  EXPECT_EQ(1U, server_multiplexer.buffer_pool_allocations());
+
+  std::vector<unsigned char> received(sent.size());
+  server_ec = asio::error::would_block;
+  server_socket.AsyncRead(asio::buffer(received), received.size(),
+                          std::bind(&handler1, args::_1, &server_ec));
+  do {
+    io_service.run_one();
+  } while (server_ec == asio::error::would_block);
+  ASSERT_TRUE(!server_ec);
+  EXPECT_TRUE(sent == received);
+}
+
+TEST(RudpSocketTest, FUNC_Throughput) {
+  const RudpParameters::CongestionAlgorithm kAlgorithms[] = {
+      RudpParameters::kAimd, RudpParameters::kCubic, RudpParameters::kBbr };
+  const char *kNames[] = { "AIMD", "CUBIC", "BBR" };
+  for (size_t i = 0; i != sizeof(kAlgorithms) / sizeof(kAlgorithms[0]); ++i) {
+    double loopback_rate(MeasureThroughput(kAlgorithms[i],
+                                           bptime::time_duration(),
+                                           kBufferSize, 100));
+    double delayed_rate(MeasureThroughput(kAlgorithms[i],
+                                          bptime::milliseconds(25),
+                                          16 * kBufferSize, 4));
+    std::cout << kNames[i] << " transferred " << loopback_rate
+              << " MB/s on loopback, " << delayed_rate
+              << " MB/s over a 50 ms round trip." << std::endl;
+  }
+}
+
 }  // namespace test
 
 }  // namespace transport
@@ -0,0 +1,116 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <atomic>
+#include <vector>
+
+#include "maidsafe/common/asio_service.h"
+#include "maidsafe/common/test.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/timing_wheel.h"
+
+namespace bptime = boost::posix_time;
+
+namespace maidsafe {
+
+namespace transport {
+
+namespace test {
+
+static void CountExpiry(std::atomic<int> *count) {
+  ++(*count);
+}
+
+TEST(TimingWheelTest, BEH_ExpireAndCancel) {
+  AsioService asio_service;
+  asio_service.Start(2);
+  std::shared_ptr<TimingWheel> wheel(std::make_shared<TimingWheel>(
+      asio_service.service(), bptime::milliseconds(10), 8));
+
+  // Expiries span more than one revolution of the wheel, so some timers share
+  // a slot with others due a revolution earlier.
+  const size_t kTimerCount(20);
+  std::vector<TimingWheel::Timer> timers(kTimerCount);
+  std::vector<std::atomic<int>> counts(kTimerCount);
+  bptime::ptime now(TimingWheel::Now());
+  for (size_t i = 0; i != kTimerCount; ++i) {
+    counts.at(i) = 0;
+    wheel->Schedule(&timers.at(i), now + bptime::milliseconds(10 * i),
+                    std::bind(&CountExpiry, &counts.at(i)));
+  }
+  EXPECT_EQ(kTimerCount, wheel->size());
+
+  // A later expiry leaves the timer as it is, while an earlier one replaces
+  // it. An infinite expiry never schedules the timer.
+  wheel->Schedule(&timers.at(1), now + bptime::seconds(10),
+                  std::bind(&CountExpiry, &counts.at(1)));
+  wheel->Schedule(&timers.at(kTimerCount - 1), now,
+                  std::bind(&CountExpiry, &counts.at(kTimerCount - 1)));
+  TimingWheel::Timer infinite_timer;
+  std::atomic<int> infinite_count(0);
+  wheel->Schedule(&infinite_timer, bptime::ptime(bptime::pos_infin),
+                  std::bind(&CountExpiry, &infinite_count));
+  EXPECT_FALSE(infinite_timer.scheduled());
+  EXPECT_EQ(kTimerCount, wheel->size());
+
+  wheel->Cancel(&timers.at(kTimerCount / 2));
+  EXPECT_FALSE(timers.at(kTimerCount / 2).scheduled());
+  EXPECT_EQ(kTimerCount - 1, wheel->size());
+
+  // No timer should fire before its expiry.
+  Sleep(bptime::milliseconds(55));
+  for (size_t i = 6; i != kTimerCount - 1; ++i)
+    EXPECT_EQ(0, counts.at(i).load());
+
+  int count(0);
+  while (wheel->size() != 0 && count++ < 100)
+    Sleep(bptime::milliseconds(10));
+  Sleep(bptime::milliseconds(10));
+  EXPECT_EQ(0U, wheel->size());
+  for (size_t i = 0; i != kTimerCount; ++i) {
+    EXPECT_FALSE(timers.at(i).scheduled());
+    EXPECT_EQ(i == kTimerCount / 2 ? 0 : 1, counts.at(i).load());
+  }
+  EXPECT_EQ(0, infinite_count.load());
+
+  // Once empty, the wheel stops ticking and restarts when next scheduled.
+  TimingWheel::Timer timer;
+  std::atomic<int> timer_count(0);
+  wheel->Schedule(&timer, TimingWheel::Now() + bptime::milliseconds(20),
+                  std::bind(&CountExpiry, &timer_count));
+  count = 0;
+  while (timer_count == 0 && count++ < 100)
+    Sleep(bptime::milliseconds(10));
+  EXPECT_EQ(1, timer_count.load());
+  asio_service.Stop();
+}
+
+}  // namespace test
+
+}  // namespace transport
+
+}  // namespace maidsafe
@@ -63,12 +63,15 @@ bptime::time_duration RudpParameters::default_ack_timeout =
                                                     bptime::milliseconds(1000);
 bptime::time_duration RudpParameters::default_send_delay =
                                                     bptime::microseconds(1000);
+boost::uint32_t RudpParameters::max_send_burst = 4;
 bptime::time_duration RudpParameters::default_receive_delay =
                                                     bptime::milliseconds(100);
 bptime::time_duration RudpParameters::ack_interval =
                                                     bptime::milliseconds(100);
 RudpParameters::ConnectionType RudpParameters::connection_type =
                                                     RudpParameters::kWireless;
+RudpParameters::CongestionAlgorithm RudpParameters::congestion_algorithm =
+                                                    RudpParameters::kAimd;
 bptime::time_duration RudpParameters::speed_calculate_inverval =
                                                     bptime::milliseconds(1000);
 boost::uint32_t RudpParameters::slow_speed_threshold = 1024;  // b/s
@@ -101,6 +104,18 @@ void TestMessageHandler::DoOnRequestReceived(const std::string &request,
              << "\".  Responding with \"" << *response << "\"";
 }
 
+void TestMessageHandler::DoOnBufferReceived(const SharedBuffer &request,
+                                            const Info &info,
+                                            std::string *response,
+                                            Timeout *timeout) {
+  boost::mutex::scoped_lock lock(mutex_);
+  requests_received_.push_back(std::make_pair(request.ToString(), info));
+  *response = "Replied to buffer of " + boost::lexical_cast<std::string>(
+              request.size()) + " bytes";
+  responses_sent_.push_back(*response);
+  *timeout = kImmediateTimeout;
+}
+
 void TestMessageHandler::DoTimeOutOnRequestReceived(const std::string &request,
                                                     const Info &info,
                                                     std::string *response,
@@ -72,6 +72,10 @@ class TestMessageHandler {
                            const Info &info,
                            std::string *response,
                            Timeout *timeout);
+  void DoOnBufferReceived(const SharedBuffer &request,
+                          const Info &info,
+                          std::string *response,
+                          Timeout *timeout);
   void DoTimeOutOnRequestReceived(const std::string &request,
                                   const Info &info,
                                   std::string *response,
@@ -25,16 +25,750 @@ TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
 THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "boost/lexical_cast.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "maidsafe/common/asio_service.h"
+#include "maidsafe/common/utils.h"
+#include "maidsafe/transport/udp_parameters.h"
 #include "maidsafe/transport/udp_transport.h"
 #include "maidsafe/transport/tests/transport_api_test.h"
 
+namespace bptime = boost::posix_time;
+
 namespace maidsafe {
 
 namespace transport {
 
 namespace test {
 
+namespace {
+
+void CountBuffer(std::atomic<size_t> *count,
+                 const SharedBuffer&,
+                 const Info&,
+                 std::string*,
+                 Timeout*) {
+  ++(*count);
+}
+
+// Answers requests and counts responses, which are told apart by their
+// content.
+void AnswerRequest(std::atomic<size_t> *requests,
+                   std::atomic<size_t> *responses,
+                   const std::string &message,
+                   const Info&,
+                   std::string *response,
+                   Timeout*) {
+  if (message.compare(0, 7, "Request") == 0) {
+    ++(*requests);
+    *response = "Response to " + message;
+  } else {
+    ++(*responses);
+  }
+}
+
+void CountWritable(std::atomic<size_t> *count, const Endpoint&) {
+  ++(*count);
+}
+
+// Keeps each buffer received, as a handler queueing messages for later would.
+void KeepBuffer(boost::mutex *mutex,
+                std::vector<SharedBuffer> *buffers,
+                const SharedBuffer &buffer,
+                const Info&,
+                std::string*,
+                Timeout*) {
+  boost::mutex::scoped_lock lock(*mutex);
+  buffers->push_back(buffer);
+}
+
+// Answers requests received as buffers, without keeping hold of the buffers.
+void AnswerBuffer(std::atomic<size_t> *requests,
+                  const SharedBuffer&,
+                  const Info&,
+                  std::string *response,
+                  Timeout*) {
+  ++(*requests);
+  *response = "Response";
+}
+
+}  // unnamed namespace
+
+// Provides a sender and a listener sharing one service, and puts back any
+// UdpParameters a test changes, even if the test fails part way through.
+class UdpTransportTest : public testing::Test {
+ protected:
+  UdpTransportTest()
+      : asio_service_(),
+        transports_(),
+        sender_(),
+        listener_(),
+        batch_size_(UdpParameters::batch_size),
+        mtu_(UdpParameters::mtu),
+        reassembly_budget_(UdpParameters::reassembly_budget),
+        reassembly_timeout_(UdpParameters::reassembly_timeout),
+        max_retransmissions_(UdpParameters::max_retransmissions),
+        initial_retransmit_timeout_(UdpParameters::initial_retransmit_timeout),
+        response_cache_size_(UdpParameters::response_cache_size),
+        socket_count_(UdpParameters::socket_count) {}
+
+  virtual void SetUp() {
+    asio_service_.Start(kThreadGroupSize);
+    sender_ = CreateTransport();
+    listener_ = CreateTransport();
+  }
+
+  // Every transport's socket, including one opened only to send from, needs
+  // closing for the service to stop.
+  virtual void TearDown() {
+    for (auto it = transports_.begin(); it != transports_.end(); ++it)
+      (*it)->StopListening();
+    asio_service_.Stop();
+    UdpParameters::batch_size = batch_size_;
+    UdpParameters::mtu = mtu_;
+    UdpParameters::reassembly_budget = reassembly_budget_;
+    UdpParameters::reassembly_timeout = reassembly_timeout_;
+    UdpParameters::max_retransmissions = max_retransmissions_;
+    UdpParameters::initial_retransmit_timeout = initial_retransmit_timeout_;
+    UdpParameters::response_cache_size = response_cache_size_;
+    UdpParameters::socket_count = socket_count_;
+  }
+
+  std::shared_ptr<UdpTransport> CreateTransport() {
+    transports_.push_back(
+        std::make_shared<UdpTransport>(asio_service_.service()));
+    return transports_.back();
+  }
+
+  // Starts a transport listening on the first free port from the one given,
+  // and returns that port. Parameters which apply to a transport's sockets
+  // must be set before it starts listening.
+  Port Listen(const std::shared_ptr<UdpTransport> &transport,
+              Port port = 20000) {
+    while (transport->StartListening(Endpoint(kIP, port)) != kSuccess)
+      ++port;
+    return port;
+  }
+
+  // Sends kMessages small requests from one transport to another, keeping up
+  // to kWindow in flight so as not to overrun the receiver's socket buffer, and
+  // reading and writing up to batch_size datagrams per system call. Returns the
+  // rate at which they were received in packets per second, and sets received
+  // to the number received, as the receiver may still drop some.
+  double MeasurePacketRate(size_t batch_size, size_t *received) {
+    const size_t kMessages(50000), kWindow(128);
+    UdpParameters::batch_size = batch_size;
+    std::shared_ptr<UdpTransport> sender(CreateTransport());
+    std::shared_ptr<UdpTransport> listener(CreateTransport());
+    Port port(Listen(listener));
+
+    std::atomic<size_t> count(0);
+    listener->on_buffer_received()->connect(
+        boost::bind(&CountBuffer, &count, _1, _2, _3, _4));
+
+    // Datagrams which are lost would leave the window stuck, so they are
+    // written off if nothing has arrived for a while.
+    bptime::ptime start(bptime::microsec_clock::universal_time());
+    bptime::ptime last_received(start);
+    size_t sent(0), last_count(0), lost(0);
+    while (count + lost < kMessages) {
+      if (sent != kMessages && sent - count - lost < kWindow) {
+        sender->Send("Request", Endpoint(kIP, port), kImmediateTimeout);
+        ++sent;
+        continue;
+      }
+      bptime::ptime now(bptime::microsec_clock::universal_time());
+      if (count != last_count) {
+        last_count = count;
+        last_received = now;
+      } else if (now - last_received > bptime::milliseconds(100)) {
+        lost = sent - count;
+        last_received = now;
+      }
+      boost::this_thread::yield();
+    }
+    bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                  start);
+    *received = count;
+
+    sender->StopListening();
+    listener->StopListening();
+    return *received * 1000000.0 / elapsed.total_microseconds();
+  }
+
+  // Makes the transport wait for its socket to become writable, as it does
+  // once a send fails with would_block, and queues messages to the endpoint
+  // in the meantime. Sets queued to the depth of the queue once they all are.
+  void SendWhileUnwritable(const std::shared_ptr<UdpTransport> &transport,
+                           const std::vector<std::string> &messages,
+                           const Endpoint &endpoint,
+                           size_t *queued) {
+    transport->strand_.dispatch(std::bind(
+        &UdpTransportTest::DoSendWhileUnwritable, this, transport, messages,
+        endpoint, queued));
+  }
+
+  void DoSendWhileUnwritable(const std::shared_ptr<UdpTransport> &transport,
+                             const std::vector<std::string> &messages,
+                             const Endpoint &endpoint,
+                             size_t *queued) {
+    transport->WaitUntilWritable();
+    for (auto it = messages.begin(); it != messages.end(); ++it)
+      transport->Send(*it, endpoint, kImmediateTimeout);
+    *queued = transport->egress_queue_depth();
+  }
+
+  AsioService asio_service_;
+  std::vector<std::shared_ptr<UdpTransport>> transports_;
+  std::shared_ptr<UdpTransport> sender_, listener_;
+
+ private:
+  size_t batch_size_, mtu_, reassembly_budget_;
+  bptime::time_duration reassembly_timeout_;
+  size_t max_retransmissions_;
+  bptime::time_duration initial_retransmit_timeout_;
+  size_t response_cache_size_, socket_count_;
+};
+
+TEST_F(UdpTransportTest, BEH_ReceiveBuffer) {
+  Port port(Listen(listener_));
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender_->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  listener_->on_buffer_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnBufferReceived, msgh_listener, _1,
+                  _2, _3, _4));
+
+  // Each buffer must remain valid after later datagrams have been received.
+  const size_t kMessageCount(5);
+  std::vector<std::string> requests;
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    requests.push_back(RandomString(1000));
+    sender_->Send(requests.back(), Endpoint(kIP, port), bptime::seconds(1));
+  }
+  int count(0);
+  while (msgh_sender->responses_received().size() < kMessageCount &&
+         count++ < 20)
+    Sleep(bptime::milliseconds(100));
+
+  ASSERT_EQ(kMessageCount, msgh_listener->requests_received().size());
+  for (size_t i = 0; i != kMessageCount; ++i)
+    EXPECT_NE(requests.end(),
+              std::find(requests.begin(), requests.end(),
+                        msgh_listener->requests_received().at(i).first));
+  EXPECT_EQ(kMessageCount, msgh_sender->responses_received().size());
+}
+
+TEST_F(UdpTransportTest, BEH_BatchedSendAndReceive) {
+  UdpParameters::batch_size = 8;
+  Port port(Listen(listener_));
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender_->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  listener_->on_buffer_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnBufferReceived, msgh_listener, _1,
+                  _2, _3, _4));
+
+  // More requests than fit in a batch, each of which must be answered.
+  const size_t kMessageCount(20);
+  std::vector<std::string> requests;
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    requests.push_back(RandomString(1 + i * 100));
+    sender_->Send(requests.back(), Endpoint(kIP, port), bptime::seconds(2));
+  }
+  int count(0);
+  while (msgh_sender->responses_received().size() < kMessageCount &&
+         count++ < 30)
+    Sleep(bptime::milliseconds(100));
+
+  ASSERT_EQ(kMessageCount, msgh_listener->requests_received().size());
+  for (size_t i = 0; i != kMessageCount; ++i)
+    EXPECT_NE(requests.end(),
+              std::find(requests.begin(), requests.end(),
+                        msgh_listener->requests_received().at(i).first));
+  EXPECT_EQ(kMessageCount, msgh_sender->responses_received().size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+  // Requests wait in the egress queue until their batch is sent.
+  EXPECT_EQ(0U, sender_->egress_queue_depth());
+  EXPECT_LT(0U, sender_->peak_egress_queue_depth());
+}
+
+TEST_F(UdpTransportTest, BEH_SendWhenWritable) {
+  boost::asio::ip::udp::socket peer(asio_service_.service());
+  peer.open(boost::asio::ip::udp::v4());
+  peer.bind(boost::asio::ip::udp::endpoint(kIP, 0));
+  Endpoint endpoint(kIP, peer.local_endpoint().port());
+  std::vector<unsigned char> datagram(0xffff);
+  const size_t kHeaderLength(20);
+
+  // Sending over loopback never fills the socket's send buffer, so each
+  // sender is put into the state a full buffer leaves it in. The messages
+  // queued meanwhile must all be sent, in order, once the socket is found to
+  // be writable, both one at a time and in batches.
+  const size_t kBatchSizes[] = { 1, 8 };
+  const size_t kMessageCount(50);
+  for (size_t i = 0; i != sizeof(kBatchSizes) / sizeof(kBatchSizes[0]); ++i) {
+    UdpParameters::batch_size = kBatchSizes[i];
+    std::shared_ptr<UdpTransport> sender(CreateTransport());
+    sender->Send("Open", endpoint, kImmediateTimeout);
+    int count(0);
+    while (peer.available() == 0 && count++ < 100)
+      Sleep(bptime::milliseconds(10));
+    ASSERT_NE(0U, peer.available());
+    peer.receive(boost::asio::buffer(datagram));
+
+    std::vector<std::string> messages;
+    for (size_t j = 0; j != kMessageCount; ++j)
+      messages.push_back("Message " + boost::lexical_cast<std::string>(j));
+    size_t queued(0);
+    SendWhileUnwritable(sender, messages, endpoint, &queued);
+    std::vector<std::string> received;
+    count = 0;
+    while (received.size() != kMessageCount && count++ < 100) {
+      if (peer.available() == 0) {
+        Sleep(bptime::milliseconds(10));
+        continue;
+      }
+      size_t length(peer.receive(boost::asio::buffer(datagram)));
+      ASSERT_LE(kHeaderLength, length);
+      received.push_back(std::string(datagram.begin() + kHeaderLength,
+                                     datagram.begin() + length));
+    }
+    EXPECT_EQ(kMessageCount, queued);
+    EXPECT_TRUE(messages == received);
+    EXPECT_EQ(0U, sender->egress_queue_depth());
+    EXPECT_EQ(0U, peer.available());
+  }
+
+  peer.close();
+}
+
+TEST_F(UdpTransportTest, BEH_ReplyTimeouts) {
+  Port port(Listen(listener_));
+
+  // The listener never replies, so every request times out, whether or not
+  // it arrived.
+  std::atomic<size_t> count(0);
+  listener_->on_buffer_received()->connect(
+      boost::bind(&CountBuffer, &count, _1, _2, _3, _4));
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  sender_->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+
+  const size_t kMessageCount(1000);
+  const bptime::milliseconds kTimeout(200);
+  bptime::ptime start(bptime::microsec_clock::universal_time());
+  for (size_t i = 0; i != kMessageCount; ++i)
+    sender_->Send("Request", Endpoint(kIP, port), kTimeout);
+  int waited(0);
+  while (msgh_sender->results().size() < kMessageCount && waited++ < 100)
+    Sleep(bptime::milliseconds(50));
+  bptime::time_duration elapsed(bptime::microsec_clock::universal_time() -
+                                start);
+
+  Results results(msgh_sender->results());
+  ASSERT_EQ(kMessageCount, results.size());
+  EXPECT_EQ(kMessageCount, static_cast<size_t>(
+      std::count(results.begin(), results.end(), kReceiveTimeout)));
+  EXPECT_GE(elapsed, kTimeout);
+}
+
+TEST_F(UdpTransportTest, BEH_FragmentedMessages) {
+  UdpParameters::mtu = 1400;
+  Port port(Listen(listener_));
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender_->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  sender_->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  listener_->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  // Requests and their responses of up to 100 KB are split into fragments.
+  // Each is sent once the last has been answered, so as not to overrun the
+  // receiver's socket buffer.
+  const size_t kSizes[] = { 1000, 2000, 20000, 65536, 100000 };
+  const size_t kMessageCount(sizeof(kSizes) / sizeof(kSizes[0]));
+  std::vector<std::string> requests;
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    requests.push_back(RandomString(kSizes[i]));
+    sender_->Send(requests.back(), Endpoint(kIP, port), bptime::seconds(2));
+    int count(0);
+    while (msgh_sender->responses_received().size() < i + 1 &&
+           msgh_sender->results().empty() && count++ < 40)
+      Sleep(bptime::milliseconds(50));
+  }
+  ASSERT_TRUE(msgh_sender->results().empty());
+  ASSERT_EQ(kMessageCount, msgh_listener->requests_received().size());
+  ASSERT_EQ(kMessageCount, msgh_sender->responses_received().size());
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    EXPECT_EQ(requests.at(i), msgh_listener->requests_received().at(i).first);
+    EXPECT_EQ(msgh_listener->responses_sent().at(i),
+              msgh_sender->responses_received().at(i).first);
+  }
+
+  // A message larger than the reassembly budget couldn't be reassembled by a
+  // receiver with the same parameters, so it is refused before being sent.
+  UdpParameters::reassembly_budget = 10000;
+  EXPECT_EQ(10000, UdpTransport::kMaxTransportMessageSize());
+  sender_->Send(RandomString(20000), Endpoint(kIP, port),
+                bptime::milliseconds(200));
+  ASSERT_EQ(1U, msgh_sender->results().size());
+  EXPECT_EQ(kMessageSizeTooLarge, msgh_sender->results().front());
+  // The response to a smaller message is a little larger, but must still fit
+  // in the sender's budget.
+  requests.push_back(RandomString(9000));
+  sender_->Send(requests.back(), Endpoint(kIP, port), bptime::seconds(2));
+  int count(0);
+  while (msgh_sender->responses_received().size() < kMessageCount + 1 &&
+         count++ < 40)
+    Sleep(bptime::milliseconds(50));
+  ASSERT_EQ(kMessageCount + 1, msgh_listener->requests_received().size());
+  EXPECT_EQ(requests.back(),
+            msgh_listener->requests_received().back().first);
+  EXPECT_EQ(kMessageCount + 1, msgh_sender->responses_received().size());
+  EXPECT_EQ(1U, msgh_sender->results().size());
+}
+
+TEST_F(UdpTransportTest, BEH_Retransmission) {
+  UdpParameters::max_retransmissions = 3;
+  UdpParameters::initial_retransmit_timeout = bptime::milliseconds(200);
+  UdpParameters::response_cache_size = 16;
+  Port port(Listen(listener_));
+
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  sender_->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnResponseReceived, msgh_sender, _1,
+                  _2, _3, _4));
+  sender_->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  listener_->on_message_received()->connect(
+      boost::bind(&TestMessageHandler::DoOnRequestReceived, msgh_listener,
+                  _1, _2, _3, _4));
+
+  // The request is lost while the listener's socket is closed, so it only
+  // arrives when it is retransmitted.
+  listener_->StopListening();
+  Sleep(bptime::milliseconds(50));
+  sender_->Send("Request", Endpoint(kIP, port), bptime::seconds(3));
+  Sleep(bptime::milliseconds(50));
+  int count(0);
+  while (listener_->StartListening(Endpoint(kIP, port)) != kSuccess &&
+         count++ < 20)
+    Sleep(bptime::milliseconds(10));
+  count = 0;
+  while (msgh_sender->responses_received().empty() && count++ < 40)
+    Sleep(bptime::milliseconds(50));
+  EXPECT_EQ(1U, msgh_listener->requests_received().size());
+  ASSERT_EQ(1U, msgh_sender->responses_received().size());
+  EXPECT_TRUE(msgh_sender->results().empty());
+
+  // A request received twice is handled once, and answered twice with the
+  // same response.
+  boost::asio::ip::udp::socket peer(asio_service_.service());
+  peer.open(boost::asio::ip::udp::v4());
+  peer.bind(boost::asio::ip::udp::endpoint(kIP, 0));
+  const std::string kRequest("Repeated request");
+  const uint64_t kRequestId(0x123456789ULL);
+  std::vector<unsigned char> datagram(4 + 2 * sizeof(uint64_t));
+  datagram[3] = static_cast<unsigned char>(kRequest.size());
+  std::memcpy(&datagram[4], &kRequestId, sizeof(kRequestId));
+  datagram.insert(datagram.end(), kRequest.begin(), kRequest.end());
+  boost::asio::ip::udp::endpoint listener_endpoint(kIP, port);
+  peer.send_to(boost::asio::buffer(datagram), listener_endpoint);
+  count = 0;
+  while (peer.available() == 0 && count++ < 40)
+    Sleep(bptime::milliseconds(50));
+  peer.send_to(boost::asio::buffer(datagram), listener_endpoint);
+  std::vector<std::string> responses;
+  for (int i = 0; i != 2; ++i) {
+    count = 0;
+    while (peer.available() == 0 && count++ < 40)
+      Sleep(bptime::milliseconds(50));
+    ASSERT_NE(0U, peer.available());
+    std::vector<unsigned char> response(0xffff);
+    size_t length(peer.receive(boost::asio::buffer(response)));
+    ASSERT_LT(4 + 2 * sizeof(uint64_t), length);
+    uint64_t reply_to_id(0);
+    std::memcpy(&reply_to_id, &response[4 + sizeof(uint64_t)],
+                sizeof(reply_to_id));
+    EXPECT_EQ(kRequestId, reply_to_id);
+    responses.push_back(std::string(response.begin() + 4 +
+                                        2 * sizeof(uint64_t),
+                                    response.begin() + length));
+  }
+  ASSERT_EQ(2U, msgh_listener->requests_received().size());
+  EXPECT_EQ(kRequest, msgh_listener->requests_received().back().first);
+  EXPECT_EQ(msgh_listener->responses_sent().back(), responses.at(0));
+  EXPECT_EQ(responses.at(0), responses.at(1));
+
+  peer.close();
+}
+
+TEST_F(UdpTransportTest, BEH_RetransmissionWithOutboundLimits) {
+  UdpParameters::max_retransmissions = 3;
+  UdpParameters::initial_retransmit_timeout = bptime::milliseconds(100);
+  Port port(Listen(listener_));
+  std::atomic<size_t> sender_requests(0), sender_responses(0);
+  std::atomic<size_t> listener_requests(0), listener_responses(0);
+  std::atomic<size_t> writable(0);
+  sender_->on_message_received()->connect(
+      boost::bind(&AnswerRequest, &sender_requests, &sender_responses,
+                  _1, _2, _3, _4));
+  sender_->on_writable()->connect(boost::bind(&CountWritable, &writable, _1));
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  sender_->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+  listener_->on_message_received()->connect(
+      boost::bind(&AnswerRequest, &listener_requests, &listener_responses,
+                  _1, _2, _3, _4));
+
+  // Only one message may be in flight to each endpoint at a time. A request
+  // which may be retransmitted holds its place until it is answered.
+  OutboundLimits limits;
+  limits.endpoint_messages = 1;
+  sender_->SetOutboundLimits(limits);
+  const size_t kMessageCount(5);
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    sender_->Send("Request", Endpoint(kIP, port), bptime::seconds(2));
+    int count(0);
+    while (sender_responses < i + 1 && count++ < 100)
+      Sleep(bptime::milliseconds(10));
+    ASSERT_EQ(i + 1, sender_responses);
+  }
+  EXPECT_EQ(kMessageCount, listener_requests);
+  EXPECT_TRUE(msgh_sender->results().empty());
+
+  // A request which is never answered is retransmitted until it times out,
+  // and then gives up its place. Until then, other messages to the same peer
+  // are refused.
+  boost::asio::ip::udp::socket silent_peer(asio_service_.service());
+  silent_peer.open(boost::asio::ip::udp::v4());
+  silent_peer.bind(boost::asio::ip::udp::endpoint(kIP, 0));
+  Endpoint silent_endpoint(kIP, silent_peer.local_endpoint().port());
+  sender_->Send("Request", silent_endpoint, bptime::milliseconds(500));
+  sender_->Send("Request", silent_endpoint, bptime::milliseconds(500));
+  int count(0);
+  while (msgh_sender->results().size() < 2 && count++ < 200)
+    Sleep(bptime::milliseconds(10));
+  ASSERT_EQ(2U, msgh_sender->results().size());
+  EXPECT_EQ(kSendStalled, msgh_sender->results().at(0));
+  EXPECT_EQ(kReceiveTimeout, msgh_sender->results().at(1));
+  EXPECT_EQ(1U, writable);
+  size_t transmissions(0);
+  std::vector<unsigned char> datagram(0xffff);
+  while (silent_peer.available() != 0) {
+    silent_peer.receive(boost::asio::buffer(datagram));
+    ++transmissions;
+  }
+  EXPECT_LT(1U, transmissions);
+
+  sender_->Send("Message", silent_endpoint, kImmediateTimeout);
+  count = 0;
+  while (silent_peer.available() == 0 && count++ < 100)
+    Sleep(bptime::milliseconds(10));
+  EXPECT_NE(0U, silent_peer.available());
+  EXPECT_EQ(2U, msgh_sender->results().size());
+
+  silent_peer.close();
+}
+
+TEST_F(UdpTransportTest, BEH_OutboundLimitsAcrossEndpoints) {
+  // Requests which may be retransmitted hold their places until they time
+  // out, rather than just until they have been sent.
+  UdpParameters::max_retransmissions = 3;
+  std::atomic<size_t> writable(0);
+  sender_->on_writable()->connect(boost::bind(&CountWritable, &writable, _1));
+  TestMessageHandlerPtr msgh_sender(new TestMessageHandler("Sender"));
+  sender_->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_sender, _1));
+
+  // Nothing is in flight to any of the peers, but the total limit still
+  // applies, so only the first requests are sent.
+  OutboundLimits limits;
+  limits.total_messages = 2;
+  sender_->SetOutboundLimits(limits);
+  const size_t kPeerCount(5);
+  std::vector<std::shared_ptr<boost::asio::ip::udp::socket>> peers;
+  for (size_t i = 0; i != kPeerCount; ++i) {
+    peers.push_back(std::make_shared<boost::asio::ip::udp::socket>(
+        asio_service_.service()));
+    peers.back()->open(boost::asio::ip::udp::v4());
+    peers.back()->bind(boost::asio::ip::udp::endpoint(kIP, 0));
+    sender_->Send("Request",
+                  Endpoint(kIP, peers.back()->local_endpoint().port()),
+                  bptime::milliseconds(300));
+  }
+  ASSERT_EQ(kPeerCount - limits.total_messages, msgh_sender->results().size());
+  for (size_t i = 0; i != msgh_sender->results().size(); ++i)
+    EXPECT_EQ(kSendStalled, msgh_sender->results().at(i));
+  Sleep(bptime::milliseconds(100));
+  for (size_t i = 0; i != kPeerCount; ++i)
+    EXPECT_EQ(i < limits.total_messages, peers.at(i)->available() != 0);
+
+  // Once the requests time out, each refused endpoint is writable again.
+  int count(0);
+  while ((writable < kPeerCount - limits.total_messages ||
+          msgh_sender->results().size() < kPeerCount) && count++ < 100)
+    Sleep(bptime::milliseconds(10));
+  EXPECT_EQ(kPeerCount - limits.total_messages, writable);
+  ASSERT_EQ(kPeerCount, msgh_sender->results().size());
+  EXPECT_EQ(kReceiveTimeout, msgh_sender->results().at(kPeerCount - 1));
+
+  for (auto it = peers.begin(); it != peers.end(); ++it)
+    (*it)->close();
+}
+
+TEST_F(UdpTransportTest, BEH_ShardedSockets) {
+  UdpParameters::socket_count = 4;
+  Port port(Listen(listener_));
+  std::atomic<size_t> listener_requests(0), listener_responses(0);
+  listener_->on_message_received()->connect(
+      boost::bind(&AnswerRequest, &listener_requests, &listener_responses,
+                  _1, _2, _3, _4));
+  TestMessageHandlerPtr msgh_listener(new TestMessageHandler("Listener"));
+  listener_->on_error()->connect(
+      boost::bind(&TestMessageHandler::DoOnError, msgh_listener, _1));
+
+  // Peers on different ports are spread across the listener's sockets.
+  UdpParameters::socket_count = 1;
+  const size_t kPeerCount(8);
+  std::vector<std::shared_ptr<UdpTransport>> peers;
+  std::vector<Port> peer_ports;
+  std::atomic<size_t> peer_requests(0), peer_responses(0);
+  for (size_t i = 0; i != kPeerCount; ++i) {
+    peers.push_back(CreateTransport());
+    peer_ports.push_back(Listen(peers.back(), static_cast<Port>(port + 1)));
+    peers.back()->on_message_received()->connect(
+        boost::bind(&AnswerRequest, &peer_requests, &peer_responses,
+                    _1, _2, _3, _4));
+  }
+
+  // Each peer sends a request to the listener, and the listener sends one to
+  // each peer. Whichever of the listener's sockets reads a reply, it reaches
+  // the one which sent the request.
+  for (size_t i = 0; i != kPeerCount; ++i) {
+    peers.at(i)->Send("Request from peer", Endpoint(kIP, port),
+                      bptime::seconds(2));
+    listener_->Send("Request from listener", Endpoint(kIP, peer_ports.at(i)),
+                    bptime::seconds(2));
+  }
+  int count(0);
+  while ((listener_requests + listener_responses + peer_requests +
+          peer_responses < 4 * kPeerCount) && count++ < 40)
+    Sleep(bptime::milliseconds(50));
+
+  EXPECT_EQ(kPeerCount, listener_requests);
+  EXPECT_EQ(kPeerCount, listener_responses);
+  EXPECT_EQ(kPeerCount, peer_requests);
+  EXPECT_EQ(kPeerCount, peer_responses);
+  EXPECT_TRUE(msgh_listener->results().empty());
+}
+
+TEST_F(UdpTransportTest, BEH_PooledBuffersAndRequests) {
+  Port port(Listen(listener_));
+  std::atomic<size_t> sender_requests(0), sender_responses(0);
+  std::atomic<size_t> listener_requests(0);
+  sender_->on_message_received()->connect(
+      boost::bind(&AnswerRequest, &sender_requests, &sender_responses,
+                  _1, _2, _3, _4));
+  listener_->on_buffer_received()->connect(
+      boost::bind(&AnswerBuffer, &listener_requests, _1, _2, _3, _4));
+
+  // Once the pools have warmed up, further requests and responses reuse their
+  // buffers and requests.
+  const size_t kWarmUpCount(10), kMessageCount(100);
+  const std::string kRequest("Request " + RandomString(1000));
+  size_t sender_buffers(0), sender_requests_created(0);
+  size_t listener_buffers(0), listener_requests_created(0);
+  for (size_t i = 0; i != kWarmUpCount + kMessageCount; ++i) {
+    if (i == kWarmUpCount) {
+      sender_buffers = sender_->buffer_pool_allocations();
+      sender_requests_created = sender_->request_pool_allocations();
+      listener_buffers = listener_->buffer_pool_allocations();
+      listener_requests_created = listener_->request_pool_allocations();
+    }
+    sender_->Send(kRequest, Endpoint(kIP, port), bptime::seconds(2));
+    int count(0);
+    while (sender_responses < i + 1 && count++ < 200)
+      Sleep(bptime::milliseconds(10));
+    ASSERT_EQ(i + 1, sender_responses);
+  }
+
+  EXPECT_EQ(kWarmUpCount + kMessageCount, listener_requests);
+  EXPECT_EQ(0U, sender_requests);
+  EXPECT_LT(0U, sender_buffers);
+  EXPECT_LT(0U, listener_requests_created);
+  EXPECT_EQ(sender_buffers, sender_->buffer_pool_allocations());
+  EXPECT_EQ(sender_requests_created, sender_->request_pool_allocations());
+  EXPECT_EQ(listener_buffers, listener_->buffer_pool_allocations());
+  EXPECT_EQ(listener_requests_created, listener_->request_pool_allocations());
+}
+
+TEST_F(UdpTransportTest, BEH_KeptSmallBuffers) {
+  Port port(Listen(listener_));
+  boost::mutex mutex;
+  std::vector<SharedBuffer> buffers;
+  listener_->on_buffer_received()->connect(
+      boost::bind(&KeepBuffer, &mutex, &buffers, _1, _2, _3, _4));
+
+  // Small messages are copied out of the receive buffers, so keeping more of
+  // them than the pool holds doesn't need more receive buffers.
+  const size_t kMessageCount(300);
+  std::vector<std::string> messages;
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    messages.push_back(RandomString(100));
+    sender_->Send(messages.back(), Endpoint(kIP, port), kImmediateTimeout);
+    if (i % 50 == 49)
+      Sleep(bptime::milliseconds(20));
+  }
+  int count(0);
+  size_t received(0);
+  while (received < kMessageCount && count++ < 100) {
+    Sleep(bptime::milliseconds(20));
+    boost::mutex::scoped_lock lock(mutex);
+    received = buffers.size();
+  }
+
+  boost::mutex::scoped_lock lock(mutex);
+  ASSERT_EQ(kMessageCount, buffers.size());
+  for (size_t i = 0; i != kMessageCount; ++i) {
+    EXPECT_EQ(100U, buffers.at(i).size());
+    EXPECT_NE(messages.end(), std::find(messages.begin(), messages.end(),
+                                        buffers.at(i).ToString()));
+  }
+  EXPECT_GT(10U, listener_->buffer_pool_allocations());
+}
 
+TEST_F(UdpTransportTest, FUNC_PacketRate) {
+  size_t single_received(0), batch_received(0);
+  double single_rate(MeasurePacketRate(1, &single_received));
+  double batch_rate(MeasurePacketRate(32, &batch_received));
+  std::cout << "Received " << single_rate << " packets/s ("
+            << single_received << " arrived) one at a time, "
+            << batch_rate << " packets/s (" << batch_received
+            << " arrived) in batches of 32." << std::endl;
+}
 
 }  // namespace test
 
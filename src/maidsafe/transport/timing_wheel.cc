@@ -0,0 +1,165 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "maidsafe/transport/timing_wheel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace asio = boost::asio;
+namespace bs = boost::system;
+namespace bptime = boost::posix_time;
+namespace args = std::placeholders;
+
+namespace maidsafe {
+
+namespace transport {
+
+TimingWheel::TimingWheel(asio::io_service &asio_service,  // NOLINT
+                         const bptime::time_duration &resolution,
+                         size_t slot_count)
+    : asio_service_(asio_service),
+      ticker_(asio_service),
+      epoch_(Now()),
+      resolution_(resolution),
+      slots_(std::max(slot_count, size_t(1))),
+      current_tick_(0),
+      size_(0),
+      ticking_(false),
+      mutex_() {
+  assert(resolution_ > bptime::time_duration());
+}
+
+void TimingWheel::Schedule(Timer *timer,
+                           const bptime::ptime &expiry,
+                           const Handler &handler) {
+  if (expiry.is_special())
+    return;
+
+  boost::mutex::scoped_lock lock(mutex_);
+  if (timer->scheduled_) {
+    if (timer->expiry_ <= expiry)
+      return;
+    DoCancel(timer);
+  }
+
+  // The wheel is empty when it isn't ticking, so it can safely restart from
+  // the current time.
+  if (!ticking_)
+    current_tick_ = TickOf(Now());
+
+  // A timer which is already due goes in the next slot to be expired.
+  int64_t tick(std::max(TickOf(expiry), current_tick_));
+  size_t slot(static_cast<size_t>(tick % static_cast<int64_t>(slots_.size())));
+  timer->scheduled_ = true;
+  timer->expiry_ = expiry;
+  timer->slot_ = slot;
+  timer->entry_ = slots_.at(slot).insert(slots_.at(slot).end(),
+                                         Entry(timer, handler));
+  ++size_;
+
+  if (!ticking_)
+    StartTick();
+}
+
+void TimingWheel::Cancel(Timer *timer) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (timer->scheduled_)
+    DoCancel(timer);
+}
+
+size_t TimingWheel::size() {
+  boost::mutex::scoped_lock lock(mutex_);
+  return size_;
+}
+
+int64_t TimingWheel::TickOf(const bptime::ptime &time) const {
+  return (time - epoch_).total_microseconds() /
+         resolution_.total_microseconds();
+}
+
+void TimingWheel::DoCancel(Timer *timer) {
+  slots_.at(timer->slot_).erase(timer->entry_);
+  timer->scheduled_ = false;
+  --size_;
+}
+
+bptime::ptime TimingWheel::TimeOf(int64_t tick) const {
+  return epoch_ + bptime::microseconds(tick * resolution_.total_microseconds());
+}
+
+void TimingWheel::StartTick() {
+  ticking_ = true;
+  ticker_.expires_at(TimeOf(current_tick_ + 1));
+  ticker_.async_wait(std::bind(&TimingWheel::HandleTick, shared_from_this(),
+                               args::_1));
+}
+
+void TimingWheel::HandleTick(const bs::error_code &ec) {
+  if (ec == asio::error::operation_aborted)
+    return;
+
+  std::vector<Handler> expired;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    bptime::ptime now(Now());
+    int64_t now_tick(TickOf(now));
+    // Each slot is visited at most once per tick, even after a long delay.
+    int64_t last_tick(std::min(now_tick, current_tick_ +
+                               static_cast<int64_t>(slots_.size()) - 1));
+    for (int64_t tick = current_tick_; tick <= last_tick; ++tick) {
+      Slot &slot(slots_.at(static_cast<size_t>(
+          tick % static_cast<int64_t>(slots_.size()))));
+      // Timers hashed here for a later revolution of the wheel are left.
+      for (auto it = slot.begin(); it != slot.end();) {
+        if (it->timer->expiry_ <= now) {
+          it->timer->scheduled_ = false;
+          expired.push_back(it->handler);
+          it = slot.erase(it);
+          --size_;
+        } else {
+          ++it;
+        }
+      }
+    }
+    // The current tick's slot may still hold timers due later in the tick,
+    // so it is visited again next time.
+    current_tick_ = std::max(current_tick_, now_tick);
+
+    if (size_ == 0)
+      ticking_ = false;
+    else
+      StartTick();
+  }
+
+  for (auto it = expired.begin(); it != expired.end(); ++it)
+    asio_service_.post(*it);
+}
+
+}  // namespace transport
+
+}  // namespace maidsafe
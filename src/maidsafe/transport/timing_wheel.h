@@ -0,0 +1,134 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_TIMING_WHEEL_H_
+#define MAIDSAFE_TRANSPORT_TIMING_WHEEL_H_
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
+#include "boost/asio/deadline_timer.hpp"
+#include "boost/asio/io_service.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace maidsafe {
+
+namespace transport {
+
+// A hashed timing wheel for large numbers of coarse timeouts. Each timer is
+// hashed by its expiry tick into one of a fixed number of slots, so that it is
+// scheduled and cancelled in constant time. A single deadline_timer ticks the
+// wheel while it has timers scheduled, and on each tick the timers in the
+// slots which have come due are expired together. A timer may fire up to one
+// resolution late.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Weffc++"
+#endif
+class TimingWheel : public std::enable_shared_from_this<TimingWheel> {
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+ private:
+  struct Entry;
+  typedef std::list<Entry> Slot;
+
+ public:
+  typedef std::function<void()> Handler;
+
+  // The wheel's record of a scheduled timeout. A Timer must not be destroyed
+  // or moved while it is scheduled, so owners normally keep themselves alive
+  // in the handler.
+  class Timer {
+   public:
+    Timer() : scheduled_(false), expiry_(), slot_(0), entry_() {}
+    bool scheduled() const { return scheduled_; }
+   private:
+    friend class TimingWheel;
+    bool scheduled_;
+    boost::posix_time::ptime expiry_;
+    size_t slot_;
+    Slot::iterator entry_;
+  };
+
+  TimingWheel(boost::asio::io_service &asio_service,  // NOLINT
+              const boost::posix_time::time_duration &resolution,
+              size_t slot_count);
+
+  // Schedules the handler to be posted to the io_service once the expiry has
+  // passed. As with RudpTickTimer, a timer which is already due to expire no
+  // later than the given time is left unchanged, so that a deadline which
+  // moves further away only costs a check when the earlier expiry fires.
+  // An infinite expiry leaves the timer unscheduled.
+  void Schedule(Timer *timer,
+                const boost::posix_time::ptime &expiry,
+                const Handler &handler);
+  // Removes the timer from the wheel without calling its handler.
+  void Cancel(Timer *timer);
+  size_t size();
+
+  static boost::posix_time::ptime Now() {
+    return boost::asio::deadline_timer::traits_type::now();
+  }
+
+ private:
+  TimingWheel(const TimingWheel&);
+  TimingWheel &operator=(const TimingWheel&);
+
+  struct Entry {
+    Entry(Timer *timer_in, const Handler &handler_in)
+        : timer(timer_in), handler(handler_in) {}
+    Timer *timer;
+    Handler handler;
+  };
+
+  int64_t TickOf(const boost::posix_time::ptime &time) const;
+  boost::posix_time::ptime TimeOf(int64_t tick) const;
+  void DoCancel(Timer *timer);
+  void StartTick();
+  void HandleTick(const boost::system::error_code &ec);
+
+  boost::asio::io_service &asio_service_;
+  boost::asio::deadline_timer ticker_;
+  boost::posix_time::ptime epoch_;
+  boost::posix_time::time_duration resolution_;
+  std::vector<Slot> slots_;
+  // The earliest tick whose slot may hold expired timers.
+  int64_t current_tick_;
+  size_t size_;
+  bool ticking_;
+  boost::mutex mutex_;
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_TIMING_WHEEL_H_
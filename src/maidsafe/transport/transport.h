@@ -38,6 +38,7 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <iostream>  // NOLINT
 #include <vector>
 
+#include "boost/asio/buffer.hpp"
 #include "boost/asio/ip/address.hpp"
 #include "boost/asio/io_service.hpp"
 #include "boost/date_time/posix_time/posix_time_duration.hpp"
@@ -63,6 +64,9 @@ typedef boost::asio::ip::address IP;
 typedef uint16_t Port;
 typedef int32_t DataSize;
 typedef bptime::time_duration Timeout;
+// A message made up of several buffers, which transports send without first
+// concatenating them.
+typedef std::vector<boost::asio::const_buffer> ConstBuffers;
 
 class Contact;
 class MessageHandler;
@@ -163,13 +167,100 @@ const float kTimeoutFactor(0.01f);
 // Maximum period of inactivity on a send or receive before timeout triggered
 const Timeout kStallTimeout(bptime::seconds(3));
 
+// An immutable view of received message data. It shares ownership of the
+// storage the message was received into, so handlers can parse the message in
+// place, or keep it, without the data being copied.
+class SharedBuffer {
+ public:
+  SharedBuffer() : storage_(), data_(NULL), size_(0) {}
+  template <typename Storage>
+  SharedBuffer(const std::shared_ptr<Storage> &storage,
+               size_t offset,
+               size_t size)
+      : storage_(storage),
+        data_(reinterpret_cast<const unsigned char*>(storage->data()) +
+              offset),
+        size_(size) {}
+  const unsigned char *data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::string ToString() const {
+    return std::string(reinterpret_cast<const char*>(data_), size_);
+  }
+
+ private:
+  std::shared_ptr<const void> storage_;
+  const unsigned char *data_;
+  size_t size_;
+};
+
+// Receives a single message incrementally, so that it can be processed, or
+// written out, while it is still arriving rather than being held in memory
+// whole. Streams are created by slots connected to on_stream_started. Their
+// calls are made in order, one at a time, and outside the transport's own
+// handlers, so a stream which is slow to process its data doesn't hold up
+// receiving.
+class MessageStream {
+ public:
+  virtual ~MessageStream() {}
+  // Called with each successive part of the message, in order.
+  virtual void OnData(const SharedBuffer &data) = 0;
+  // Called once the whole message has arrived. As for on_message_received, a
+  // response may be set to be sent back, along with its timeout.
+  virtual void OnComplete(const Info &info,
+                          std::string *response,
+                          Timeout *timeout) = 0;
+  // Called instead of OnComplete if the message doesn't arrive in full.
+  virtual void OnFailure(const TransportCondition &error) = 0;
+};
+
+typedef std::shared_ptr<MessageStream> MessageStreamPtr;
+
+// Bounds on the messages which Send() has accepted but the transport has yet
+// to write out, both to each remote endpoint and in total. A limit of 0 means
+// no limit. A message which would exceed a limit is refused with kSendStalled.
+// The endpoint limits don't apply while nothing else is in flight to the
+// message's endpoint, nor the total byte limit while nothing is in flight at
+// all, so that a single message larger than the byte limits can still be sent.
+struct OutboundLimits {
+  OutboundLimits()
+      : endpoint_bytes(0),
+        endpoint_messages(0),
+        total_bytes(0),
+        total_messages(0) {}
+  size_t endpoint_bytes;
+  size_t endpoint_messages;
+  size_t total_bytes;
+  size_t total_messages;
+};
+
 // transport signals
 typedef std::shared_ptr<bs2::signal<void(const std::string&,
                                          const Info&,
                                          std::string*,
                                          Timeout*)>> OnMessageReceived;
+// Alternative to OnMessageReceived which avoids copying the received data. If
+// any slots are connected to it, received messages are signalled through it
+// instead of through OnMessageReceived. A buffer which a handler keeps holds
+// on to the storage the message was received into, which may be larger than
+// the message; UdpTransport copies small messages out of its 64 KiB receive
+// buffers for this reason.
+typedef std::shared_ptr<bs2::signal<void(const SharedBuffer&,
+                                         const Info&,
+                                         std::string*,
+                                         Timeout*)>> OnBufferReceived;
+// Signalled with the total size of each incoming message as it starts to
+// arrive. A slot may set the stream to have the message delivered to it in
+// parts, in which case no other signal fires for the message. Otherwise the
+// message is received whole as usual.
+typedef std::shared_ptr<bs2::signal<void(const DataSize&,
+                                         const Info&,
+                                         MessageStreamPtr*)>> OnStreamStarted;
 typedef std::shared_ptr<bs2::signal<void(const TransportCondition&,
                                          const Endpoint&)>> OnError;
+// Signalled once there is room again to send to an endpoint for which a
+// message was refused with kSendStalled.
+typedef std::shared_ptr<bs2::signal<void(const Endpoint&)>> OnWritable;
 
 namespace test {
   class MockNatDetectionServiceTest_BEH_FullConeDetection_Test;
@@ -207,13 +298,42 @@ class Transport {
   virtual void Send(const std::string &data,
                     const Endpoint &endpoint,
                     const Timeout &timeout) = 0;
+  /**
+   * Sends the message held in the given sequence of buffers to the specified
+   * receiver, gathering the buffers as it is written where the transport
+   * supports it. By default the buffers are concatenated and sent as a string.
+   * @param data The buffers holding the message data.
+   * @param owner Keeps the memory the buffers refer to valid until sent.
+   * @param endpoint The data receiver's endpoint.
+   * @param timeout Time after which to terminate a conversation.
+   */
+  virtual void Send(const ConstBuffers &data,
+                    const std::shared_ptr<const void> &/*owner*/,
+                    const Endpoint &endpoint,
+                    const Timeout &timeout) {
+    std::string message;
+    message.reserve(boost::asio::buffer_size(data));
+    for (auto it = data.begin(); it != data.end(); ++it)
+      message.append(boost::asio::buffer_cast<const char*>(*it),
+                     boost::asio::buffer_size(*it));
+    Send(message, endpoint, timeout);
+  }
+  /**
+   * Sets the limits on outbound messages in flight. Transports which don't
+   * support limits ignore them.
+   * @param limits The new limits, which apply to subsequent sends.
+   */
+  virtual void SetOutboundLimits(const OutboundLimits &/*limits*/) {}
   /**
    * Getter for the listening port.
    * @return The port number or 0 if not listening.
    */
   Port listening_port() const { return listening_port_; }
   OnMessageReceived on_message_received() { return on_message_received_; }
+  OnBufferReceived on_buffer_received() { return on_buffer_received_; }
+  OnStreamStarted on_stream_started() { return on_stream_started_; }
   OnError on_error() { return on_error_; }
+  OnWritable on_writable() { return on_writable_; }
   DataSize kMaxTransportMessageSize() const {
     return kMaxTransportMessageSize_;
   }
@@ -237,14 +357,43 @@ class Transport {
       : asio_service_(asio_service),
         listening_port_(0),
         on_message_received_(new OnMessageReceived::element_type),
+        on_buffer_received_(new OnBufferReceived::element_type),
+        on_stream_started_(new OnStreamStarted::element_type),
         on_error_(new OnError::element_type),
+        on_writable_(new OnWritable::element_type),
         kMaxTransportMessageSize_(data_size),
         transport_details_(),
         bootstrap_status_(-2) {}
+  /**
+   * Signals a received message through on_buffer_received_ if it has any slots
+   * connected, otherwise through on_message_received_ with a copy of the data.
+   */
+  void SignalMessageReceived(const SharedBuffer &data,
+                             const Info &info,
+                             std::string *response,
+                             Timeout *timeout) {
+    if (!on_buffer_received_->empty())
+      (*on_buffer_received_)(data, info, response, timeout);
+    else
+      (*on_message_received_)(data.ToString(), info, response, timeout);
+  }
+  /**
+   * Offers an incoming message of the given size to on_stream_started_.
+   * @return The stream to deliver the message to, or null to receive it whole.
+   */
+  MessageStreamPtr SignalStreamStarted(const DataSize &size, const Info &info) {
+    MessageStreamPtr stream;
+    if (!on_stream_started_->empty())
+      (*on_stream_started_)(size, info, &stream);
+    return stream;
+  }
   boost::asio::io_service &asio_service_;
   Port listening_port_;
   OnMessageReceived on_message_received_;
+  OnBufferReceived on_buffer_received_;
+  OnStreamStarted on_stream_started_;
   OnError on_error_;
+  OnWritable on_writable_;
 
   const DataSize kMaxTransportMessageSize_;  // In bytes
   TransportDetails transport_details_;
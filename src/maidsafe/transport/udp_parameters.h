@@ -0,0 +1,103 @@
+/* Copyright (c) 2010 maidsafe.net limited
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+    * Neither the name of the maidsafe.net limited nor the names of its
+    contributors may be used to endorse or promote products derived from this
+    software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAIDSAFE_TRANSPORT_UDP_PARAMETERS_H_
+#define MAIDSAFE_TRANSPORT_UDP_PARAMETERS_H_
+
+#include <cstddef>
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "maidsafe/transport/version.h"
+
+#if MAIDSAFE_TRANSPORT_VERSION != 200
+#  error This API is not compatible with the installed library.\
+    Please update the maidsafe-transport library.
+#endif
+
+namespace maidsafe {
+
+namespace transport {
+
+// This class provides the configurability to all UDP transport parameters.
+struct UdpParameters {
+ public:
+  // Maximum number of datagrams read or written by a single system call. If
+  // greater than 1, a transport reads with recvmmsg each time its socket
+  // becomes readable, and sends requests queued in the meantime together
+  // with sendmmsg. This applies to sockets opened after it is set, and is
+  // ignored on platforms other than Linux.
+  static size_t batch_size;
+  // Largest datagram sent, including the transport's header. If non-zero, a
+  // message which doesn't fit in one datagram is split into fragments of at
+  // most this size, which the receiver reassembles. This raises the largest
+  // message which can be sent from 65535 bytes to reassembly_budget, up to
+  // 64 MiB, but the loss of any one fragment loses the whole message. If 0,
+  // messages aren't fragmented.
+  // At most 65507 bytes fit in one UDP datagram.
+  static size_t mtu;
+  // Most memory used for the data of partly reassembled messages. Fragments
+  // of a new message which would exceed it are dropped, and a message larger
+  // than it is refused by Send with kMessageSizeTooLarge.
+  static size_t reassembly_budget;
+  // Time after a message's first fragment arrives that the rest are awaited
+  // before the message is dropped.
+  static boost::posix_time::time_duration reassembly_timeout;
+  // Most times a request is sent again if no reply has arrived, before the
+  // request's own timeout expires. The wait before each retransmission is
+  // derived from the round trip times measured to the peer, and doubles with
+  // each retransmission. Peers should cache their responses (see
+  // response_cache_size), so that a retransmitted request is answered without
+  // being handled twice. If 0, requests are sent once.
+  static size_t max_retransmissions;
+  // Wait before retransmitting a request to a peer whose round trip time
+  // hasn't yet been measured.
+  static boost::posix_time::time_duration initial_retransmit_timeout;
+  // Number of recently received requests remembered, along with the responses
+  // sent to them. A request received again is answered with the same response
+  // rather than being passed to the handlers. If 0, every request received is
+  // handled.
+  static size_t response_cache_size;
+  // Number of sockets a transport listens with, all bound to the same port
+  // using SO_REUSEPORT. The kernel spreads the datagrams arriving from
+  // different peers across them, and each socket has its own strand, so that
+  // they can be handled by several io_service threads at once. Responses are
+  // sent from the socket which read the request, and requests are sent from
+  // each socket in turn. This applies to transports which start listening
+  // after it is set, and is ignored on platforms without SO_REUSEPORT.
+  static size_t socket_count;
+
+ private:
+  // Disallow copying and assignment.
+  UdpParameters(const UdpParameters&);
+  UdpParameters &operator=(const UdpParameters&);
+};
+
+}  // namespace transport
+
+}  // namespace maidsafe
+
+#endif  // MAIDSAFE_TRANSPORT_UDP_PARAMETERS_H_
@@ -27,6 +27,8 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "maidsafe/transport/udp_request.h"
 
+#include <cassert>
+
 namespace asio = boost::asio;
 namespace ip = asio::ip;
 
@@ -34,19 +36,78 @@ namespace maidsafe {
 
 namespace transport {
 
+// The most storage a request keeps for copies of its messages once they have
+// been sent.
+static const size_t kMaxRetainedCopySize(65536);
+
+UdpRequest::UdpRequest()
+  : data_(),
+    owner_(),
+    copy_(),
+    endpoint_(),
+    timer_(),
+    reply_timeout_(),
+    reply_to_id_(0) {
+}
+
 UdpRequest::UdpRequest(const std::string &data,
                        const ip::udp::endpoint &endpoint,
-                       asio::io_service &asio_service,
+                       const Timeout &timeout,
+                       uint64_t reply_to_id)
+  : data_(),
+    owner_(),
+    copy_(),
+    endpoint_(endpoint),
+    timer_(),
+    reply_timeout_(timeout),
+    reply_to_id_(reply_to_id) {
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>(data));
+  data_.push_back(asio::buffer(*owner));
+  owner_ = owner;
+}
+
+UdpRequest::UdpRequest(const ConstBuffers &data,
+                       const std::shared_ptr<const void> &owner,
+                       const ip::udp::endpoint &endpoint,
                        const Timeout &timeout,
                        uint64_t reply_to_id)
   : data_(data),
+    owner_(owner),
+    copy_(),
     endpoint_(endpoint),
-    timer_(asio_service, timeout),
+    timer_(),
     reply_timeout_(timeout),
     reply_to_id_(reply_to_id) {
 }
 
-const std::string &UdpRequest::Data() const {
+void UdpRequest::Assign(const ConstBuffers &data,
+                        const std::shared_ptr<const void> &owner,
+                        const ip::udp::endpoint &endpoint,
+                        const Timeout &timeout,
+                        uint64_t reply_to_id) {
+  assert(!timer_.scheduled());
+  data_ = data;
+  owner_ = owner;
+  endpoint_ = endpoint;
+  reply_timeout_ = timeout;
+  reply_to_id_ = reply_to_id;
+}
+
+void UdpRequest::AssignCopy(const std::string &data,
+                            const std::shared_ptr<const void> &owner,
+                            const ip::udp::endpoint &endpoint,
+                            const Timeout &timeout,
+                            uint64_t reply_to_id) {
+  assert(!timer_.scheduled());
+  copy_.assign(data);
+  data_.assign(1, asio::buffer(copy_));
+  owner_ = owner;
+  endpoint_ = endpoint;
+  reply_timeout_ = timeout;
+  reply_to_id_ = reply_to_id;
+}
+
+const ConstBuffers &UdpRequest::Data() const {
   return data_;
 }
 
@@ -62,6 +123,17 @@ uint64_t UdpRequest::ReplyToId() const {
   return reply_to_id_;
 }
 
+TimingWheel::Timer *UdpRequest::ReplyTimer() {
+  return &timer_;
+}
+
+void UdpRequest::ReleaseData() {
+  data_.clear();
+  owner_.reset();
+  if (copy_.capacity() > kMaxRetainedCopySize)
+    std::string().swap(copy_);
+}
+
 }  // namespace transport
 
 }  // namespace maidsafe
@@ -29,10 +29,10 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAIDSAFE_TRANSPORT_UDP_REQUEST_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
-#include "boost/asio/deadline_timer.hpp"
-#include "boost/asio/io_service.hpp"
 #include "boost/asio/ip/udp.hpp"
+#include "maidsafe/transport/timing_wheel.h"
 #include "maidsafe/transport/transport.h"
 
 namespace maidsafe {
@@ -41,29 +41,54 @@ namespace transport {
 
 class UdpRequest {
  public:
+  // An empty request, to be given its message by Assign or AssignCopy. This
+  // lets the transport reuse requests from a pool.
+  UdpRequest();
   UdpRequest(const std::string &data,
              const boost::asio::ip::udp::endpoint &endpoint,
-             boost::asio::io_service &asio_service,
              const Timeout &timeout,
              uint64_t reply_to_id = 0);
+  UdpRequest(const ConstBuffers &data,
+             const std::shared_ptr<const void> &owner,
+             const boost::asio::ip::udp::endpoint &endpoint,
+             const Timeout &timeout,
+             uint64_t reply_to_id = 0);
+
+  // Replaces the request's message. The request mustn't be awaiting a reply.
+  void Assign(const ConstBuffers &data,
+              const std::shared_ptr<const void> &owner,
+              const boost::asio::ip::udp::endpoint &endpoint,
+              const Timeout &timeout,
+              uint64_t reply_to_id = 0);
+  // As Assign, but copies the data into storage of the request's own, which
+  // is kept for the next message unless it has grown large.
+  void AssignCopy(const std::string &data,
+                  const std::shared_ptr<const void> &owner,
+                  const boost::asio::ip::udp::endpoint &endpoint,
+                  const Timeout &timeout,
+                  uint64_t reply_to_id = 0);
 
-  const std::string &Data() const;
+  const ConstBuffers &Data() const;
   const boost::asio::ip::udp::endpoint& Endpoint() const;
   const Timeout& ReplyTimeout() const;
   uint64_t ReplyToId() const;
+  // Drops the message data once it has been sent, so that the owner isn't
+  // kept alive while waiting for the reply.
+  void ReleaseData();
 
-  template <typename WaitHandler>
-  void WaitForTimeout(WaitHandler handler) {
-    timer_.async_wait(handler);
-  }
+  // The request's entry in the transport's timing wheel while it awaits a
+  // reply.
+  TimingWheel::Timer *ReplyTimer();
 
  private:
   UdpRequest(const UdpRequest&);
   UdpRequest &operator=(const UdpRequest&);
 
-  std::string data_;
+  ConstBuffers data_;
+  std::shared_ptr<const void> owner_;
+  std::string copy_;
   boost::asio::ip::udp::endpoint endpoint_;
-  boost::asio::deadline_timer timer_;
+  TimingWheel::Timer timer_;
   Timeout reply_timeout_;
   uint64_t reply_to_id_;
 };
@@ -27,10 +27,21 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "maidsafe/transport/udp_transport.h"
 
+#include <algorithm>
 #include <array>
+#include <cerrno>
 #include <cstring>
 #include <functional>
+#include <utility>
 
+#include "maidsafe/common/platform_config.h"
+#ifdef MAIDSAFE_LINUX
+#  include <sys/socket.h>
+#endif
+
+#include "maidsafe/transport/outbound_limiter.h"
+#include "maidsafe/transport/timing_wheel.h"
+#include "maidsafe/transport/udp_parameters.h"
 #include "maidsafe/transport/udp_request.h"
 #include "maidsafe/transport/log.h"
 #include "maidsafe/common/utils.h"
@@ -45,14 +56,182 @@ namespace maidsafe {
 
 namespace transport {
 
+// Reply timeouts are coarse, so they share a timing wheel whose ticks expire
+// every request which has come due since the last one together.
+static const bptime::time_duration kTimerResolution(bptime::milliseconds(50));
+static const size_t kTimerSlotCount(1024);
+
+// Bounds on the wait before retransmitting a request, and the most peers whose
+// round trip times are remembered.
+static const bptime::time_duration kMinRetransmitTimeout(
+    bptime::milliseconds(100));
+static const bptime::time_duration kMaxRetransmitTimeout(bptime::seconds(60));
+static const size_t kMaxPeerRttCount(4096);
+
+// The most receive buffers and requests each socket keeps for reuse.
+static const size_t kMaxPooledBuffers(256);
+static const size_t kMaxPooledRequests(1024);
+
+// The size of a receive buffer, which holds any datagram.
+static const size_t kReceiveBufferSize(0xffff);
+
+// Messages up to this size are copied out of the receive buffer before being
+// signalled through on_buffer_received, so that handlers keeping them don't
+// each pin a whole receive buffer.
+static const size_t kMaxCopiedMessageSize(4096);
+
+// The size of the message data, and the ids of the message and of the request
+// it replies to, which precede the data in each datagram.
+struct DatagramHeader {
+  std::array<unsigned char, 4> size;
+  std::array<uint64_t, 2> ids;
+};
+
+// The lengths of the fields of the header.
+static const size_t kSizeLength(4);
+static const size_t kIdsLength(2 * sizeof(uint64_t));
+
+// A fragment of a message too large for one datagram carries the size of the
+// whole message with kFragmentFlag set, then the ids as usual, and then its
+// index and the number of fragments. All but the last fragment hold the same
+// amount of data, so the receiver can tell where each belongs.
+static const uint32_t kFragmentFlag(0x80000000);
+static const size_t kFragmentFieldsLength(8);
+static const DataSize kMaxFragmentedMessageSize(67108864);
+
+static void EncodeUint32(uint32_t value, unsigned char *data) {
+  for (int i = 0; i != 4; ++i)
+    data[i] = static_cast<unsigned char>(value >> (8 * (3 - i)));
+}
+
+static uint32_t DecodeUint32(const unsigned char *data) {
+  return (static_cast<uint32_t>(data[0]) << 24) |
+         (static_cast<uint32_t>(data[1]) << 16) |
+         (static_cast<uint32_t>(data[2]) << 8) |
+         static_cast<uint32_t>(data[3]);
+}
+
+static bool IsFragmented(const UdpRequest &request) {
+  return UdpParameters::mtu != 0 &&
+         kSizeLength + kIdsLength + asio::buffer_size(request.Data()) >
+             UdpParameters::mtu;
+}
+
+// Appends the buffers holding the given range of the data.
+static void AppendRange(const ConstBuffers &data,
+                        size_t offset,
+                        size_t length,
+                        ConstBuffers *buffers) {
+  for (auto it = data.begin(); it != data.end() && length != 0; ++it) {
+    size_t size(asio::buffer_size(*it));
+    if (offset >= size) {
+      offset -= size;
+      continue;
+    }
+    size_t count(std::min(size - offset, length));
+    buffers->push_back(asio::buffer(*it + offset, count));
+    offset = 0;
+    length -= count;
+  }
+}
+
+static void EncodeHeader(const UdpRequest &request,
+                         uint64_t request_id,
+                         DatagramHeader *header) {
+  // Encode the size of the message data.
+  DataSize size = static_cast<DataSize>(asio::buffer_size(request.Data()));
+  for (int i = 0; i != 4; ++i)
+    header->size[i] = static_cast<char>(size >> (8 * (3 - i)));
+
+  // There's no need to encode the ids as they are opaque to the peer.
+  header->ids[0] = request_id;
+  header->ids[1] = request.ReplyToId();
+}
+
+#ifdef MAIDSAFE_LINUX
+// Storage for the datagrams read by a single recvmmsg call. A buffer handed
+// over to the message handlers is replaced before the next call.
+struct UdpTransport::ReadBatch {
+  ReadBatch(size_t size, SharedPool<std::vector<unsigned char>> *pool)
+      : buffers(size), senders(size), iovecs(size), messages(size) {
+    for (size_t i = 0; i != size; ++i)
+      buffers[i] = pool->Acquire();
+  }
+  std::vector<BufferPtr> buffers;
+  std::vector<ip::udp::endpoint> senders;
+  std::vector<iovec> iovecs;
+  std::vector<mmsghdr> messages;
+};
+
+// Scratch space for the datagrams written by a single sendmmsg call.
+struct UdpTransport::SendBatch {
+  explicit SendBatch(size_t size)
+      : headers(size), iovecs(), messages(size) {}
+  std::vector<DatagramHeader> headers;
+  std::vector<iovec> iovecs;
+  std::vector<mmsghdr> messages;
+};
+#endif
+
+// A message whose fragments are arriving, and which fragments have arrived.
+struct UdpTransport::Reassembly {
+  Reassembly(size_t size, size_t count, uint64_t reply_to_id_in)
+      : data(std::make_shared<std::vector<unsigned char>>(size)),
+        received(count, false),
+        remaining(count),
+        reply_to_id(reply_to_id_in),
+        timer() {}
+  BufferPtr data;
+  std::vector<bool> received;
+  size_t remaining;
+  uint64_t reply_to_id;
+  TimingWheel::Timer timer;
+};
+
+DataSize UdpTransport::kMaxTransportMessageSize() {
+  if (UdpParameters::mtu == 0)
+    return 65535;
+  // A fragmented message larger than the reassembly budget would be dropped
+  // by a receiver with the same parameters, so it isn't sent at all.
+  size_t unfragmented(UdpParameters::mtu > kSizeLength + kIdsLength ?
+                      UdpParameters::mtu - kSizeLength - kIdsLength : 0);
+  return static_cast<DataSize>(std::min(
+      static_cast<size_t>(kMaxFragmentedMessageSize),
+      std::max(unfragmented, UdpParameters::reassembly_budget)));
+}
+
 UdpTransport::UdpTransport(asio::io_service &asio_service)  // NOLINT
   : Transport(asio_service),
     strand_(asio_service),
     socket_(),
+    buffer_pool_(&UdpTransport::CreateBuffer, kMaxPooledBuffers),
+    request_pool_(&UdpTransport::CreateRequest, kMaxPooledRequests),
     read_buffer_(),
     sender_endpoint_(),
     next_request_id_(0),
-    outstanding_requests_() {
+    outstanding_requests_(),
+    timing_wheel_(std::make_shared<TimingWheel>(asio_service,
+                                                kTimerResolution,
+                                                kTimerSlotCount)),
+    read_batch_(),
+    send_batch_(),
+    send_queue_(),
+    flush_pending_(false),
+    awaiting_writable_(false),
+    egress_depth_(0),
+    peak_egress_depth_(0),
+    reassemblies_(),
+    reassembly_bytes_(0),
+    peer_rtts_(),
+    response_cache_(),
+    response_cache_order_(),
+    shard_index_(0),
+    shard_count_(1),
+    shards_(),
+    shard_table_(),
+    next_shard_(0),
+    outbound_limiter_(std::make_shared<OutboundLimiter>(asio_service,
+                                                        on_writable_)) {
   // If a UdpTransport is restarted and listens on the same port number as
   // before, it may receive late replies intended for the previous incarnation.
   // To avoid this, we use a random number as the first request id.
@@ -66,6 +245,14 @@ UdpTransport::UdpTransport(asio::io_service &asio_service)  // NOLINT
 UdpTransport::~UdpTransport() {
 }
 
+UdpTransport::BufferPtr UdpTransport::CreateBuffer() {
+  return std::make_shared<std::vector<unsigned char>>(kReceiveBufferSize);
+}
+
+UdpTransport::RequestPtr UdpTransport::CreateRequest() {
+  return std::make_shared<UdpRequest>();
+}
+
 TransportCondition UdpTransport::StartListening(const Endpoint &endpoint) {
   if (listening_port_ != 0)
     return kAlreadyStarted;
@@ -78,25 +265,92 @@ TransportCondition UdpTransport::StartListening(const Endpoint &endpoint) {
   // reopening it on the specified listening endpoint.
   StopListening();
 
+  shard_index_ = 0;
+  shard_count_ = 1;
+  shard_table_.reset();
+  size_t shard_count(1);
+#ifdef SO_REUSEPORT
+  shard_count = std::max(UdpParameters::socket_count, size_t(1));
+#endif
   ip::udp::endpoint ep(endpoint.ip, endpoint.port);
+  TransportCondition result(Listen(ep, shard_count > 1));
+  if (result != kSuccess)
+    return result;
+  listening_port_ = socket_->local_endpoint().port();
+  if (shard_count == 1) {
+    StartRead();
+    return kSuccess;
+  }
+
+  // The other shards are bound to the port this one was given, and signal
+  // through its slots.
+  shard_count_ = shard_count;
+  shard_table_ = std::make_shared<std::vector<std::weak_ptr<UdpTransport>>>();
+  shard_table_->push_back(shared_from_this());
+  for (size_t i = 1; i != shard_count; ++i) {
+    std::shared_ptr<UdpTransport> shard(
+        std::make_shared<UdpTransport>(asio_service_));
+    shard->on_message_received_ = on_message_received_;
+    shard->on_buffer_received_ = on_buffer_received_;
+    shard->on_stream_started_ = on_stream_started_;
+    shard->on_error_ = on_error_;
+    shard->on_writable_ = on_writable_;
+    result = shard->Listen(ip::udp::endpoint(ep.address(), listening_port_),
+                           true);
+    if (result != kSuccess) {
+      StopListening();
+      return result;
+    }
+    shard->listening_port_ = listening_port_;
+    shards_.push_back(shard);
+    shard_table_->push_back(shard);
+  }
+  // Each shard's ids start from this one's, rounded up to a multiple of the
+  // shard count, plus the shard's index.
+  uint64_t first_id(next_request_id_ - next_request_id_ % shard_count +
+                    shard_count);
+  for (size_t i = 0; i != shard_count; ++i) {
+    std::shared_ptr<UdpTransport> shard((*shard_table_)[i].lock());
+    shard->shard_index_ = i;
+    shard->shard_count_ = shard_count;
+    shard->shard_table_ = shard_table_;
+    shard->next_request_id_ = first_id + i;
+    shard->StartRead();
+  }
+  return kSuccess;
+}
+
+TransportCondition UdpTransport::Listen(const ip::udp::endpoint &endpoint,
+                                        bool reuse_port) {
   socket_.reset(new ip::udp::socket(asio_service_));
-  sender_endpoint_.reset(new ip::udp::endpoint);
-  read_buffer_.reset(new std::vector<unsigned char>(0xffff));
+  PrepareRead();
 
   bs::error_code ec;
-  socket_->open(ep.protocol(), ec);
+  socket_->open(endpoint.protocol(), ec);
 
   if (ec)
     return kInvalidAddress;
 
-  socket_->bind(ep, ec);
+  ip::udp::socket::non_blocking_io nbio(true);
+  socket_->io_control(nbio, ec);
 
   if (ec)
-    return kBindError;
+    return kSetOptionFailure;
 
-  listening_port_ = socket_->local_endpoint().port();
+#ifdef SO_REUSEPORT
+  if (reuse_port) {
+    typedef asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>
+        ReusePort;
+    socket_->set_option(ReusePort(true), ec);
+    if (ec)
+      return kSetOptionFailure;
+  }
+#endif
 
-  StartRead();
+  socket_->bind(endpoint, ec);
+
+  if (ec)
+    return kBindError;
 
   return kSuccess;
 }
@@ -110,29 +364,78 @@ void UdpTransport::StopListening() {
   if (socket_)
     strand_.dispatch(std::bind(&UdpTransport::CloseSocket, socket_));
   listening_port_ = 0;
+  for (auto it = shards_.begin(); it != shards_.end(); ++it)
+    (*it)->StopListening();
+  // The shard table is left for any handlers still running on the strands.
+  shards_.clear();
 }
 
 void UdpTransport::Send(const std::string &data,
                         const Endpoint &endpoint,
                         const Timeout &timeout) {
-  ip::udp::endpoint ep(endpoint.ip, endpoint.port);
-  if (static_cast<DataSize>(data.size()) > kMaxTransportMessageSize()) {
-    DLOG(ERROR) << "Data size " << data.size() << " bytes (exceeds limit of "
+  // The data is copied into the request's own storage, which is reused along
+  // with the request.
+  std::shared_ptr<const void> ticket;
+  if (!AdmitSend(data.size(), endpoint, &ticket))
+    return;
+  RequestPtr request(request_pool_.Acquire());
+  request->AssignCopy(data, ticket, ip::udp::endpoint(endpoint.ip,
+                                                      endpoint.port),
+                      timeout);
+  StartSend(request);
+}
+
+void UdpTransport::Send(const ConstBuffers &data,
+                        const std::shared_ptr<const void> &owner,
+                        const Endpoint &endpoint,
+                        const Timeout &timeout) {
+  std::shared_ptr<const void> ticket(owner);
+  if (!AdmitSend(asio::buffer_size(data), endpoint, &ticket))
+    return;
+  RequestPtr request(request_pool_.Acquire());
+  request->Assign(data, ticket, ip::udp::endpoint(endpoint.ip, endpoint.port),
+                  timeout);
+  StartSend(request);
+}
+
+bool UdpTransport::AdmitSend(size_t size,
+                             const Endpoint &endpoint,
+                             std::shared_ptr<const void> *ticket) {
+  if (static_cast<DataSize>(size) > kMaxTransportMessageSize()) {
+    DLOG(ERROR) << "Data size " << size << " bytes (exceeds limit of "
                 << kMaxTransportMessageSize() << ")";
     (*on_error_)(kMessageSizeTooLarge, endpoint);
-    return;
+    return false;
   }
-  RequestPtr request(new UdpRequest(data, ep, asio_service_, timeout));
-  strand_.dispatch(std::bind(&UdpTransport::DoSend,
-                             shared_from_this(), request));
+  // The message is counted against the outbound limits until the request
+  // releases the ticket.
+  if (!outbound_limiter_->Acquire(endpoint, size, ticket)) {
+    (*on_error_)(kSendStalled, endpoint);
+    return false;
+  }
+  return true;
+}
+
+void UdpTransport::StartSend(RequestPtr request) {
+  // Requests are spread across the shards in turn.
+  std::shared_ptr<UdpTransport> shard(shared_from_this());
+  if (!shards_.empty()) {
+    size_t index(next_shard_++ % (shards_.size() + 1));
+    if (index != 0)
+      shard = shards_.at(index - 1);
+  }
+  shard->strand_.dispatch(std::bind(&UdpTransport::DoSend, shard, request));
+}
+
+void UdpTransport::SetOutboundLimits(const OutboundLimits &limits) {
+  outbound_limiter_->set_limits(limits);
 }
 
 void UdpTransport::DoSend(RequestPtr request) {
   // Open a socket for sending if we don't have one already.
   if (!socket_) {
     socket_.reset(new ip::udp::socket(asio_service_));
-    sender_endpoint_.reset(new ip::udp::endpoint);
-    read_buffer_.reset(new std::vector<unsigned char>(0xffff));
+    PrepareRead();
 
     bs::error_code ec;
     socket_->open(request->Endpoint().protocol(), ec);
@@ -143,6 +446,15 @@ void UdpTransport::DoSend(RequestPtr request) {
       return;
     }
 
+    ip::udp::socket::non_blocking_io nbio(true);
+    socket_->io_control(nbio, ec);
+    if (ec) {
+      socket_.reset();
+      (*on_error_)(kSetOptionFailure, Endpoint(request->Endpoint().address(),
+                                               request->Endpoint().port()));
+      return;
+    }
+
     // Passing 0 as the port number will bind the socket to an OS-assigned port.
     socket_->bind(ip::udp::endpoint(request->Endpoint().protocol(), 0), ec);
     if (ec) {
@@ -156,31 +468,68 @@ void UdpTransport::DoSend(RequestPtr request) {
   }
 
   // Generate a new id for the message.
-  uint64_t request_id = next_request_id_++;
+  uint64_t request_id = next_request_id_;
+  next_request_id_ += shard_count_;
   if (next_request_id_ == 0)
-    ++next_request_id_;
+    next_request_id_ += shard_count_;
 
-  // Encode the size of the message data.
-  DataSize size = static_cast<DataSize>(request->Data().size());
-  std::array<unsigned char, 4> size_buffer;
-  for (int i = 0; i != 4; ++i)
-    size_buffer[i] = static_cast<char>(size >> (8 * (3 - i)));
+  QueueSend(QueuedSend(request, request_id, false));
+}
 
-  // There's no need to encode the ids as they are opaque to the peer.
-  std::array<uint64_t, 2> ids;
-  ids[0] = request_id;
-  ids[1] = request->ReplyToId();
-
-  // There's no need to do an asynchronous operation here as UDP sends
-  // generally don't block.
-  std::array<boost::asio::const_buffer, 3> asio_buffer;
-  asio_buffer[0] = boost::asio::buffer(size_buffer.data(),
-                                       size_buffer.size());
-  asio_buffer[1] = boost::asio::buffer(ids.data(),
-                                       ids.size() * sizeof(uint64_t));
-  asio_buffer[2] = boost::asio::buffer(request->Data());
+void UdpTransport::QueueSend(const QueuedSend &queued_send) {
+  send_queue_.push_back(queued_send);
+  UpdateEgressDepth();
+  if (flush_pending_ || awaiting_writable_)
+    return;
+  flush_pending_ = true;
+#ifdef MAIDSAFE_LINUX
+  if (send_batch_) {
+    // Rather than sending this request straight away, let any other handlers
+    // already waiting in the strand queue their requests too, so that they
+    // can all go in one sendmmsg.
+    strand_.post(std::bind(&UdpTransport::FlushSends, shared_from_this()));
+    return;
+  }
+#endif
+  FlushSends();
+}
+
+bs::error_code UdpTransport::Transmit(const UdpRequest &request,
+                                      uint64_t request_id,
+                                      size_t *fragment) {
+  if (IsFragmented(request))
+    return SendFragments(request, request_id, fragment);
+
+  DatagramHeader header;
+  EncodeHeader(request, request_id, &header);
+
+  // The socket is non-blocking, so that a full send buffer leaves the
+  // datagram queued rather than holding up the strand.
+  ConstBuffers asio_buffer;
+  asio_buffer.reserve(2 + request.Data().size());
+  asio_buffer.push_back(boost::asio::buffer(header.size.data(),
+                                            header.size.size()));
+  asio_buffer.push_back(boost::asio::buffer(header.ids.data(),
+                                            header.ids.size() *
+                                                sizeof(uint64_t)));
+  asio_buffer.insert(asio_buffer.end(), request.Data().begin(),
+                     request.Data().end());
   bs::error_code ec;
-  socket_->send_to(asio_buffer, request->Endpoint(), 0, ec);
+  socket_->send_to(asio_buffer, request.Endpoint(), 0, ec);
+  return ec;
+}
+
+void UdpTransport::HandleSent(RequestPtr request,
+                              uint64_t request_id,
+                              const bs::error_code &ec) {
+  // A request which may be retransmitted keeps its data until it is answered
+  // or times out. Responses aren't retransmitted, as a lost response is sent
+  // again when the request is.
+  bool retransmit(UdpParameters::max_retransmissions != 0 &&
+                  request->ReplyTimeout() != kImmediateTimeout &&
+                  request->ReplyToId() == 0);
+  if (ec || !retransmit)
+    request->ReleaseData();
   if (ec) {
     (*on_error_)(kSendFailure, Endpoint(request->Endpoint().address(),
                                         request->Endpoint().port()));
@@ -189,11 +538,238 @@ void UdpTransport::DoSend(RequestPtr request) {
 
   // The message has been sent successfully, start waiting for a reply.
   if (request->ReplyTimeout() != kImmediateTimeout) {
-    outstanding_requests_[request_id] = request;
-    request->WaitForTimeout(strand_.wrap(std::bind(&UdpTransport::HandleTimeout,
-                                                   shared_from_this(),
-                                                   request_id, args::_1)));
+    OutstandingRequest outstanding;
+    outstanding.request = request;
+    outstanding.sent_at = TimingWheel::Now();
+    outstanding.deadline = outstanding.sent_at + request->ReplyTimeout();
+    if (retransmit)
+      outstanding.retransmit_timeout = RetransmitTimeout(request->Endpoint());
+    outstanding.transmissions = 1;
+    outstanding_requests_.Insert(request_id, outstanding);
+    ScheduleReplyTimeout(request_id, outstanding);
+  }
+}
+
+void UdpTransport::ScheduleReplyTimeout(uint64_t request_id,
+                                        const OutstandingRequest &outstanding) {
+  bptime::ptime expiry(outstanding.deadline);
+  if (!outstanding.retransmit_timeout.is_special())
+    expiry = std::min(expiry,
+                      outstanding.sent_at + outstanding.retransmit_timeout);
+  timing_wheel_->Schedule(outstanding.request->ReplyTimer(), expiry,
+                          strand_.wrap(std::bind(&UdpTransport::HandleTimeout,
+                                                 shared_from_this(),
+                                                 request_id)));
+}
+
+bs::error_code UdpTransport::SendFragments(const UdpRequest &request,
+                                           uint64_t request_id,
+                                           size_t *fragment) {
+  size_t size(asio::buffer_size(request.Data()));
+  size_t header_length(kSizeLength + kIdsLength + kFragmentFieldsLength);
+  size_t capacity(UdpParameters::mtu > header_length ?
+                  UdpParameters::mtu - header_length : 1);
+  size_t count((size + capacity - 1) / capacity);
+  // The data is spread evenly, so that the last fragment isn't much smaller
+  // than the rest.
+  size_t fragment_size((size + count - 1) / count);
+
+  DatagramHeader header;
+  EncodeHeader(request, request_id, &header);
+  EncodeUint32(static_cast<uint32_t>(size) | kFragmentFlag,
+               header.size.data());
+  std::array<unsigned char, kFragmentFieldsLength> fields;
+  EncodeUint32(static_cast<uint32_t>(count), &fields[4]);
+
+  // If the socket's send buffer fills, the fragments still to be sent are
+  // sent once it becomes writable.
+  bs::error_code ec;
+  ConstBuffers asio_buffer;
+  for (; *fragment != count; ++*fragment) {
+    EncodeUint32(static_cast<uint32_t>(*fragment), &fields[0]);
+    size_t offset(*fragment * fragment_size);
+    asio_buffer.clear();
+    asio_buffer.push_back(asio::buffer(header.size.data(), header.size.size()));
+    asio_buffer.push_back(asio::buffer(header.ids.data(), kIdsLength));
+    asio_buffer.push_back(asio::buffer(fields));
+    AppendRange(request.Data(), offset, std::min(fragment_size, size - offset),
+                &asio_buffer);
+    socket_->send_to(asio_buffer, request.Endpoint(), 0, ec);
+    if (ec)
+      break;
+  }
+  return ec;
+}
+
+void UdpTransport::FlushSends() {
+  while (!send_queue_.empty() && !awaiting_writable_) {
+    // The socket may have been closed while the flush was pending.
+    if (!socket_->is_open()) {
+      SendQueue failed;
+      failed.swap(send_queue_);
+      for (auto it = failed.begin(); it != failed.end(); ++it)
+        FinishSend(*it, asio::error::bad_descriptor);
+      break;
+    }
+
+#ifdef MAIDSAFE_LINUX
+    if (send_batch_ && !IsFragmented(*send_queue_.front().request)) {
+      SendBatched();
+      continue;
+    }
+#endif
+
+    QueuedSend &front(send_queue_.front());
+    bs::error_code ec(Transmit(*front.request, front.request_id,
+                               &front.fragment));
+    if (ec == asio::error::would_block || ec == asio::error::try_again) {
+      WaitUntilWritable();
+      break;
+    }
+    QueuedSend sent(front);
+    send_queue_.pop_front();
+    FinishSend(sent, ec);
   }
+  flush_pending_ = false;
+  UpdateEgressDepth();
+}
+
+#ifdef MAIDSAFE_LINUX
+void UdpTransport::SendBatched() {
+  // Each datagram is gathered from its header and the request's buffers.
+  // The iovecs are all added before any are referred to, as adding them may
+  // move them. Only the requests at the front of the queue which fit in one
+  // datagram go in the batch.
+  SendBatch &batch(*send_batch_);
+  size_t count(0);
+  batch.iovecs.clear();
+  while (count != std::min(send_queue_.size(), batch.messages.size()) &&
+         !IsFragmented(*send_queue_.at(count).request)) {
+    const UdpRequest &request(*send_queue_.at(count).request);
+    DatagramHeader &header(batch.headers.at(count));
+    EncodeHeader(request, send_queue_.at(count).request_id, &header);
+    iovec iov;
+    iov.iov_base = header.size.data();
+    iov.iov_len = header.size.size();
+    batch.iovecs.push_back(iov);
+    iov.iov_base = header.ids.data();
+    iov.iov_len = header.ids.size() * sizeof(uint64_t);
+    batch.iovecs.push_back(iov);
+    for (auto it = request.Data().begin(); it != request.Data().end(); ++it) {
+      iov.iov_base = const_cast<void*>(asio::buffer_cast<const void*>(*it));
+      iov.iov_len = asio::buffer_size(*it);
+      batch.iovecs.push_back(iov);
+    }
+    ++count;
+  }
+  size_t offset(0);
+  for (size_t i = 0; i != count; ++i) {
+    const UdpRequest &request(*send_queue_.at(i).request);
+    msghdr &message(batch.messages.at(i).msg_hdr);
+    std::memset(&message, 0, sizeof(message));
+    message.msg_name = const_cast<sockaddr*>(request.Endpoint().data());
+    message.msg_namelen = request.Endpoint().size();
+    message.msg_iov = &batch.iovecs.at(offset);
+    message.msg_iovlen = 2 + request.Data().size();
+    offset += message.msg_iovlen;
+  }
+
+  // The call stops at the first datagram which fails, so a failure is
+  // reported against that datagram alone and the rest are retried. If the
+  // send buffer is full, the batch waits for the socket to become writable.
+  int result(::sendmmsg(socket_->native_handle(), &batch.messages.at(0),
+                        static_cast<unsigned int>(count), 0));
+  if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return WaitUntilWritable();
+  bs::error_code ec;
+  size_t sent(static_cast<size_t>(result));
+  if (result < 0) {
+    ec = bs::error_code(errno, asio::error::get_system_category());
+    sent = 1;
+  }
+  // The sent requests are removed from the queue before they are finished,
+  // as finishing one may queue more.
+  std::vector<QueuedSend> finished(send_queue_.begin(),
+                                   send_queue_.begin() + sent);
+  send_queue_.erase(send_queue_.begin(), send_queue_.begin() + sent);
+  for (auto it = finished.begin(); it != finished.end(); ++it)
+    FinishSend(*it, ec);
+}
+#endif
+
+void UdpTransport::FinishSend(const QueuedSend &queued_send,
+                              const bs::error_code &ec) {
+  // A retransmitted request is already awaiting its reply, and if this
+  // transmission failed, the next may succeed.
+  if (!queued_send.retransmission) {
+    HandleSent(queued_send.request, queued_send.request_id, ec);
+  } else if (ec) {
+    DLOG(WARNING) << "Failed to retransmit request to "
+                  << queued_send.request->Endpoint() << ": " << ec.message();
+  }
+}
+
+void UdpTransport::WaitUntilWritable() {
+  awaiting_writable_ = true;
+  socket_->async_send(asio::null_buffers(),
+                      strand_.wrap(std::bind(&UdpTransport::HandleWritable,
+                                             shared_from_this(), args::_1)));
+}
+
+void UdpTransport::HandleWritable(const bs::error_code&) {
+  // If the socket has been closed, the flush fails the queued requests.
+  awaiting_writable_ = false;
+  flush_pending_ = true;
+  FlushSends();
+}
+
+void UdpTransport::UpdateEgressDepth() {
+  egress_depth_ = send_queue_.size();
+  if (send_queue_.size() > peak_egress_depth_)
+    peak_egress_depth_ = send_queue_.size();
+}
+
+size_t UdpTransport::egress_queue_depth() const {
+  size_t depth(egress_depth_);
+  for (auto it = shards_.begin(); it != shards_.end(); ++it)
+    depth += (*it)->egress_depth_;
+  return depth;
+}
+
+size_t UdpTransport::peak_egress_queue_depth() const {
+  size_t depth(peak_egress_depth_);
+  for (auto it = shards_.begin(); it != shards_.end(); ++it)
+    depth = std::max(depth, static_cast<size_t>((*it)->peak_egress_depth_));
+  return depth;
+}
+
+size_t UdpTransport::buffer_pool_allocations() const {
+  size_t allocations(buffer_pool_.allocations());
+  for (auto it = shards_.begin(); it != shards_.end(); ++it)
+    allocations += (*it)->buffer_pool_.allocations();
+  return allocations;
+}
+
+size_t UdpTransport::request_pool_allocations() const {
+  size_t allocations(request_pool_.allocations());
+  for (auto it = shards_.begin(); it != shards_.end(); ++it)
+    allocations += (*it)->request_pool_.allocations();
+  return allocations;
+}
+
+void UdpTransport::PrepareRead() {
+#ifdef MAIDSAFE_LINUX
+  if (UdpParameters::batch_size > 1) {
+    read_batch_.reset(new ReadBatch(UdpParameters::batch_size,
+                                    &buffer_pool_));
+    send_batch_.reset(new SendBatch(UdpParameters::batch_size));
+    return;
+  }
+  read_batch_.reset();
+  send_batch_.reset();
+#endif
+  sender_endpoint_.reset(new ip::udp::endpoint);
+  read_buffer_ = buffer_pool_.Acquire();
 }
 
 void UdpTransport::CloseSocket(SocketPtr socket) {
@@ -204,6 +780,19 @@ void UdpTransport::CloseSocket(SocketPtr socket) {
 void UdpTransport::StartRead() {
   assert(socket_->is_open());
 
+#ifdef MAIDSAFE_LINUX
+  if (read_batch_) {
+    // Wait for the socket to become readable, and then read as many waiting
+    // datagrams as the batch holds in one call.
+    socket_->async_receive(asio::null_buffers(),
+                           strand_.wrap(std::bind(
+                               &UdpTransport::HandleReadBatch,
+                               shared_from_this(), socket_, read_batch_,
+                               args::_1)));
+    return;
+  }
+#endif
+
   socket_->async_receive_from(asio::buffer(*read_buffer_),
                               *sender_endpoint_,
                               strand_.wrap(std::bind(&UdpTransport::HandleRead,
@@ -222,48 +811,237 @@ void UdpTransport::HandleRead(SocketPtr socket,
   if (!socket->is_open())
     return;
 
+  // The handlers may keep hold of the received data, so subsequent datagrams
+  // are read into another buffer.
+  if (!ec && HandleDatagram(read_buffer, bytes_transferred, *sender_endpoint))
+    read_buffer_ = buffer_pool_.Acquire();
+
+  StartRead();
+}
+
+#ifdef MAIDSAFE_LINUX
+void UdpTransport::HandleReadBatch(SocketPtr socket,
+                                   ReadBatchPtr batch,
+                                   const bs::error_code &ec) {
+  if (!socket->is_open())
+    return;
+
+  if (ec)
+    return StartRead();
+
+  for (size_t i = 0; i != batch->messages.size(); ++i) {
+    batch->iovecs[i].iov_base = batch->buffers[i]->data();
+    batch->iovecs[i].iov_len = batch->buffers[i]->size();
+    msghdr &message(batch->messages[i].msg_hdr);
+    std::memset(&message, 0, sizeof(message));
+    message.msg_name = batch->senders[i].data();
+    message.msg_namelen = batch->senders[i].capacity();
+    message.msg_iov = &batch->iovecs[i];
+    message.msg_iovlen = 1;
+  }
+  int result(::recvmmsg(socket->native_handle(), &batch->messages.at(0),
+                        static_cast<unsigned int>(batch->messages.size()),
+                        MSG_DONTWAIT, NULL));
+  size_t count(result < 0 ? 0 : static_cast<size_t>(result));
+  for (size_t i = 0; i != count; ++i) {
+    batch->senders[i].resize(batch->messages[i].msg_hdr.msg_namelen);
+    if (HandleDatagram(batch->buffers[i], batch->messages[i].msg_len,
+                       batch->senders[i]))
+      batch->buffers[i] = buffer_pool_.Acquire();
+  }
+
+  // A full batch means more datagrams are probably waiting, so read again
+  // once any other handlers queued in the strand have run. Otherwise the
+  // socket has been drained, and we wait for it to become readable.
+  if (count == batch->messages.size())
+    strand_.post(std::bind(&UdpTransport::HandleReadBatch, shared_from_this(),
+                           socket, batch, bs::error_code()));
+  else
+    StartRead();
+}
+#endif
+
+bool UdpTransport::HandleDatagram(const BufferPtr &read_buffer,
+                                  size_t bytes_transferred,
+                                  const ip::udp::endpoint &sender_endpoint) {
   // Ignore any message that is too short to contain all necessary fields.
-  const size_t size_length = 4;
-  const size_t ids_length = 2 * sizeof(uint64_t);
-  if (!ec && bytes_transferred >= size_length + ids_length) {
-    DataSize size = (((((read_buffer->at(0) << 8) |
-                      read_buffer->at(1)) << 8) |
-                      read_buffer->at(2)) << 8) |
-                      read_buffer->at(3);
-
-    // Check the size matches the actual amount of data received.
-    if (size_length + ids_length + size == bytes_transferred) {
-      // There's no need to decode the ids as they treated as opaque values.
-      std::array<uint64_t, 2> ids;
-      std::memcpy(ids.data(), &(*read_buffer)[size_length], ids_length);
-      uint64_t request_id = ids[0];
-      uint64_t reply_to_id = ids[1];
-
-      // If this is a reply we can remove the corresponding outstanding request.
-      // Removal of the request will cancel the WaitForTimeout operation.
-      if (reply_to_id != 0) {
-        RequestMap::iterator request = outstanding_requests_.find(reply_to_id);
-        if (request == outstanding_requests_.end())
-          return;  // Late or unexpected reply is ignored.
-        outstanding_requests_.erase(request);
-      }
-
-      std::string data(read_buffer->begin() + size_length + ids_length,
-                       read_buffer->begin() + size_length + ids_length + size);
-
-      Info info;
-      info.endpoint.ip = sender_endpoint->address();
-      info.endpoint.port = sender_endpoint->port();
-      // info.rtt = ?;
-
-      // Dispatch the message outside the strand.
-      strand_.get_io_service().post(std::bind(&UdpTransport::DispatchMessage,
-                                              shared_from_this(),
-                                              data, info, request_id));
+  if (bytes_transferred < kSizeLength + kIdsLength)
+    return false;
+
+  uint32_t size(DecodeUint32(read_buffer->data()));
+
+  // There's no need to decode the ids as they treated as opaque values.
+  std::array<uint64_t, 2> ids;
+  std::memcpy(ids.data(), &(*read_buffer)[kSizeLength], kIdsLength);
+  uint64_t request_id = ids[0];
+  uint64_t reply_to_id = ids[1];
+
+  // The kernel picks the shard to read a datagram by its source, so a reply
+  // may need passing to the shard which sent the request.
+  if (reply_to_id != 0 && shard_count_ > 1 &&
+      reply_to_id % shard_count_ != shard_index_) {
+    std::shared_ptr<UdpTransport> shard(
+        shard_table_->at(reply_to_id % shard_count_).lock());
+    if (!shard)
+      return false;
+    shard->strand_.post(std::bind(&UdpTransport::HandleForwardedDatagram,
+                                  shard, read_buffer, bytes_transferred,
+                                  sender_endpoint));
+    return true;
+  }
+
+  if ((size & kFragmentFlag) != 0) {
+    HandleFragment(read_buffer, bytes_transferred, sender_endpoint,
+                   size & ~kFragmentFlag, request_id, reply_to_id);
+    return false;
+  }
+
+  // Check the size matches the actual amount of data received.
+  if (kSizeLength + kIdsLength + size != bytes_transferred)
+    return false;
+
+  return DeliverMessage(read_buffer, kSizeLength + kIdsLength, size,
+                        sender_endpoint, request_id, reply_to_id);
+}
+
+void UdpTransport::HandleForwardedDatagram(
+    BufferPtr read_buffer,
+    size_t bytes_transferred,
+    ip::udp::endpoint sender_endpoint) {
+  HandleDatagram(read_buffer, bytes_transferred, sender_endpoint);
+}
+
+void UdpTransport::HandleFragment(const BufferPtr &read_buffer,
+                                  size_t bytes_transferred,
+                                  const ip::udp::endpoint &sender_endpoint,
+                                  size_t size,
+                                  uint64_t request_id,
+                                  uint64_t reply_to_id) {
+  const size_t header_length(kSizeLength + kIdsLength + kFragmentFieldsLength);
+  if (bytes_transferred < header_length)
+    return;
+  const unsigned char *fields(&(*read_buffer)[kSizeLength + kIdsLength]);
+  size_t index(DecodeUint32(fields));
+  size_t count(DecodeUint32(fields + 4));
+
+  // Ignore any fragment which doesn't fit the message it claims to be part of.
+  if (count == 0 || index >= count || count > size ||
+      size > static_cast<size_t>(kMaxFragmentedMessageSize))
+    return;
+  size_t fragment_size((size + count - 1) / count);
+  size_t offset(index * fragment_size);
+  if (offset >= size ||
+      header_length + std::min(fragment_size, size - offset) !=
+          bytes_transferred)
+    return;
+
+  MessageKey key(sender_endpoint, request_id);
+  ReassemblyMap::iterator it(reassemblies_.find(key));
+  if (it == reassemblies_.end()) {
+    // Don't hold on to a reply which nobody is waiting for.
+    if (reply_to_id != 0 && !outstanding_requests_.Find(reply_to_id))
+      return;
+    if (reassembly_bytes_ + size > UdpParameters::reassembly_budget) {
+      DLOG(WARNING) << "Dropping fragment of " << size << " byte message from "
+                    << sender_endpoint << " (reassembly budget exhausted)";
+      return;
     }
+    ReassemblyPtr reassembly(std::make_shared<Reassembly>(size, count,
+                                                          reply_to_id));
+    it = reassemblies_.insert(std::make_pair(key, reassembly)).first;
+    reassembly_bytes_ += size;
+    timing_wheel_->Schedule(&reassembly->timer,
+                            TimingWheel::Now() +
+                                UdpParameters::reassembly_timeout,
+                            strand_.wrap(std::bind(
+                                &UdpTransport::HandleReassemblyTimeout,
+                                shared_from_this(), key)));
   }
 
-  StartRead();
+  ReassemblyPtr reassembly(it->second);
+  if (reassembly->data->size() != size ||
+      reassembly->received.size() != count ||
+      reassembly->reply_to_id != reply_to_id)
+    return;
+  if (reassembly->received[index])
+    return;  // A duplicate fragment is ignored.
+  std::memcpy(&(*reassembly->data)[offset], fields + kFragmentFieldsLength,
+              bytes_transferred - header_length);
+  reassembly->received[index] = true;
+  if (--reassembly->remaining != 0)
+    return;
+
+  timing_wheel_->Cancel(&reassembly->timer);
+  reassemblies_.erase(it);
+  reassembly_bytes_ -= size;
+  DeliverMessage(reassembly->data, 0, size, sender_endpoint, request_id,
+                 reply_to_id);
+}
+
+void UdpTransport::HandleReassemblyTimeout(const MessageKey &key) {
+  ReassemblyMap::iterator it(reassemblies_.find(key));
+  if (it == reassemblies_.end())
+    return;
+  DLOG(WARNING) << "Dropping incomplete " << it->second->data->size()
+                << " byte message from " << key.first << " ("
+                << it->second->remaining << " fragments missing)";
+  reassembly_bytes_ -= it->second->data->size();
+  reassemblies_.erase(it);
+}
+
+bool UdpTransport::DeliverMessage(const BufferPtr &buffer,
+                                  size_t offset,
+                                  size_t size,
+                                  const ip::udp::endpoint &sender_endpoint,
+                                  uint64_t request_id,
+                                  uint64_t reply_to_id) {
+  // If this is a reply we can remove the corresponding outstanding request
+  // and cancel its timeout.
+  if (reply_to_id != 0) {
+    OutstandingRequest *outstanding = outstanding_requests_.Find(reply_to_id);
+    if (!outstanding)
+      return false;  // Late or unexpected reply is ignored.
+    timing_wheel_->Cancel(outstanding->request->ReplyTimer());
+    // Only a request sent once gives an unambiguous round trip time.
+    if (!outstanding->retransmit_timeout.is_special() &&
+        outstanding->transmissions == 1)
+      UpdateRtt(sender_endpoint, TimingWheel::Now() - outstanding->sent_at);
+    FinishRequest(reply_to_id, outstanding);
+  } else if (UdpParameters::response_cache_size != 0 &&
+             IsDuplicate(MessageKey(sender_endpoint, request_id))) {
+    return false;
+  }
+
+  Info info;
+  info.endpoint.ip = sender_endpoint.address();
+  info.endpoint.port = sender_endpoint.port();
+  // info.rtt = ?;
+
+  // Dispatch the message outside the strand.
+  if (on_buffer_received_->empty()) {
+    std::string data(buffer->begin() + offset,
+                     buffer->begin() + offset + size);
+    strand_.get_io_service().post(std::bind(&UdpTransport::DispatchMessage,
+                                            shared_from_this(),
+                                            data, info, request_id));
+    return false;
+  }
+
+  if (size <= kMaxCopiedMessageSize && size < buffer->size()) {
+    BufferPtr copy(std::make_shared<std::vector<unsigned char>>(
+        buffer->begin() + offset, buffer->begin() + offset + size));
+    strand_.get_io_service().post(std::bind(&UdpTransport::DispatchBuffer,
+                                            shared_from_this(),
+                                            SharedBuffer(copy, 0, size),
+                                            info, request_id));
+    return false;
+  }
+
+  SharedBuffer data(buffer, offset, size);
+  strand_.get_io_service().post(std::bind(&UdpTransport::DispatchBuffer,
+                                          shared_from_this(),
+                                          data, info, request_id));
+  return true;
 }
 
 void UdpTransport::DispatchMessage(const std::string &data,
@@ -272,29 +1050,151 @@ void UdpTransport::DispatchMessage(const std::string &data,
   std::string response;
   Timeout response_timeout(kImmediateTimeout);
   (*on_message_received_)(data, info, &response, &response_timeout);
+  SendResponse(response, response_timeout, info, reply_to_id);
+}
+
+void UdpTransport::DispatchBuffer(const SharedBuffer &data,
+                                  const Info &info,
+                                  uint64_t reply_to_id) {
+  std::string response;
+  Timeout response_timeout(kImmediateTimeout);
+  (*on_buffer_received_)(data, info, &response, &response_timeout);
+  SendResponse(response, response_timeout, info, reply_to_id);
+}
 
-  if (!response.empty()) {
-    ip::udp::endpoint ep(info.endpoint.ip, info.endpoint.port);
-    RequestPtr request(new UdpRequest(response, ep,
-                                      asio_service_,
-                                      response_timeout,
-                                      reply_to_id));
-    strand_.dispatch(std::bind(&UdpTransport::DoSend,
-                               shared_from_this(), request));
-  }
-}
-
-void UdpTransport::HandleTimeout(uint64_t request_id,
-                                 const bs::error_code &ec) {
-  if (!ec) {
-    RequestMap::iterator request = outstanding_requests_.find(request_id);
-    if (request != outstanding_requests_.end()) {
-      Endpoint peer_endpoint((*request).second->Endpoint().address(),
-                             (*request).second->Endpoint().port());
-      outstanding_requests_.erase(request);
-      (*on_error_)(kReceiveTimeout, peer_endpoint);
+void UdpTransport::SendResponse(const std::string &response,
+                                const Timeout &response_timeout,
+                                const Info &info,
+                                uint64_t reply_to_id) {
+  if (response.empty())
+    return;
+
+  ip::udp::endpoint ep(info.endpoint.ip, info.endpoint.port);
+  RequestPtr request(request_pool_.Acquire());
+  if (UdpParameters::response_cache_size == 0) {
+    request->AssignCopy(response, std::shared_ptr<const void>(), ep,
+                        response_timeout, reply_to_id);
+    strand_.dispatch(std::bind(&UdpTransport::DoSend, shared_from_this(),
+                               request));
+    return;
+  }
+
+  // A cached response outlives the request, so it has storage of its own.
+  std::shared_ptr<std::string> owner(std::make_shared<std::string>(response));
+  request->Assign(ConstBuffers(1, asio::buffer(*owner)), owner, ep,
+                  response_timeout, reply_to_id);
+  strand_.dispatch(std::bind(&UdpTransport::DoSendResponse,
+                             shared_from_this(), request, owner));
+}
+
+void UdpTransport::DoSendResponse(RequestPtr request,
+                                  std::shared_ptr<std::string> response) {
+  ResponseCache::iterator it(response_cache_.find(
+      MessageKey(request->Endpoint(), request->ReplyToId())));
+  if (it != response_cache_.end())
+    it->second = response;
+  DoSend(request);
+}
+
+bool UdpTransport::IsDuplicate(const MessageKey &key) {
+  ResponseCache::iterator it(response_cache_.find(key));
+  if (it == response_cache_.end()) {
+    response_cache_.insert(std::make_pair(key,
+                                          std::shared_ptr<std::string>()));
+    response_cache_order_.push_back(key);
+    while (response_cache_order_.size() > UdpParameters::response_cache_size) {
+      response_cache_.erase(response_cache_order_.front());
+      response_cache_order_.pop_front();
     }
+    return false;
+  }
+
+  // A request still being handled is ignored, and one which has been answered
+  // is sent the same response. The response isn't itself awaiting a reply.
+  if (it->second) {
+    RequestPtr request(request_pool_.Acquire());
+    request->Assign(ConstBuffers(1, asio::buffer(*it->second)), it->second,
+                    key.first, kImmediateTimeout, key.second);
+    DoSend(request);
+  }
+  return true;
+}
+
+void UdpTransport::HandleTimeout(uint64_t request_id) {
+  OutstandingRequest *outstanding = outstanding_requests_.Find(request_id);
+  if (!outstanding)
+    return;
+
+  // Send the request again with the same id, so that the peer can recognise
+  // it, if it still has time to be answered, waiting twice as long for the
+  // reply as last time.
+  bptime::ptime now(TimingWheel::Now());
+  if (now < outstanding->deadline &&
+      outstanding->transmissions <= UdpParameters::max_retransmissions &&
+      !outstanding->retransmit_timeout.is_special()) {
+    ++outstanding->transmissions;
+    outstanding->sent_at = now;
+    outstanding->retransmit_timeout =
+        std::min(outstanding->retransmit_timeout * 2, kMaxRetransmitTimeout);
+    ScheduleReplyTimeout(request_id, *outstanding);
+    QueueSend(QueuedSend(outstanding->request, request_id, true));
+    return;
+  }
+
+  Endpoint peer_endpoint(outstanding->request->Endpoint().address(),
+                         outstanding->request->Endpoint().port());
+  FinishRequest(request_id, outstanding);
+  (*on_error_)(kReceiveTimeout, peer_endpoint);
+}
+
+void UdpTransport::FinishRequest(uint64_t request_id,
+                                 OutstandingRequest *outstanding) {
+  // A retransmission still waiting to be sent would go out without its data.
+  if (outstanding->transmissions > 1) {
+    for (auto it = send_queue_.begin(); it != send_queue_.end();) {
+      if (it->retransmission && it->request_id == request_id)
+        it = send_queue_.erase(it);
+      else
+        ++it;
+    }
+    UpdateEgressDepth();
+  }
+  outstanding->request->ReleaseData();
+  outstanding_requests_.Erase(request_id);
+}
+
+bptime::time_duration UdpTransport::RetransmitTimeout(
+    const ip::udp::endpoint &peer) const {
+  PeerRttMap::const_iterator it(peer_rtts_.find(peer));
+  if (it == peer_rtts_.end())
+    return UdpParameters::initial_retransmit_timeout;
+  return it->second.rto;
+}
+
+void UdpTransport::UpdateRtt(const ip::udp::endpoint &peer,
+                             const bptime::time_duration &rtt) {
+  // The estimate is made as for TCP in RFC 6298, with the timeout bounded
+  // below by the resolution of the timing wheel rather than a second.
+  PeerRttMap::iterator it(peer_rtts_.find(peer));
+  if (it == peer_rtts_.end()) {
+    if (peer_rtts_.size() >= kMaxPeerRttCount)
+      peer_rtts_.erase(peer_rtts_.begin());
+    it = peer_rtts_.insert(std::make_pair(peer, PeerRtt())).first;
+    it->second.srtt = rtt;
+    it->second.rttvar = rtt / 2;
+  } else {
+    PeerRtt &estimate(it->second);
+    bptime::time_duration error(estimate.srtt - rtt);
+    if (error.is_negative())
+      error = error.invert_sign();
+    estimate.rttvar = (estimate.rttvar * 3 + error) / 4;
+    estimate.srtt = (estimate.srtt * 7 + rtt) / 8;
   }
+  PeerRtt &estimate(it->second);
+  estimate.rto = estimate.srtt + std::max(kTimerResolution,
+                                          estimate.rttvar * 4);
+  estimate.rto = std::max(estimate.rto, kMinRetransmitTimeout);
+  estimate.rto = std::min(estimate.rto, kMaxRetransmitTimeout);
 }
 
 }  // namespace transport
@@ -28,14 +28,20 @@ THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef MAIDSAFE_TRANSPORT_UDP_TRANSPORT_H_
 #define MAIDSAFE_TRANSPORT_UDP_TRANSPORT_H_
 
+#include <atomic>
 #include <cstdint>
-#include <unordered_map>
+#include <deque>
+#include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include "boost/asio/io_service.hpp"
 #include "boost/asio/ip/udp.hpp"
 #include "boost/asio/strand.hpp"
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "maidsafe/transport/flat_id_map.h"
+#include "maidsafe/transport/shared_pool.h"
 #include "maidsafe/transport/transport.h"
 #include "maidsafe/transport/version.h"
 
@@ -49,8 +55,14 @@ namespace maidsafe {
 
 namespace transport {
 
+class OutboundLimiter;
+class TimingWheel;
 class UdpRequest;
 
+namespace test {
+class UdpTransportTest;
+}  // namespace test
+
 #ifdef __GNUC__
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Weffc++"
@@ -70,7 +82,29 @@ class UdpTransport : public Transport,
   virtual void Send(const std::string &data,
                     const Endpoint &endpoint,
                     const Timeout &timeout);
-  static DataSize kMaxTransportMessageSize() { return 65535; }
+  virtual void Send(const ConstBuffers &data,
+                    const std::shared_ptr<const void> &owner,
+                    const Endpoint &endpoint,
+                    const Timeout &timeout);
+  virtual void SetOutboundLimits(const OutboundLimits &limits);
+  // The number of messages waiting to be sent, across all of the transport's
+  // sockets, and the most there have been waiting on any one socket. Messages
+  // wait while a socket's send buffer is full, and in batch mode, until the
+  // batch is sent.
+  size_t egress_queue_depth() const;
+  size_t peak_egress_queue_depth() const;
+  // The number of receive buffers and requests created, across all of the
+  // transport's sockets. Both are reused once released, so these stop growing
+  // under steady traffic.
+  size_t buffer_pool_allocations() const;
+  size_t request_pool_allocations() const;
+  // If messages are fragmented (see UdpParameters::mtu), the reassembly
+  // budget, or the most which fits in one datagram if that is larger, up to
+  // 64 MiB. Otherwise 65535 bytes.
+  static DataSize kMaxTransportMessageSize();
+
+  friend class test::UdpTransportTest;
+
  private:
   UdpTransport(const UdpTransport&);
   UdpTransport &operator=(const UdpTransport&);
@@ -79,29 +113,192 @@ class UdpTransport : public Transport,
   typedef std::shared_ptr<boost::asio::ip::udp::endpoint> EndpointPtr;
   typedef std::shared_ptr<std::vector<unsigned char>> BufferPtr;
   typedef std::shared_ptr<UdpRequest> RequestPtr;
-  typedef std::unordered_map<uint64_t, RequestPtr> RequestMap;
+  // A request awaiting its reply, with the times it was last sent and will
+  // time out, and if it may be retransmitted, the time to wait for the reply
+  // before doing so. Requests are held by pointer, so their timers don't
+  // move as the map grows.
+  struct OutstandingRequest {
+    OutstandingRequest()
+        : request(),
+          sent_at(),
+          deadline(),
+          retransmit_timeout(boost::posix_time::pos_infin),
+          transmissions(0) {}
+    RequestPtr request;
+    boost::posix_time::ptime sent_at, deadline;
+    boost::posix_time::time_duration retransmit_timeout;
+    size_t transmissions;
+  };
+  typedef FlatIdMap<OutstandingRequest> RequestMap;
+  // The smoothed round trip time to a peer and its variation, from which the
+  // time to wait before retransmitting a request to it is derived.
+  struct PeerRtt {
+    PeerRtt() : srtt(), rttvar(), rto() {}
+    boost::posix_time::time_duration srtt, rttvar, rto;
+  };
+  typedef std::map<boost::asio::ip::udp::endpoint, PeerRtt> PeerRttMap;
+  // Storage for reading and writing several datagrams in one system call,
+  // which is only used on Linux.
+  struct ReadBatch;
+  struct SendBatch;
+  typedef std::shared_ptr<ReadBatch> ReadBatchPtr;
+  // A request waiting to be sent, and if it is split into fragments, the
+  // next to send. A retransmitted request is already awaiting its reply.
+  struct QueuedSend {
+    QueuedSend(RequestPtr request_in,
+               uint64_t request_id_in,
+               bool retransmission_in)
+        : request(request_in),
+          request_id(request_id_in),
+          fragment(0),
+          retransmission(retransmission_in) {}
+    RequestPtr request;
+    uint64_t request_id;
+    size_t fragment;
+    bool retransmission;
+  };
+  typedef std::deque<QueuedSend> SendQueue;
+  // Messages being reassembled from fragments, keyed by their sender and
+  // request id.
+  struct Reassembly;
+  typedef std::shared_ptr<Reassembly> ReassemblyPtr;
+  typedef std::pair<boost::asio::ip::udp::endpoint, uint64_t> MessageKey;
+  typedef std::map<MessageKey, ReassemblyPtr> ReassemblyMap;
+  // The responses to recently received requests, which are null until the
+  // response has been sent.
+  typedef std::map<MessageKey, std::shared_ptr<std::string>> ResponseCache;
 
+  static BufferPtr CreateBuffer();
+  static RequestPtr CreateRequest();
+  // Opens the socket and binds it to the endpoint, sharing the port with the
+  // transport's other shards if reuse_port is set.
+  TransportCondition Listen(const boost::asio::ip::udp::endpoint &endpoint,
+                            bool reuse_port);
+  // Checks the size of a message given to Send() and counts it against the
+  // outbound limits, returning false if it can't be sent.
+  bool AdmitSend(size_t size,
+                 const Endpoint &endpoint,
+                 std::shared_ptr<const void> *ticket);
+  void StartSend(RequestPtr request);
   void DoSend(RequestPtr request);
+  void HandleSent(RequestPtr request,
+                  uint64_t request_id,
+                  const boost::system::error_code &ec);
+  void QueueSend(const QueuedSend &queued_send);
+  void FlushSends();
+  void SendBatched();
+  void FinishSend(const QueuedSend &queued_send,
+                  const boost::system::error_code &ec);
+  void WaitUntilWritable();
+  void HandleWritable(const boost::system::error_code &ec);
+  void UpdateEgressDepth();
+  boost::system::error_code Transmit(const UdpRequest &request,
+                                     uint64_t request_id,
+                                     size_t *fragment);
+  boost::system::error_code SendFragments(const UdpRequest &request,
+                                          uint64_t request_id,
+                                          size_t *fragment);
   static void CloseSocket(SocketPtr socket);
 
+  void PrepareRead();
   void StartRead();
   void HandleRead(SocketPtr socket,
                   BufferPtr read_buffer,
                   EndpointPtr sender_endpoint,
                   const boost::system::error_code &ec,
                   size_t bytes_transferred);
+  void HandleReadBatch(SocketPtr socket,
+                       ReadBatchPtr batch,
+                       const boost::system::error_code &ec);
+  // Dispatches a received datagram, returning true if the handlers have been
+  // given a share of its buffer.
+  bool HandleDatagram(const BufferPtr &read_buffer,
+                      size_t bytes_transferred,
+                      const boost::asio::ip::udp::endpoint &sender_endpoint);
+  void HandleFragment(const BufferPtr &read_buffer,
+                      size_t bytes_transferred,
+                      const boost::asio::ip::udp::endpoint &sender_endpoint,
+                      size_t size,
+                      uint64_t request_id,
+                      uint64_t reply_to_id);
+  void HandleReassemblyTimeout(const MessageKey &key);
+  void HandleForwardedDatagram(BufferPtr read_buffer,
+                               size_t bytes_transferred,
+                               boost::asio::ip::udp::endpoint sender_endpoint);
+  // Dispatches a complete message held in the buffer at the given offset,
+  // returning true if the handlers have been given a share of the buffer.
+  bool DeliverMessage(const BufferPtr &buffer,
+                      size_t offset,
+                      size_t size,
+                      const boost::asio::ip::udp::endpoint &sender_endpoint,
+                      uint64_t request_id,
+                      uint64_t reply_to_id);
   void DispatchMessage(const std::string &data,
                        const Info &info,
                        uint64_t reply_to_id);
-  void HandleTimeout(uint64_t request_id,
-                     const boost::system::error_code &ec);
+  void DispatchBuffer(const SharedBuffer &data,
+                      const Info &info,
+                      uint64_t reply_to_id);
+  void SendResponse(const std::string &response,
+                    const Timeout &response_timeout,
+                    const Info &info,
+                    uint64_t reply_to_id);
+  void DoSendResponse(RequestPtr request,
+                      std::shared_ptr<std::string> response);
+  // Returns true if the request has been received before, in which case any
+  // response already sent is sent again.
+  bool IsDuplicate(const MessageKey &key);
+  void ScheduleReplyTimeout(uint64_t request_id,
+                            const OutstandingRequest &outstanding);
+  void HandleTimeout(uint64_t request_id);
+  // Forgets a request which has been answered or has timed out, releasing its
+  // data and its place in the outbound limits.
+  void FinishRequest(uint64_t request_id, OutstandingRequest *outstanding);
+  boost::posix_time::time_duration RetransmitTimeout(
+      const boost::asio::ip::udp::endpoint &peer) const;
+  void UpdateRtt(const boost::asio::ip::udp::endpoint &peer,
+                 const boost::posix_time::time_duration &rtt);
 
   boost::asio::io_service::strand strand_;
   SocketPtr socket_;
+  // Datagrams are read into buffers from buffer_pool_, and messages are sent
+  // from requests taken from request_pool_, so that neither is allocated per
+  // message.
+  SharedPool<std::vector<unsigned char>> buffer_pool_;
+  SharedPool<UdpRequest> request_pool_;
   BufferPtr read_buffer_;
   EndpointPtr sender_endpoint_;
   uint64_t next_request_id_;
   RequestMap outstanding_requests_;
+  // Reply timeouts are tracked by a timing wheel rather than a deadline_timer
+  // per request.
+  std::shared_ptr<TimingWheel> timing_wheel_;
+  ReadBatchPtr read_batch_;
+  std::shared_ptr<SendBatch> send_batch_;
+  // Requests are queued with their ids until the next flush, which in batch
+  // mode is posted to the strand, and while the socket's send buffer is full.
+  SendQueue send_queue_;
+  bool flush_pending_, awaiting_writable_;
+  std::atomic<size_t> egress_depth_, peak_egress_depth_;
+  ReassemblyMap reassemblies_;
+  // The total size of the messages in reassemblies_.
+  size_t reassembly_bytes_;
+  PeerRttMap peer_rtts_;
+  // Requests are forgotten in the order they were received once the cache
+  // is full.
+  ResponseCache response_cache_;
+  std::deque<MessageKey> response_cache_order_;
+  // When listening with several sockets (see UdpParameters::socket_count),
+  // each further socket belongs to a transport of its own, which shares this
+  // one's signals. Every shard generates request ids congruent to its index
+  // modulo the number of shards, so that a reply read by the wrong socket can
+  // be passed to the shard awaiting it.
+  size_t shard_index_, shard_count_;
+  std::vector<std::shared_ptr<UdpTransport>> shards_;
+  std::shared_ptr<std::vector<std::weak_ptr<UdpTransport>>> shard_table_;
+  std::atomic<size_t> next_shard_;
+  // Accounts for the messages accepted by Send() until they are sent.
+  std::shared_ptr<OutboundLimiter> outbound_limiter_;
 };
 
 }  // namespace transport